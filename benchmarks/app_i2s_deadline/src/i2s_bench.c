@@ -0,0 +1,205 @@
+/**
+ * @file i2s_bench.c
+ * @brief Deadline benchmark of a reference I2S output loop on the uDSP-Card ports.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The loop drives BCLK, LRCLK and up to I2S_LINES data lines with 32 bit buffered
+ * ports, computing every sample through a synthetic DSP load. The bit clock is
+ * derived from the 100MHz reference clock so the benchmark runs in xsim without
+ * an external MCLK. The divider is rounded so BCLK is never slower than on the
+ * board, which leaves a slightly tighter budget than the hardware.
+ *
+ * Per frame the loop measures the time from releasing the previous frame to the
+ * port until the next frame is ready. The slack is the frame period minus this
+ * time, a negative slack is a missed deadline.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xs1.h>
+#include <xclib.h>
+#include <xcore/clock.h>
+#include <xcore/hwtimer.h>
+#include <xcore/port.h>
+
+#include "udsp_card_board.h"
+#include "i2s_bench.h"
+
+#define I2S_BENCH_BITS_PER_FRAME (I2S_CHANS_PER_FRAME * I2S_DATA_BITS)
+
+static const port_t i2s_bench_data_ports[] = {
+    UDSP_CARD_PORT_I2S_D0,
+    UDSP_CARD_PORT_I2S_D1,
+    UDSP_CARD_PORT_I2S_D2,
+    UDSP_CARD_PORT_I2S_D3,
+    UDSP_CARD_PORT_I2S_D4,
+};
+
+static const unsigned i2s_bench_rates[] = {48000, 96000, 192000};
+
+/** Cleared when the sweep is done, stops the background load threads. */
+static volatile int i2s_bench_running = 1;
+
+typedef struct
+{
+    unsigned fs;          // Nominal sample rate
+    unsigned lines;       // Data lines driven
+    unsigned period;      // Frame period in reference ticks
+    int32_t worst_slack;  // Smallest slack seen in reference ticks
+    uint64_t busy;        // Sum of the time from release to frame ready
+    unsigned missed;      // Frames with negative slack
+} i2s_bench_result_t;
+
+/**
+ * @brief Synthetic per-sample DSP work of I2S_BENCH_MACS multiply-accumulates.
+ **/
+static inline int32_t i2s_bench_dsp(int32_t x, unsigned n)
+{
+    int64_t acc = x;
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        acc += (int64_t)x * (int32_t)(i | 1);
+        // Keep the compiler from folding the loop
+        asm volatile("" : "+r"(acc));
+    }
+    return (int32_t)(acc >> 32) ^ x;
+}
+
+/**
+ * @brief Start the I2S ports with BCLK = 100MHz / (2 * div).
+ **/
+static void i2s_bench_start(unsigned lines, unsigned div)
+{
+    xclock_t bclk = UDSP_CARD_CLKBLK_I2S_BCLK;
+
+    clock_enable(bclk);
+    clock_set_source_clk_ref(bclk);
+    clock_set_divide(bclk, div);
+
+    port_enable(UDSP_CARD_PORT_I2S_BCLK);
+    port_set_clock(UDSP_CARD_PORT_I2S_BCLK, bclk);
+    port_set_out_clock(UDSP_CARD_PORT_I2S_BCLK);
+
+    port_start_buffered(UDSP_CARD_PORT_I2S_LRCLK, 32);
+    port_set_clock(UDSP_CARD_PORT_I2S_LRCLK, bclk);
+
+    for (unsigned i = 0; i < lines; i++)
+    {
+        port_start_buffered(i2s_bench_data_ports[i], 32);
+        port_set_clock(i2s_bench_data_ports[i], bclk);
+    }
+
+    clock_start(bclk);
+}
+
+static void i2s_bench_stop(unsigned lines)
+{
+    clock_stop(UDSP_CARD_CLKBLK_I2S_BCLK);
+
+    for (unsigned i = 0; i < lines; i++)
+    {
+        port_disable(i2s_bench_data_ports[i]);
+    }
+    port_disable(UDSP_CARD_PORT_I2S_LRCLK);
+    port_disable(UDSP_CARD_PORT_I2S_BCLK);
+    clock_disable(UDSP_CARD_CLKBLK_I2S_BCLK);
+}
+
+/**
+ * @brief Run one configuration and fill in the result.
+ **/
+static void i2s_bench_run(i2s_bench_result_t *res)
+{
+    int32_t samples[I2S_LINES][I2S_CHANS_PER_FRAME] = {{0}};
+    unsigned div = XS1_TIMER_HZ / (2 * res->fs * I2S_BENCH_BITS_PER_FRAME);
+    uint32_t released, ready;
+
+    res->period = 2 * div * I2S_BENCH_BITS_PER_FRAME;
+    res->worst_slack = INT32_MAX;
+    res->busy = 0;
+    res->missed = 0;
+
+    i2s_bench_start(res->lines, div);
+    released = get_reference_time();
+
+    for (unsigned frame = 0; frame < I2S_BENCH_WARMUP + I2S_BENCH_FRAMES; frame++)
+    {
+        for (unsigned l = 0; l < res->lines; l++)
+        {
+            for (unsigned c = 0; c < I2S_CHANS_PER_FRAME; c++)
+            {
+                samples[l][c] = i2s_bench_dsp(samples[l][c] + frame, I2S_BENCH_MACS);
+            }
+        }
+
+        ready = get_reference_time();
+        if (frame >= I2S_BENCH_WARMUP)
+        {
+            int32_t slack = (int32_t)res->period - (int32_t)(ready - released);
+
+            res->busy += ready - released;
+            res->worst_slack = slack < res->worst_slack ? slack : res->worst_slack;
+            res->missed += slack < 0;
+        }
+
+        // I2S is MSB first, LRCLK is low for the left channel
+        for (unsigned c = 0; c < I2S_CHANS_PER_FRAME; c++)
+        {
+            for (unsigned l = 0; l < res->lines; l++)
+            {
+                port_out(i2s_bench_data_ports[l], bitrev(samples[l][c]));
+            }
+            port_out(UDSP_CARD_PORT_I2S_LRCLK, c ? 0xFFFFFFFF : 0);
+        }
+        released = get_reference_time();
+    }
+
+    i2s_bench_stop(res->lines);
+}
+
+void i2s_bench(void)
+{
+    i2s_bench_result_t res;
+    unsigned failed = 0;
+
+    printf("I2S deadline benchmark: %u frames, %u MACs/sample, %u load threads\n", I2S_BENCH_FRAMES, I2S_BENCH_MACS,
+           I2S_BENCH_LOAD_THREADS);
+    printf("%7s %5s %10s %12s %12s %8s %7s\n", "fs", "lines", "period", "sample [ns]", "worst slack", "util %",
+           "missed");
+
+    for (unsigned r = 0; r < sizeof(i2s_bench_rates) / sizeof(i2s_bench_rates[0]); r++)
+    {
+        for (unsigned lines = 1; lines <= I2S_LINES; lines++)
+        {
+            res.fs = i2s_bench_rates[r];
+            res.lines = lines;
+            i2s_bench_run(&res);
+
+            printf("%7u %5u %10u %12u %12ld %8u %7u\n", res.fs, res.lines, res.period,
+                   res.period * (1000 / XS1_TIMER_MHZ) / (lines * I2S_CHANS_PER_FRAME), (long)res.worst_slack,
+                   (unsigned)(res.busy * 100 / ((uint64_t)res.period * I2S_BENCH_FRAMES)), res.missed);
+
+            failed += res.missed != 0;
+        }
+    }
+
+    i2s_bench_running = 0;
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    exit(failed ? 1 : 0);
+}
+
+void i2s_bench_load(void)
+{
+    uint32_t x = 1;
+
+    while (i2s_bench_running)
+    {
+        x = x * 1664525 + 1013904223;
+    }
+}
@@ -0,0 +1,41 @@
+/**
+ * @file i2s_bench.h
+ * @brief Deadline benchmark of a reference I2S output loop on the uDSP-Card ports.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#pragma once
+
+/** @defgroup I2S_Bench_Config Benchmark Configuration
+ *  @brief Override with -D in APP_COMPILER_FLAGS.
+ *  @{
+ */
+#ifndef I2S_BENCH_FRAMES
+#define I2S_BENCH_FRAMES 1000 // Frames measured per configuration
+#endif
+
+#ifndef I2S_BENCH_WARMUP
+#define I2S_BENCH_WARMUP 16 // Frames run before measuring, fills the port buffers
+#endif
+
+#ifndef I2S_BENCH_MACS
+#define I2S_BENCH_MACS 0 // Synthetic DSP load per sample in multiply-accumulates
+#endif
+
+#ifndef I2S_BENCH_LOAD_THREADS
+#define I2S_BENCH_LOAD_THREADS 7 // Busy threads sharing tile 1 with the I2S loop, 7 fills the tile
+#endif
+/** @} */
+
+/**
+ * @brief Run the sweep over sample rates and line counts and print one result row
+ * per configuration. Exits with status 1 if any configuration missed a deadline.
+ */
+void i2s_bench(void);
+
+/**
+ * @brief Background thread that competes for issue slots until i2s_bench() is done.
+ */
+void i2s_bench_load(void);
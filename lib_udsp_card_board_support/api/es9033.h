@@ -21,6 +21,8 @@
  */
 #define ES9033_I2C_DEVICE_ADDR (0x96 >> 1)    // R/W and R-only registers. A system clock must be present. (0x90, 0x92, 0x94, 0x96)
 #define ES9033_I2C_DEVICE_ADDR_SS (0x9E >> 1) // W-only registers. No system clock necessary. (098, 0x9A, 0x9C, 0x9E)
+#define ES9033_I2C_ADDR(pins) ((0x90 >> 1) + ((pins) & 0x03))    // R/W address for the address pin setting 0-3
+#define ES9033_I2C_ADDR_SS(pins) ((0x98 >> 1) + ((pins) & 0x03)) // W-only address for the address pin setting 0-3
 /** @} */
 
 /**
@@ -60,7 +62,7 @@
  * @name Master Clock Configuration Register (0x03) (R/W)
  * @{
  */
-#define ES9033_REG_MASTER_CLOCK_CONFIG x03
+#define ES9033_REG_MASTER_CLOCK_CONFIG 0x03
 #define ES9033_BIT_SELECT_MENC_HALF (1 << 7)    // (0) Half clock divide value
 #define ES9033_MASK_SELECT_MENC_NUM (0x7F << 0) // (7) Whole number divide value + 1
 /** @} */
@@ -324,7 +326,7 @@
  */
 #define ES9033_REG_TDM_SLOT_CONFIG 0x2A
 #define ES9033_MASK_CONFIG_CH2_SLOT_SEL (0x0F << 4) // (1) CH2 data slot selection. CH2 receives data from Mth slot. M = TDM_CH2_SLOT_SEL + 1
-#define ES9033_MASK_CONFIG_CH1_SLOT_SEL (0x0F << 0) // (1) CH1 data slot selection. CH1 receives data from Nth slot. N = TDM_CH1_SLOT_SEL + 1
+#define ES9033_MASK_CONFIG_CH1_SLOT_SEL (0x0F << 0) // (0) CH1 data slot selection. CH1 receives data from Nth slot. N = TDM_CH1_SLOT_SEL + 1
 /** @} */
 
 /**
@@ -787,6 +789,212 @@
 /** @} */
 /** @} */ // End of ES9033_Registers group
 
+/**
+ * @brief Maximum number of registers written in a single burst transaction.
+ */
+#define ES9033_BURST_MAX_LEN 16
+
+/**
+ * @brief Additional attempts of a register write the DAC did not acknowledge.
+ */
+#ifndef ES9033_WRITE_RETRIES
+#define ES9033_WRITE_RETRIES 1
+#endif
+
+/**
+ * @brief I2C bus statistics of the ES9033 driver.
+ */
+typedef struct
+{
+    unsigned transactions; // Number of I2C transactions (start to stop)
+    unsigned bytes;        // Number of bytes on the bus, including the device address
+    unsigned errors;       // Writes and register reads that failed, after retries
+    unsigned retries;      // Writes repeated after a missing acknowledge
+} es9033_i2c_stats_t;
+
+/**
+ * @brief Number of cached registers: 0x00-0x58 (R/W) followed by 0xC0-0xCB (W only).
+ */
+#define ES9033_SHADOW_SIZE ((ES9033_REG_MASTER_TRIM + 1) + (ES9033_REG_PLL8 - ES9033_REG_RESET_PLL1 + 1))
+
+/**
+ * @brief Maximum number of clean registers a flush rewrites to join two dirty
+ * registers into one burst instead of starting a new transaction.
+ */
+#define ES9033_FLUSH_MAX_GAP 2
+
+/**
+ * @brief Shadow copy of the writable ES9033 register file.
+ */
+typedef struct
+{
+    uint8_t regs[ES9033_SHADOW_SIZE];                // Cached register values
+    uint32_t dirty[(ES9033_SHADOW_SIZE + 31) / 32]; // Registers changed since the last flush
+} es9033_shadow_t;
+
+/**
+ * @brief Registers changed by a suspend, restored on resume.
+ */
+typedef struct
+{
+    int suspended;  // Set between suspend and resume
+    uint8_t system; // ES9033_REG_SYSTEM_CONFIG before the suspend
+    uint8_t analog; // ES9033_REG_ANALOG_CTRL_CONFIG before the suspend
+    uint8_t resync; // ES9033_REG_RESYNC_CONFIG before the suspend
+    uint8_t mute;   // ES9033_REG_MUTE_CTRL before the suspend
+} es9033_suspend_t;
+
+/**
+ * @brief One ES9033 on the I2C bus, set up with es9033_dev_init().
+ */
+typedef struct
+{
+    uint8_t addr;             // I2C address of the R/W and R-only registers
+    uint8_t addr_ss;          // I2C address of the W-only registers
+    es9033_shadow_t shadow;   // Shadow of the writable register file
+    es9033_suspend_t suspend; // Suspend state
+} es9033_dev_t;
+
+/**
+ * @brief Maximum number of DACs in a group, one per address pin setting.
+ */
+#define ES9033_GROUP_MAX 4
+
+/**
+ * @brief DACs on one I2C bus that are configured together.
+ */
+typedef struct
+{
+    es9033_dev_t *devs[ES9033_GROUP_MAX]; // Members, in the order they are written
+    unsigned num;                         // Number of members
+} es9033_group_t;
+
+/** @defgroup ES9033_Profiles ES9033 Init Profiles
+ *  @brief Constant register tables for the bring-up sequence, generated and
+ *  range checked at build time from the MCLK and sample rate.
+ *  @{
+ */
+
+/**
+ * @name Init Profile Layout
+ * @{
+ */
+#define ES9033_STEP_MAX_LEN 3          // Longest step, the clock divider block 0x02-0x04
+#define ES9033_PROFILE_STEPS 7         // Number of steps in the bring-up sequence
+#define ES9033_READY_TIMEOUT_US 100000 // Upper bound for a step waiting on the DAC clock
+#define ES9033_MUTE_TIMEOUT_US 20000   // Upper bound for the soft mute ramp down
+#define ES9033_POLL_INTERVAL_US 50     // Pause between two reads of a status register while waiting
+/** @} */
+
+/**
+ * @brief One step of an init profile: a register burst followed by a delay.
+ */
+typedef struct
+{
+    uint8_t addr;                      // Register bank, ES9033_I2C_DEVICE_ADDR(_SS), mapped to the address pair of each device
+    uint8_t reg;                       // First register of the burst
+    uint8_t len;                       // Number of registers in the burst
+    uint8_t wait_mask;                 // INTERRUPT_STATE2 flags to wait for after the burst, 0 for none
+    uint16_t delay_us;                 // Delay after the burst in microseconds
+    uint8_t vals[ES9033_STEP_MAX_LEN]; // Register values
+} es9033_step_t;
+
+/**
+ * @brief Init profile for one MCLK and sample rate combination.
+ */
+typedef struct
+{
+    unsigned mclk_freq;                         // MCLK frequency in Hz
+    unsigned fs;                                // Sample rate in Hz
+    es9033_step_t steps[ES9033_PROFILE_STEPS]; // Bring-up sequence
+} es9033_profile_t;
+
+/**
+ * @name Clock Configuration Helpers
+ * @{
+ */
+#define ES9033_2X_MODE(fs) ((fs) > 384000)                                        // 768k runs the core at 384k in 2x mode
+#define ES9033_CORE_FS(fs) (ES9033_2X_MODE(fs) ? (fs) / 2 : (fs))                 // Sample rate of the DAC core
+#define ES9033_IDAC_NUM(mclk, fs) ((mclk) / (128 * ES9033_CORE_FS(fs)) - 1)       // SELECT_IDAC_NUM for CLK_IDAC = 128fs
+#define ES9033_CP_CLOCK_DIV(mclk) (((mclk) + 4 * 768000) / (8 * 768000) - 1)      // CP_CLOCK_DIV for a ~768kHz PNEG charge pump
+#define ES9033_CLOCK_VALID(mclk, fs) (ES9033_CORE_FS(fs) != 0 &&                   \
+                                      (mclk) % (128 * ES9033_CORE_FS(fs)) == 0 && \
+                                      (mclk) / (128 * ES9033_CORE_FS(fs)) >= 1 && \
+                                      ES9033_IDAC_NUM(mclk, fs) <= ES9033_MASK_SELECT_IDAC_NUM)
+/** @} */
+
+/**
+ * @name Build-Time Table Generation
+ * @{
+ */
+#define ES9033_BUILD_ASSERT(cond) (0 * sizeof(char[(cond) ? 1 : -1])) // Fails to compile if cond is false
+#define ES9033_WRITABLE(reg, len) ((reg) + (len) - 1 <= ES9033_REG_MASTER_TRIM || \
+                                   (ES9033_REG_RESET_PLL1 <= (reg) && (reg) + (len) - 1 <= ES9033_REG_PLL8))
+#define ES9033_STEP_LEN(...) (sizeof((const uint8_t[]){__VA_ARGS__}))
+
+#define ES9033_STEP(reg_, wait_mask_, delay_us_, ...)                                                     \
+    {                                                                                                     \
+        .addr = ((reg_) <= ES9033_REG_MASTER_TRIM ? ES9033_I2C_DEVICE_ADDR : ES9033_I2C_DEVICE_ADDR_SS) + \
+                ES9033_BUILD_ASSERT(ES9033_WRITABLE(reg_, ES9033_STEP_LEN(__VA_ARGS__)) &&                \
+                                    ES9033_STEP_LEN(__VA_ARGS__) <= ES9033_STEP_MAX_LEN),                 \
+        .reg = (reg_),                                                                                    \
+        .len = ES9033_STEP_LEN(__VA_ARGS__),                                                              \
+        .wait_mask = (wait_mask_),                                                                        \
+        .delay_us = (delay_us_),                                                                          \
+        .vals = {__VA_ARGS__},                                                                            \
+    }
+
+/**
+ * @brief Generate the init profile for I2S input with the given MCLK and sample rate.
+ * Fails to compile if the MCLK is not a supported multiple of the sample rate.
+ */
+#define ES9033_PROFILE(mclk_, fs_)                                                                     \
+    {                                                                                                  \
+        .mclk_freq = (mclk_) + ES9033_BUILD_ASSERT(ES9033_CLOCK_VALID(mclk_, fs_)),                    \
+        .fs = (fs_),                                                                                   \
+        .steps = {                                                                                     \
+            /* Set GPIO1/MCLK to input, Invert CLKHV phase for better DNR */                           \
+            /* Bypass PLL, Disable 10k DVDD shunt, Set PLL input MUX to MCLK, Enable PLL input MUX */  \
+            ES9033_STEP(ES9033_REG_RESET_PLL1, 0, 0,                                                   \
+                        ES9033_BIT_GPIO1_SDB_SYNC | ES9033_BIT_PLL_CLKHV_PHASE,                        \
+                        ES9033_BIT_PLL_BYPASS | ES9033_BIT_DVDD_SHUNTB | ES9033_BIT_EN_PLL_CLKIN),     \
+            /* Enable PLL 1.2V regulator (PLL7 MSB), PLL3-PLL7 MID are left untouched */               \
+            /* The slave registers need no system clock, wait for a valid MCLK before the next step */ \
+            ES9033_STEP(ES9033_REG_PLL7_MSB, ES9033_BIT_CLK_AVALID_INT, 0,                             \
+                        (ES9033_BIT_PLL_REG_PDB_1V2 >> 16)),                                           \
+            /* Set the MCLK/FS rate, Master clock divider reset value, PNEG charge pump clock */       \
+            ES9033_STEP(ES9033_REG_DAC_CLOCK_CONFIG, 0, 0,                                             \
+                        ES9033_IDAC_NUM(mclk_, fs_),                                                   \
+                        0x07,                                                                          \
+                        ES9033_CP_CLOCK_DIV(mclk_)),                                                   \
+            /* Toggle DAC clock resync to line up all the clocks in the DAC core */                    \
+            ES9033_STEP(ES9033_REG_RESYNC_CONFIG, 0, 0, ES9033_BIT_SYNC_DAC_CLK_DIV),                  \
+            ES9033_STEP(ES9033_REG_RESYNC_CONFIG, 0, 0,                                                \
+                        ES9033_BIT_DOP_CLK_RESYNC | ES9033_BIT_VOL_THD_RESYNC |                        \
+                            ES9033_BIT_FIR_RESYNC | ES9033_BIT_FS_RESYNC),                             \
+            ES9033_STEP(ES9033_REG_RESYNC_CONFIG, 0, 0, 0),                                            \
+            /* Enable audio, Enable interpolation and modulator clock, Enable analog section */        \
+            ES9033_STEP(ES9033_REG_SYSTEM_CONFIG, 0, 10,                                               \
+                        ES9033_BIT_ENABLE_ANALOG_DAC_CH1 | ES9033_BIT_ENABLE_ANALOG_DAC_CH2 |          \
+                            ES9033_BIT_ENABLE_NSMOD | ES9033_BIT_ENABLE_DAC |                          \
+                            ES9033_BIT_AMP_MODE_REG |                                                  \
+                            (ES9033_2X_MODE(fs_) ? ES9033_BIT_ENABLE_2X_MODE : 0)),                    \
+        },                                                                                             \
+    }
+/** @} */
+
+/**
+ * @name Predefined Init Profiles
+ * @{
+ */
+extern const es9033_profile_t es9033_profile_44k1; // MCLK = 45.1584MHz, fs = 44.1kHz
+extern const es9033_profile_t es9033_profile_48k;  // MCLK = 49.152MHz, fs = 48kHz
+extern const es9033_profile_t es9033_profile_96k;  // MCLK = 49.152MHz, fs = 96kHz
+extern const es9033_profile_t es9033_profile_192k; // MCLK = 49.152MHz, fs = 192kHz
+extern const es9033_profile_t es9033_profile_384k; // MCLK = 49.152MHz, fs = 384kHz
+/** @} */
+/** @} */ // End of ES9033_Profiles group
+
 /**
  * @brief Initializes the ES9033 DAC with default settings.
  * This function configures the ES9033 for I2S, MCLK = 49.152MHz,
@@ -796,3 +1004,693 @@
  * @return 0 on success, -1 on failure.
  **/
 int es9033_init(i2c_master_t *i2c_ctx);
+
+/**
+ * @brief Initializes the ES9033 DAC by running an init profile, e.g. one
+ * generated with ES9033_PROFILE(). I2S input, DRE enabled, automute enabled.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_init_profile(i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief First half of es9033_init_profile(): reset the shadow and write the
+ * leading slave register steps. These need no system clock, so they may run
+ * while the MCLK source is still being configured.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_init_profile_ss(i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief Second half of es9033_init_profile(): wait until the DAC sees a valid
+ * MCLK, then run the remaining steps. Requires es9033_init_profile_ss().
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_init_profile_clocked(i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief Read a register of the ES9033 DAC. R/W and R-only registers are
+ * only accessible while a system clock is present.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param reg The register address to read from.
+ * @param val Pointer to store the register value.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_reg_read(i2c_master_t *i2c_ctx, uint8_t reg, uint8_t *val);
+
+/**
+ * @brief Check that the bus works at its current speed. Reads SYS_READ and
+ * CHIP_ID twice in auto-increment bursts and requires both reads to agree and
+ * the address pins in SYS_READ to match ES9033_I2C_DEVICE_ADDR. Needs a system
+ * clock at the DAC.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param chip_id Pointer to store the chip ID, may be NULL.
+ * @return 0 if the handshake passed, -1 otherwise.
+ **/
+int es9033_handshake(i2c_master_t *i2c_ctx, uint8_t *chip_id);
+
+/**
+ * @brief Check that the DAC answers on the bus without a system clock. Addresses
+ * the W-only bank and sends a register address without data, so no register is
+ * written. Tells a missing MCLK, which only NACKs the clocked bank, from a bus fault.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 0 if the DAC acknowledged, -1 otherwise.
+ **/
+int es9033_probe(i2c_master_t *i2c_ctx);
+
+/**
+ * @brief Poll ES9033_REG_INTERRUPT_STATE2 until all flags in mask are set,
+ * e.g. ES9033_BIT_CLK_AVALID_INT or ES9033_BIT_PLL_LOCKED_R_INT. The register
+ * NACKs until the DAC sees a system clock, which counts as not ready.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param mask The INTERRUPT_STATE2 flags to wait for.
+ * @param timeout_us Maximum time to wait in microseconds.
+ * @return 0 when ready, -1 on timeout.
+ **/
+int es9033_wait_ready(i2c_master_t *i2c_ctx, uint8_t mask, unsigned timeout_us);
+
+/**
+ * @brief Poll a read-only status register until all flags in mask are set.
+ * Reads are spaced ES9033_POLL_INTERVAL_US apart.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param reg The status register, e.g. ES9033_REG_DAC_STATUS_READ.
+ * @param mask The flags to wait for.
+ * @param timeout_us Maximum time to wait in microseconds.
+ * @return 0 when all flags are set, -1 on timeout.
+ **/
+int es9033_wait_status(i2c_master_t *i2c_ctx, uint8_t reg, uint8_t mask, unsigned timeout_us);
+
+/**
+ * @brief Switch the sample rate at runtime without a full re-init.
+ * Soft mutes the DAC, calls set_mclk to retune the MCLK source, reprograms the
+ * clock dividers and 2x mode (768k), resyncs the DAC core and restores the
+ * previous mute state. Requires a prior es9033_init() or es9033_init_profile().
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param mclk_freq The new MCLK frequency in Hz.
+ * @param fs The new sample rate in Hz.
+ * @param set_mclk Callback retuning the MCLK while muted, NULL if the MCLK does not change.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_set_sample_rate(i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs, void (*set_mclk)(unsigned mclk_freq));
+
+/**
+ * @brief Power the analog section down between playback sessions. Soft mutes
+ * and waits for the ramp down, then clears AMP_MODE_REG and sets CP_PDB_ON_MUTE
+ * and LP_DAC_REG. The register file is kept, so the DAC enable line may be
+ * dropped afterwards to cut power completely.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_suspend(i2c_master_t *i2c_ctx);
+
+/**
+ * @brief Resume after es9033_suspend() and restore the previous mute state.
+ * If power_lost is 0, only the registers changed by the suspend are written.
+ * If the DAC was power cycled, only registers that differ from their reset
+ * value are rewritten, without the fixed delays of the init profile.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param power_lost 1 if the DAC enable line was dropped since the DAC was configured.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_resume(i2c_master_t *i2c_ctx, int power_lost);
+
+/**
+ * @brief Check whether the DAC is suspended.
+ *
+ * @return 1 between es9033_suspend() and es9033_resume(), 0 otherwise.
+ **/
+int es9033_is_suspended();
+
+/**
+ * @name Channel Selection
+ * @{
+ */
+#define ES9033_CH1 (1 << 0)
+#define ES9033_CH2 (1 << 1)
+/** @} */
+
+/**
+ * @brief Set the channel volume. The DAC ramps to the new value at
+ * DAC_VOL_UP_RATE/DAC_VOL_DOWN_RATE.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param attenuation Attenuation in 0.5dB steps. 0: 0dB, 255: -127.5dB.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_set_volume(i2c_master_t *i2c_ctx, uint8_t ch_mask, uint8_t attenuation);
+
+/**
+ * @brief Soft mute or unmute channels.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param mute 1 to mute, 0 to unmute.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_set_mute(i2c_master_t *i2c_ctx, uint8_t ch_mask, int mute);
+
+/**
+ * @brief Select the interpolation FIR filter shape.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param shape Filter shape, ES9033_BIT_FILTER_SHAPE_1 to ES9033_BIT_FILTER_SHAPE_8.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_set_filter(i2c_master_t *i2c_ctx, uint8_t shape);
+
+/** @defgroup ES9033_Volume ES9033 Volume Engine
+ *  @brief Coalescing volume and mute control. Any thread posts the latest
+ *  target in constant time, the bus owner applies it at most once per slot
+ *  and the DAC ramps to it in hardware at DAC_VOL_UP_RATE/DAC_VOL_DOWN_RATE.
+ *  @{
+ */
+
+/**
+ * @name Volume Conversion
+ * @{
+ */
+#define ES9033_VOLUME_MIN_DB10 (-1275) // Lowest volume in 0.1dB, -127.5dB
+// Convert 0.1dB to a VOLUME register value in 0.5dB steps, constant for constant arguments
+#define ES9033_VOLUME_FROM_DB10(db10) ((db10) >= 0 ? 0 : (db10) <= ES9033_VOLUME_MIN_DB10 ? 0xFF : (-(db10) + 2) / 5)
+#ifndef ES9033_VOLUME_SLOT_US
+#define ES9033_VOLUME_SLOT_US 1000 // Minimum time between two volume bus writes
+#endif
+/** @} */
+
+/**
+ * @brief Volume engine state, shared between posting threads and the bus owner.
+ */
+typedef struct
+{
+    int16_t target_db10[2]; // Latest requested volume per channel in 0.1dB, written by posting threads
+    uint8_t target_mute;    // Latest requested mute mask (ES9033_CH1/ES9033_CH2), written by posting threads
+    uint32_t seq;           // Incremented on every request
+    uint32_t applied_seq;   // Request sequence last applied, bus owner only
+    uint32_t last_write;    // Reference time of the last bus write, bus owner only
+    unsigned requests;      // Number of requests posted
+    unsigned writes;        // Number of bus writes, requests / writes is the coalescing ratio
+} es9033_volume_t;
+
+/**
+ * @brief Initialize the volume engine at 0dB, unmuted.
+ *
+ * @param vol Pointer to the volume engine.
+ **/
+void es9033_volume_init(es9033_volume_t *vol);
+
+/**
+ * @brief Configure the hardware ramp rates used for every volume change.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param up_rate DAC_VOL_UP_RATE, 0 (instant) to 255 (fastest).
+ * @param down_rate DAC_VOL_DOWN_RATE, 0 (instant) to 255 (fastest).
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_volume_ramp(i2c_master_t *i2c_ctx, uint8_t up_rate, uint8_t down_rate);
+
+/**
+ * @brief Request a volume. Constant time, no bus access, latest request wins.
+ *
+ * @param vol Pointer to the volume engine.
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param db10 Volume in 0.1dB, 0 to ES9033_VOLUME_MIN_DB10, rounded to 0.5dB.
+ **/
+void es9033_volume_set(es9033_volume_t *vol, uint8_t ch_mask, int db10);
+
+/**
+ * @brief Request a soft mute or unmute. Constant time, no bus access.
+ *
+ * @param vol Pointer to the volume engine.
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param mute 1 to mute, 0 to unmute.
+ **/
+void es9033_volume_mute(es9033_volume_t *vol, uint8_t ch_mask, int mute);
+
+/**
+ * @brief Apply the latest requests, at most once per ES9033_VOLUME_SLOT_US.
+ * Call periodically from the thread owning the I2C bus.
+ *
+ * @param vol Pointer to the volume engine.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 1 if the DAC was written, 0 if nothing was pending or the slot has not elapsed, -1 on failure.
+ **/
+int es9033_volume_service(es9033_volume_t *vol, i2c_master_t *i2c_ctx);
+
+/**
+ * @brief Check whether the next es9033_volume_service() call writes the DAC.
+ *
+ * @param vol Pointer to the volume engine.
+ * @return 1 if a request is waiting and its slot has elapsed, 0 otherwise.
+ **/
+int es9033_volume_pending(const es9033_volume_t *vol);
+/** @} */ // End of ES9033_Volume group
+
+/** @defgroup ES9033_Monitor ES9033 Fault and Status Monitor
+ *  @brief Arms the DAC interrupt system and decodes latched interrupt sources.
+ *  With an interrupt line the bus is only touched when the line is asserted,
+ *  otherwise the latched sources are read in one burst per poll period, so
+ *  no event between two polls is lost. The interrupt line is sampled with
+ *  port_peek() each time the monitor is serviced, not waited on as a pin
+ *  change event, so the reaction time is bounded by the caller's loop period.
+ *  @{
+ */
+
+/**
+ * @name Monitor Events
+ * @{
+ */
+#define ES9033_EVENT_CLK_LOST (1 << 0)     // Clock valid flag dropped
+#define ES9033_EVENT_CLK_VALID (1 << 1)    // Clock valid flag restored
+#define ES9033_EVENT_BCK_WS_FAIL (1 << 2)  // BCK/WS ratio check failed
+#define ES9033_EVENT_PLL_UNLOCK (1 << 3)   // DAC PLL lost lock
+#define ES9033_EVENT_AUTOMUTE_ON (1 << 4)  // A channel entered automute
+#define ES9033_EVENT_AUTOMUTE_OFF (1 << 5) // A channel left automute
+/** @} */
+
+/**
+ * @name Monitor Interrupt Masks
+ * @{
+ */
+#define ES9033_MONITOR_MASK_P (ES9033_BIT_BCK_WS_FAILED_FLAG_MASKP | \
+                               ES9033_BIT_CLK_AVALID_FLAG_MASKP |    \
+                               ES9033_BIT_AUTOMUTE_FLAG_CH2_MASKP |  \
+                               ES9033_BIT_AUTOMUTE_FLAG_CH1_MASKP) // Rising edges: fault, clock restored, automute on
+#define ES9033_MONITOR_MASK_N (ES9033_BIT_CLK_AVALID_FLAG_MASKN |   \
+                               ES9033_BIT_AUTOMUTE_FLAG_CH2_MASKN | \
+                               ES9033_BIT_AUTOMUTE_FLAG_CH1_MASKN) // Falling edges: clock lost, automute off
+/** @} */
+
+/**
+ * @brief Raw interrupt registers 0xE5-0xE8, read in a single burst.
+ */
+typedef struct
+{
+    uint8_t state;   // ES9033_REG_INTERRUPT_STATE
+    uint8_t state2;  // ES9033_REG_INTERRUPT_STATE2
+    uint8_t source;  // ES9033_REG_INTERRUPT_SOURCE
+    uint8_t source2; // ES9033_REG_INTERRUPT_SOURCE2
+} es9033_irq_status_t;
+
+/**
+ * @brief Event callback, called on the thread servicing the monitor.
+ *
+ * @param events Decoded ES9033_EVENT_x flags.
+ * @param status Raw interrupt registers the events were decoded from.
+ */
+typedef void (*es9033_event_cb_t)(unsigned events, const es9033_irq_status_t *status);
+
+/**
+ * @brief Monitor state.
+ */
+typedef struct
+{
+    port_t irq_port;            // Port with the DAC interrupt line (GPIO1), 0 if not wired
+    uint32_t irq_mask;          // Interrupt line pin in irq_port, active high
+    unsigned poll_us;           // Poll period without an interrupt line
+    uint32_t last_poll;         // Reference time of the last status read
+    es9033_event_cb_t cb;       // Event callback
+    unsigned event_count;       // Number of events reported
+    const es9033_volume_t *vol; // Volume engine whose pending bursts go before a poll, NULL if none
+    unsigned deferred;          // Polls put off for a pending volume burst
+} es9033_monitor_t;
+
+/**
+ * @brief Initialize the monitor.
+ *
+ * @param mon Pointer to the monitor.
+ * @param irq_port Port with the DAC interrupt line, 0 to poll the latched sources.
+ * @param irq_mask Interrupt line pin in irq_port.
+ * @param poll_us Poll period in microseconds when irq_port is 0.
+ * @param cb Event callback.
+ **/
+void es9033_monitor_init(es9033_monitor_t *mon, port_t irq_port, uint32_t irq_mask, unsigned poll_us, es9033_event_cb_t cb);
+
+/**
+ * @brief Arm the interrupt masks with ES9033_MONITOR_MASK_P/N and clear
+ * pending sources. Routing the interrupt to GPIO1 is left to the board, as
+ * GPIO1 doubles as the MCLK input.
+ *
+ * @param mon Pointer to the monitor.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_monitor_arm(es9033_monitor_t *mon, i2c_master_t *i2c_ctx);
+
+/**
+ * @brief Put off polls while the volume engine has a burst pending, so a poll
+ * never holds up a volume or mute change on the bus. The poll runs on the next
+ * service after the burst has been written.
+ *
+ * @param mon Pointer to the monitor.
+ * @param vol Volume engine served by the same thread, NULL to poll regardless.
+ **/
+void es9033_monitor_defer(es9033_monitor_t *mon, const es9033_volume_t *vol);
+
+/**
+ * @brief Check for events and report them through the callback. Touches the
+ * bus only if the interrupt line is asserted or the poll period has elapsed.
+ * Call periodically from the thread owning the I2C bus.
+ *
+ * @param mon Pointer to the monitor.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return Decoded events, 0 if none, -1 on failure.
+ **/
+int es9033_monitor_service(es9033_monitor_t *mon, i2c_master_t *i2c_ctx);
+/** @} */ // End of ES9033_Monitor group
+
+/** @defgroup ES9033_Status ES9033 Status Snapshot and Register Dump
+ *  @brief Health checks from a single burst read of the read-only registers,
+ *  and a dump of the R/W register file to diff against an init profile or the
+ *  register shadow. The W-only slave registers cannot be read back.
+ *  @{
+ */
+
+/**
+ * @name Status and Dump Layout
+ * @{
+ */
+#define ES9033_STATUS_SIZE (ES9033_REG_DRE_STATUS_READ - ES9033_REG_SYS_READ + 1) // Read-only registers 0xE0-0xF2
+#define ES9033_STATUS_REG(status, reg) ((status)->regs[(reg) - ES9033_REG_SYS_READ]) // Raw register of a snapshot
+#define ES9033_DUMP_SIZE (ES9033_REG_MASTER_TRIM + 1)                                // R/W registers 0x00-0x58
+/** @} */
+
+/**
+ * @brief Raw read-only registers 0xE0-0xF2, read in a single burst. The
+ * reserved registers in between are included and read as 0.
+ */
+typedef struct
+{
+    uint8_t regs[ES9033_STATUS_SIZE]; // Registers from ES9033_REG_SYS_READ, see ES9033_STATUS_REG()
+} es9033_status_t;
+
+/**
+ * @brief Decoded status snapshot. Channel masks use ES9033_CH1/ES9033_CH2.
+ */
+typedef struct
+{
+    uint8_t chip_id;    // ES9033_REG_CHIP_ID
+    uint8_t addr_pins;  // Address pin setting 0-3, ES9033_BIT_SYS_ADDR1/0
+    uint8_t sys_modes;  // ES9033_MASK_SYS_MODES
+    int clk_valid;      // The DAC sees a valid system clock, ES9033_BIT_CLK_AVALID_INT
+    int pll_locked;     // The DAC PLL is locked, ES9033_BIT_PLL_LOCKED_R_INT
+    int bck_ws_fail;    // The BCK/WS ratio check fails, ES9033_BIT_BCK_WS_FAIL_INT
+    int ratio_valid;    // Auto tuning found a valid clock ratio, ES9033_BIT_RATIO_VALID
+    unsigned idac_div;  // Auto tuned IDAC divider, ES9033_MASK_IDAC_DIV_REG
+    int idac_div_half;  // Auto tuned half clock divide, ES9033_BIT_IDAC_DIV_HALF_REG
+    int tdm_valid;      // Valid TDM data, ES9033_BIT_TDM_DATA_VALID
+    int dop_valid;      // Valid DoP data, ES9033_BIT_DOP_VALID
+    int gpio1;          // GPIO1 input level, ES9033_BIT_GPIO1_I_READ
+    uint8_t vol_min;    // Channels at minimum volume
+    uint8_t automute;   // Channels in automute
+    uint8_t ramping;    // Channels in a soft ramp up or down
+    uint8_t dre_select; // Channels with DRE selected
+    unsigned events;    // Latched interrupt sources as ES9033_EVENT_x flags, not cleared
+} es9033_status_info_t;
+
+/**
+ * @brief Register dump of the R/W bank, indexed by register address. Reserved
+ * registers hold 0.
+ */
+typedef struct
+{
+    uint8_t regs[ES9033_DUMP_SIZE];
+} es9033_dump_t;
+
+/**
+ * @brief Take a status snapshot in one auto-increment burst. Needs a system
+ * clock at the DAC.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param status Pointer to store the snapshot.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_status_read(i2c_master_t *i2c_ctx, es9033_status_t *status);
+
+/**
+ * @brief Decode a status snapshot, no bus access.
+ *
+ * @param status Pointer to the snapshot.
+ * @param info Pointer to store the decoded fields.
+ **/
+void es9033_status_decode(const es9033_status_t *status, es9033_status_info_t *info);
+
+/**
+ * @brief Read the R/W register file, one burst per run of documented registers.
+ * Needs a system clock at the DAC.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param dump Pointer to store the dump.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_dump(i2c_master_t *i2c_ctx, es9033_dump_t *dump);
+
+/**
+ * @brief Expected R/W register file after an init profile: the reset defaults
+ * with the profile steps applied in order.
+ *
+ * @param dump Pointer to store the expected dump.
+ * @param profile Pointer to the init profile.
+ **/
+void es9033_dump_profile(es9033_dump_t *dump, const es9033_profile_t *profile);
+
+/**
+ * @brief Expected R/W register file from the register shadow, including
+ * changes not flushed yet.
+ *
+ * @param dump Pointer to store the expected dump.
+ **/
+void es9033_dump_shadow(es9033_dump_t *dump);
+
+/**
+ * @brief Compare the documented registers of two dumps and print every
+ * difference with debug_printf().
+ *
+ * @param dump Pointer to the dump read from the DAC.
+ * @param expected Pointer to the expected dump.
+ * @return Number of registers that differ.
+ **/
+unsigned es9033_dump_diff(const es9033_dump_t *dump, const es9033_dump_t *expected);
+/** @} */ // End of ES9033_Status group
+
+/** @defgroup ES9033_Device ES9033 Device Handles and Groups
+ *  @brief The functions without a handle address the DAC at ES9033_I2C_DEVICE_ADDR,
+ *  es9033_dev_default(). Each es9033_dev_x() function does the same as es9033_x()
+ *  on the DAC of a handle, so up to four DACs with different address pins share
+ *  a bus. The es9033_group_x() functions run a sequence on all members of a group
+ *  step by step: a step is written to every DAC back to back, then its wait or
+ *  delay is paid once, so configuring N DACs takes about as long as one.
+ *  @{
+ */
+
+/**
+ * @brief Initialize a device handle. The shadow starts at the reset defaults.
+ *
+ * @param dev Pointer to the device handle.
+ * @param pins Address pin setting 0-3, e.g. 3 for ES9033_I2C_DEVICE_ADDR.
+ **/
+void es9033_dev_init(es9033_dev_t *dev, unsigned pins);
+
+/**
+ * @brief Get the handle of the DAC addressed by the functions without a handle.
+ *
+ * @return The handle of the DAC at ES9033_I2C_DEVICE_ADDR.
+ **/
+es9033_dev_t *es9033_dev_default();
+
+int es9033_dev_init_profile(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+int es9033_dev_init_profile_ss(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+int es9033_dev_init_profile_clocked(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+int es9033_dev_reg_read(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, uint8_t *val);
+int es9033_dev_handshake(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t *chip_id);
+int es9033_dev_probe(es9033_dev_t *dev, i2c_master_t *i2c_ctx);
+int es9033_dev_wait_ready(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t mask, unsigned timeout_us);
+int es9033_dev_wait_status(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, uint8_t mask, unsigned timeout_us);
+int es9033_dev_set_sample_rate(es9033_dev_t *dev, i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs,
+                               void (*set_mclk)(unsigned mclk_freq));
+int es9033_dev_suspend(es9033_dev_t *dev, i2c_master_t *i2c_ctx);
+int es9033_dev_resume(es9033_dev_t *dev, i2c_master_t *i2c_ctx, int power_lost);
+int es9033_dev_is_suspended(const es9033_dev_t *dev);
+int es9033_dev_set_volume(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t ch_mask, uint8_t attenuation);
+int es9033_dev_set_mute(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t ch_mask, int mute);
+int es9033_dev_set_filter(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t shape);
+int es9033_dev_volume_ramp(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t up_rate, uint8_t down_rate);
+int es9033_dev_volume_service(es9033_dev_t *dev, es9033_volume_t *vol, i2c_master_t *i2c_ctx);
+int es9033_dev_monitor_arm(es9033_dev_t *dev, es9033_monitor_t *mon, i2c_master_t *i2c_ctx);
+int es9033_dev_monitor_service(es9033_dev_t *dev, es9033_monitor_t *mon, i2c_master_t *i2c_ctx);
+void es9033_dev_shadow_reset(es9033_dev_t *dev);
+int es9033_dev_reg_set(es9033_dev_t *dev, uint8_t reg, uint8_t val);
+uint8_t es9033_dev_reg_get(const es9033_dev_t *dev, uint8_t reg);
+int es9033_dev_field_set(es9033_dev_t *dev, uint8_t reg, uint32_t mask, uint32_t val);
+uint32_t es9033_dev_field_get(const es9033_dev_t *dev, uint8_t reg, uint32_t mask);
+int es9033_dev_flush(es9033_dev_t *dev, i2c_master_t *i2c_ctx);
+int es9033_dev_status_read(es9033_dev_t *dev, i2c_master_t *i2c_ctx, es9033_status_t *status);
+int es9033_dev_dump(es9033_dev_t *dev, i2c_master_t *i2c_ctx, es9033_dump_t *dump);
+void es9033_dev_dump_shadow(const es9033_dev_t *dev, es9033_dump_t *dump);
+
+/**
+ * @brief Initialize an empty group.
+ *
+ * @param group Pointer to the group.
+ **/
+void es9033_group_init(es9033_group_t *group);
+
+/**
+ * @brief Add an initialized device handle to a group.
+ *
+ * @param group Pointer to the group.
+ * @param dev Pointer to the device handle, must outlive the group.
+ * @return 0 on success, -1 if the group is full or already has a DAC at the address.
+ **/
+int es9033_group_add(es9033_group_t *group, es9033_dev_t *dev);
+
+/**
+ * @brief es9033_init_profile() on all members. The DACs must share the DAC
+ * enable line and the MCLK.
+ *
+ * @param group Pointer to the group.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 if any member failed.
+ **/
+int es9033_group_init_profile(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief es9033_init_profile_ss() on all members.
+ *
+ * @param group Pointer to the group.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 if any member failed.
+ **/
+int es9033_group_init_profile_ss(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief es9033_init_profile_clocked() on all members.
+ *
+ * @param group Pointer to the group.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param profile Pointer to the init profile.
+ * @return 0 on success, -1 if any member failed.
+ **/
+int es9033_group_init_profile_clocked(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile);
+
+/**
+ * @brief es9033_set_sample_rate() on all members, with one mute ramp, one
+ * set_mclk call and one wait for the new clock.
+ *
+ * @param group Pointer to the group.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param mclk_freq The new MCLK frequency in Hz.
+ * @param fs The new sample rate in Hz.
+ * @param set_mclk Callback retuning the shared MCLK while muted, NULL if the MCLK does not change.
+ * @return 0 on success, -1 if any member failed.
+ **/
+int es9033_group_set_sample_rate(es9033_group_t *group, i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs,
+                                 void (*set_mclk)(unsigned mclk_freq));
+
+/**
+ * @brief Set a bitfield in the shadow of every member, see es9033_field_set().
+ *
+ * @param group Pointer to the group.
+ * @param reg The register address holding the least significant byte of the mask.
+ * @param mask The field mask as defined in this header.
+ * @param val The unshifted field value.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_group_field_set(es9033_group_t *group, uint8_t reg, uint32_t mask, uint32_t val);
+
+/**
+ * @brief Write the dirty registers of every member, see es9033_flush().
+ *
+ * @param group Pointer to the group.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 0 on success, -1 if any member failed.
+ **/
+int es9033_group_flush(es9033_group_t *group, i2c_master_t *i2c_ctx);
+/** @} */ // End of ES9033_Device group
+
+/**
+ * @brief Get the I2C bus statistics accumulated since the last reset.
+ * Consecutive registers are written as auto-increment bursts, so the
+ * transaction count reflects the start/address/stop overhead paid.
+ *
+ * @param stats Pointer to store the statistics.
+ **/
+void es9033_i2c_stats_get(es9033_i2c_stats_t *stats);
+
+/**
+ * @brief Reset the I2C bus statistics.
+ **/
+void es9033_i2c_stats_reset();
+
+/**
+ * @brief Reset the register shadow to the documented reset defaults and
+ * clear all dirty flags. Call after the DAC has been power cycled.
+ **/
+void es9033_shadow_reset();
+
+/**
+ * @brief Set a register in the shadow only. The register is marked dirty
+ * if its value changes and is written on the next es9033_flush().
+ *
+ * @param reg The register address.
+ * @param val The new register value.
+ * @return 0 on success, -1 if the register is not a documented writable register.
+ **/
+int es9033_reg_set(uint8_t reg, uint8_t val);
+
+/**
+ * @brief Get a register value from the shadow, no bus access.
+ *
+ * @param reg The register address.
+ * @return The cached value, 0 if the register is not cached.
+ **/
+uint8_t es9033_reg_get(uint8_t reg);
+
+/**
+ * @brief Set a bitfield in the shadow only, e.g.
+ * es9033_field_set(ES9033_REG_RESET_PLL1, ES9033_MASK_PLL_VCO_I, 6).
+ * Masks wider than 8 bits span the following registers (LSB first), so
+ * 16- and 24-bit fields are addressed through their LSB register.
+ *
+ * @param reg The register address holding the least significant byte of the mask.
+ * @param mask The field mask as defined in this header.
+ * @param val The unshifted field value.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_field_set(uint8_t reg, uint32_t mask, uint32_t val);
+
+/**
+ * @brief Get a bitfield from the shadow, no bus access.
+ *
+ * @param reg The register address holding the least significant byte of the mask.
+ * @param mask The field mask as defined in this header.
+ * @return The unshifted field value.
+ **/
+uint32_t es9033_field_get(uint8_t reg, uint32_t mask);
+
+/**
+ * @brief Write all dirty registers to the DAC, grouping them into as few
+ * auto-increment burst transactions as possible.
+ *
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @return 0 on success, -1 on failure.
+ **/
+int es9033_flush(i2c_master_t *i2c_ctx);
@@ -0,0 +1,93 @@
+/**
+ * @file udsp_card_audio.h
+ * @brief Double-buffered multi-line I2S/TDM output engine for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * An audio thread on tile 1 owns the I2S ports and clock block and plays whole
+ * blocks of frames. A DSP thread fills the other block of a ping-pong pair in
+ * place and hands it over by advancing a counter, so no samples are copied or
+ * passed over channels. If no block is ready at a block boundary the engine
+ * plays silence and counts an underrun.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "udsp_card_board.h"
+
+/** @defgroup Audio_Engine_Defines Audio Engine Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_AUDIO_BLOCK_FRAMES
+#define UDSP_CARD_AUDIO_BLOCK_FRAMES 32 // Frames per block, the latency is one to two blocks
+#endif
+
+#ifndef UDSP_CARD_AUDIO_MAX_SLOTS
+#define UDSP_CARD_AUDIO_MAX_SLOTS 8 // Largest number of TDM slots per data line
+#endif
+
+#define UDSP_CARD_AUDIO_MAX_CHANS (I2S_LINES * UDSP_CARD_AUDIO_MAX_SLOTS)
+/** @} */
+
+/**
+ * @brief Engine state. Blocks are interleaved, channel line * slots + slot of
+ * frame f is at block[f * chans + line * slots + slot].
+ */
+typedef struct
+{
+    int32_t blocks[2][UDSP_CARD_AUDIO_BLOCK_FRAMES * UDSP_CARD_AUDIO_MAX_CHANS];
+    uint32_t filled;     // Blocks released by the DSP thread
+    uint32_t played;     // Blocks played by the audio thread
+    uint32_t underruns;  // Block periods played as silence, written by the audio thread
+    unsigned lines;      // Data lines driven, D0 upwards
+    unsigned slots;      // Slots per line, 2 is I2S, more is TDM
+    unsigned chans;      // Channels per frame, lines * slots
+    unsigned bclk_div;   // Clock block divider, BCLK = MCLK / (2 * bclk_div), 0 for MCLK
+    int running;         // Cleared by udsp_card_audio_stop()
+} udsp_card_audio_t;
+
+/**
+ * @brief Initialize the engine. Does not touch any hardware.
+ *
+ * @param audio Pointer to the engine state.
+ * @param mclk_freq MCLK frequency at UDSP_CARD_PORT_MCLK in Hz.
+ * @param fs Sample rate in Hz.
+ * @param lines Number of data lines, 1 to I2S_LINES.
+ * @param slots Slots per line, 2 for I2S or up to UDSP_CARD_AUDIO_MAX_SLOTS for TDM.
+ * @return 0 on success, -1 if the configuration is invalid or BCLK cannot be divided from MCLK.
+ */
+int udsp_card_audio_init(udsp_card_audio_t *audio, unsigned mclk_freq, unsigned fs, unsigned lines, unsigned slots);
+
+/**
+ * @brief Get the next block to fill without blocking.
+ *
+ * @param audio Pointer to the engine state.
+ * @return The block to write UDSP_CARD_AUDIO_BLOCK_FRAMES frames of chans samples
+ * into, or NULL if both blocks are in flight.
+ */
+int32_t *udsp_card_audio_acquire(udsp_card_audio_t *audio);
+
+/**
+ * @brief Hand the block returned by udsp_card_audio_acquire() to the audio thread.
+ *
+ * @param audio Pointer to the engine state.
+ */
+void udsp_card_audio_release(udsp_card_audio_t *audio);
+
+/**
+ * @brief Audio thread. Starts the I2S ports and plays blocks until
+ * udsp_card_audio_stop() is called. Must run on tile 1.
+ *
+ * @param audio Pointer to the engine state.
+ */
+void udsp_card_audio_task(udsp_card_audio_t *audio);
+
+/**
+ * @brief Stop the audio thread at the end of the current block.
+ *
+ * @param audio Pointer to the engine state.
+ */
+void udsp_card_audio_stop(udsp_card_audio_t *audio);
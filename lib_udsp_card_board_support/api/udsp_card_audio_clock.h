@@ -0,0 +1,77 @@
+/**
+ * @file udsp_card_audio_clock.h
+ * @brief Audio clock time base on tile 0, counting MCLK periods with the MCLK count port.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * UDSP_CARD_PORT_MCLK_COUNT is clocked by the MCLK at UDSP_CARD_PORT_MCLK_IN_USB,
+ * so its 16 bit port counter advances once per MCLK period. Each reader extends
+ * the counter to 64 bits with the reference time between its reads. This
+ * resolves any number of wraps as long as reads are less than
+ * UDSP_CARD_AUDIO_CLOCK_MAX_GAP_S apart. Times in MCLK periods convert to audio
+ * frames by dividing by MCLK / fs, and do not drift against the audio stream.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @defgroup Audio_Clock_Defines Audio Clock Configuration
+ *  @{
+ */
+#define UDSP_CARD_AUDIO_CLOCK_MAX_GAP_S 1 // Longest time between reads for an MCLK up to 600ppm off nominal
+/** @} */
+
+/**
+ * @brief Audio clock reader. Each thread uses its own reader.
+ */
+typedef struct
+{
+    unsigned mclk_freq; // Nominal MCLK frequency in Hz
+    unsigned fs;        // Sample rate in Hz
+    uint64_t mclk;      // MCLK periods counted at ref_time
+    uint32_t ref_time;  // Reference time of the last read
+    uint16_t count;     // Port counter at the last read
+    int valid;          // Set after the first read
+} udsp_card_audio_clock_t;
+
+/**
+ * @brief Start the MCLK count port if it is not running yet and initialize a
+ * reader. Must run on tile 0.
+ *
+ * @param clk Pointer to the reader.
+ * @param mclk_freq Nominal MCLK frequency in Hz.
+ * @param fs Sample rate in Hz.
+ */
+void udsp_card_audio_clock_init(udsp_card_audio_clock_t *clk, unsigned mclk_freq, unsigned fs);
+
+/**
+ * @brief Read the MCLK periods counted since the first read.
+ *
+ * @param clk Pointer to the reader.
+ * @return MCLK periods at clk->ref_time.
+ */
+uint64_t udsp_card_audio_clock_read(udsp_card_audio_clock_t *clk);
+
+/**
+ * @brief Convert an earlier reference time to MCLK periods, e.g. the time of an
+ * interrupt edge. Reads the clock first.
+ *
+ * @param clk Pointer to the reader.
+ * @param ref_time Reference time, at most UDSP_CARD_AUDIO_CLOCK_MAX_GAP_S in the past.
+ * @return MCLK periods at ref_time.
+ */
+uint64_t udsp_card_audio_clock_at(udsp_card_audio_clock_t *clk, uint32_t ref_time);
+
+/**
+ * @brief Convert MCLK periods to audio frames.
+ *
+ * @param clk Pointer to the reader.
+ * @param mclk MCLK periods.
+ * @return Audio frames.
+ */
+static inline uint64_t udsp_card_audio_clock_frames(const udsp_card_audio_clock_t *clk, uint64_t mclk)
+{
+    return mclk / (clk->mclk_freq / clk->fs);
+}
@@ -8,6 +8,10 @@
 
 #pragma once
 
+#ifndef __XC__
+#include "i2c.h"
+#endif
+
 /** @defgroup GPIO_Resources GPIO Port Resources
  *  @brief GPIO input and output ports.
  *  @{
@@ -22,6 +26,12 @@
  */
 #define UDSP_CARD_PORT_SYS_SCL XS1_PORT_1N
 #define UDSP_CARD_PORT_SYS_SDA XS1_PORT_1O
+
+#ifndef UDSP_CARD_I2C_KBPS
+#define UDSP_CARD_I2C_KBPS 400 // Preferred system I2C bus speed: 100, 400 or 1000 kbps
+#endif
+
+#define UDSP_CARD_I2C_SPEEDS 3 // Supported bus speeds, 100, 400 and 1000 kbps
 /** @} */
 
 /** @defgroup SPI_Resources SPI Port Resources
@@ -35,6 +45,24 @@
 #define UDSP_CARD_PORT_SPI_IRQ XS1_PORT_4F
 /** @} */
 
+/** @defgroup SQI_Resources QSPI Flash Port Resources
+ *  @brief Boot flash interface ports on tile 0.
+ *  @{
+ */
+#define UDSP_CARD_PORT_SQI_CS XS1_PORT_1B
+#define UDSP_CARD_PORT_SQI_SCLK XS1_PORT_1C
+#define UDSP_CARD_PORT_SQI_SIO XS1_PORT_4B
+/** @} */
+
+/** @defgroup SD_Resources SD Card Port Resources
+ *  @brief SD card interface ports on tile 0.
+ *  @{
+ */
+#define UDSP_CARD_PORT_SD_CMD XS1_PORT_1A
+#define UDSP_CARD_PORT_SD_CLK XS1_PORT_1D
+#define UDSP_CARD_PORT_SD_SIO XS1_PORT_4D
+/** @} */
+
 /** @defgroup I2S_Resources I2S Port and Clock Resources
  *  @brief I2S audio interface and clock blocks.
  *  @{
@@ -90,6 +118,8 @@
  *  @{
  */
 #define MASTER_CLOCK_FREQUENCY 49152000
+#define UDSP_CARD_MCLK_FREQUENCY_44K1 45158400 // MCLK for the 44.1kHz family after a runtime rate change
+#define UDSP_CARD_MCLK_FREQUENCY_48K 49152000  // MCLK for the 48kHz family after a runtime rate change
 #define AUDIO_CLOCK_FREQUENCY 192000
 #define PDM_CLOCK_FREQUENCY 3072000
 #define PDM_MICS_PORT 8
@@ -99,9 +129,44 @@
 #define I2S_DATA_BITS 32
 /** @} */
 
+/** @defgroup DAC_Power_States DAC Power States
+ *  @brief Power states of the DAC for udsp_card_dac_power().
+ *  @{
+ */
+#define UDSP_CARD_DAC_ON 0      // Analog section powered
+#define UDSP_CARD_DAC_SUSPEND 1 // Analog section powered down, registers kept
+#define UDSP_CARD_DAC_OFF 2     // DAC enable line low, registers lost
+/** @} */
+
+/**
+ * @brief System I2C bus statistics for one bus speed.
+ */
+typedef struct
+{
+    unsigned kbps;         // Bus speed
+    unsigned transactions; // DAC transactions at this speed
+    unsigned errors;       // Failed DAC transactions and handshakes at this speed
+    unsigned retries;      // DAC writes repeated at this speed
+    unsigned fallbacks;    // Times the bus fell back from this speed to a lower one
+} udsp_card_i2c_speed_stats_t;
+
+/**
+ * @brief DAC power statistics.
+ */
+typedef struct
+{
+    unsigned suspends;      // Transitions out of UDSP_CARD_DAC_ON
+    unsigned resumes;       // Transitions back to UDSP_CARD_DAC_ON
+    unsigned resume_us;     // Latency of the last resume, from the call until the DAC ramps up
+    unsigned resume_max_us; // Longest resume latency
+} udsp_card_dac_power_stats_t;
+
 /**
  * @brief Initialize devices on the uDSP-Card. Sets up the system clock,
  * initializes I2C communication, enables/configures the DAC (ES9033) and turns on LED0.
+ * Independent steps run in parallel on UDSP_CARD_INIT_THREADS threads of tile 0,
+ * see udsp_card_init.h. The I2C bus starts at UDSP_CARD_I2C_KBPS and falls back to
+ * a lower speed while the DAC does not answer.
  *
  * @return 0 on success, non-zero on failure.
  */
@@ -111,3 +176,102 @@ int udsp_card_devices_init();
  * @brief Configure the system PLL with a fixed master clock frequency.
  */
 void udsp_card_pll_init();
+
+#ifndef __XC__
+/**
+ * @brief Get the system I2C bus context initialized by udsp_card_devices_init().
+ *
+ * @return Pointer to the I2C context.
+ */
+i2c_master_t *udsp_card_i2c_ctx();
+#endif
+
+/**
+ * @brief Change the system I2C bus speed and verify it with the DAC handshake
+ * (es9033_handshake()). If the handshake fails, the bus falls back to the next
+ * lower speed until it passes. Needs a powered and clocked DAC. Must run on the
+ * thread owning the system I2C bus.
+ *
+ * @param kbps 100, 400 or 1000.
+ * @return 0 if the bus works at kbps or a lower speed, non-zero otherwise. The
+ * speed is left unchanged if the DAC is suspended or off.
+ */
+int udsp_card_i2c_set_speed(unsigned kbps);
+
+/**
+ * @brief Get the current system I2C bus speed.
+ *
+ * @return The bus speed in kbps.
+ */
+unsigned udsp_card_i2c_get_speed();
+
+/**
+ * @brief Check the bus after a failed DAC transaction and fall back to a lower
+ * speed if the handshake fails at the current one. Called by udsp_card_ctrl_task()
+ * after a command that failed on the bus, not after a rejected argument.
+ *
+ * @return 0 if the bus works, non-zero otherwise.
+ */
+int udsp_card_i2c_recover();
+
+/**
+ * @brief Get the system I2C bus statistics per bus speed, slowest first.
+ *
+ * @param stats Array of UDSP_CARD_I2C_SPEEDS entries to store the statistics.
+ */
+void udsp_card_i2c_speed_stats_get(udsp_card_i2c_speed_stats_t stats[UDSP_CARD_I2C_SPEEDS]);
+
+/**
+ * @brief Switch the audio sample rate at runtime without re-initializing the DAC.
+ * Supports the 44.1kHz and 48kHz families up to 768kHz. The DAC is soft muted
+ * while the application PLL is retuned (only on a family change) and the DAC
+ * clocks are reprogrammed and resynced.
+ *
+ * @param fs The new sample rate in Hz.
+ * @return 0 on success, non-zero on failure. Fails without touching the clock if
+ * fs is not supported or the DAC is not UDSP_CARD_DAC_ON.
+ */
+int udsp_card_set_sample_rate(unsigned fs);
+
+/**
+ * @brief Get the current audio sample rate.
+ *
+ * @return The sample rate in Hz.
+ */
+unsigned udsp_card_get_sample_rate();
+
+/**
+ * @brief Set GPIO output pins, e.g. UDSP_CARD_GPIO_OUT_LED_1. Pins outside
+ * mask keep their state. Must run on tile 0, safe to call from several threads.
+ *
+ * @param mask The output pins to change.
+ * @param value The new pin values.
+ */
+void udsp_card_gpio_set(unsigned mask, unsigned value);
+
+/**
+ * @brief Change the DAC power state. Suspending ramps the output down and powers
+ * the analog section down. UDSP_CARD_DAC_OFF also drops the DAC enable line.
+ * Resuming restores only the state the suspend changed or the power cycle
+ * lost, and records its latency. Going from UDSP_CARD_DAC_OFF to
+ * UDSP_CARD_DAC_SUSPEND is not supported. Must run on the thread owning the
+ * system I2C bus, e.g. through UDSP_CARD_CMD_POWER.
+ *
+ * @param state UDSP_CARD_DAC_ON, UDSP_CARD_DAC_SUSPEND or UDSP_CARD_DAC_OFF.
+ * @return 0 on success, non-zero on failure.
+ */
+int udsp_card_dac_power(unsigned state);
+
+/**
+ * @brief Get the current DAC power state.
+ *
+ * @return UDSP_CARD_DAC_ON, UDSP_CARD_DAC_SUSPEND or UDSP_CARD_DAC_OFF.
+ */
+unsigned udsp_card_dac_power_get();
+
+/**
+ * @brief Get the DAC power statistics.
+ *
+ * @param stats Pointer to store the statistics.
+ */
+void udsp_card_dac_power_stats_get(udsp_card_dac_power_stats_t *stats);
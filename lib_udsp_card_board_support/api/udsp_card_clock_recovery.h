@@ -0,0 +1,108 @@
+/**
+ * @file udsp_card_clock_recovery.h
+ * @brief Adaptive clock recovery, disciplines the MCLK to an external reference with lib_sw_pll.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The thread that sees the reference calls udsp_card_clock_recovery_update() on
+ * every reference event, e.g. each USB SOF or every frame of an I2S input. Each
+ * call samples the MCLK count port through an audio clock reader
+ * (udsp_card_audio_clock.h) and feeds both timestamps to the lib_sw_pll lookup
+ * table controller. Every UDSP_CARD_CLOCK_RECOVERY_LOOP_COUNT events the
+ * controller trims the application PLL fractional divider, so the MCLK follows
+ * the reference instead of drifting against it.
+ *
+ * The lookup table and the application PLL register values are generated for
+ * the nominal MCLK with the lib_sw_pll Python tools and passed in by the
+ * application. While recovery runs, the MCLK must not be changed with
+ * udsp_card_set_sample_rate().
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sw_pll.h"
+#include "udsp_card_audio_clock.h"
+
+/** @defgroup Clock_Recovery_Defines Clock Recovery Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_CLOCK_RECOVERY_LOOP_COUNT
+#define UDSP_CARD_CLOCK_RECOVERY_LOOP_COUNT 8 // Reference events per control step
+#endif
+
+#ifndef UDSP_CARD_CLOCK_RECOVERY_KP
+#define UDSP_CARD_CLOCK_RECOVERY_KP SW_PLL_15Q16(0.0) // Proportional gain of the controller
+#endif
+
+#ifndef UDSP_CARD_CLOCK_RECOVERY_KI
+#define UDSP_CARD_CLOCK_RECOVERY_KI SW_PLL_15Q16(1.0) // Integral gain of the controller
+#endif
+
+#ifndef UDSP_CARD_CLOCK_RECOVERY_KII
+#define UDSP_CARD_CLOCK_RECOVERY_KII SW_PLL_15Q16(0.0) // Double integral gain of the controller
+#endif
+/** @} */
+
+/**
+ * @brief Application PLL lookup table generated by the lib_sw_pll tools.
+ */
+typedef struct
+{
+    const int16_t *table;  // Fractional divider values, ascending frequency
+    size_t entries;        // Number of table entries
+    uint32_t ctl_reg;      // Application PLL control register value
+    uint32_t div_reg;      // Application PLL output divider register value
+    unsigned nominal;      // Table index of the nominal MCLK
+    unsigned ppm_range;    // Pull range of the table in ppm
+} udsp_card_clock_recovery_lut_t;
+
+/**
+ * @brief Clock recovery state and statistics.
+ */
+typedef struct
+{
+    sw_pll_lut_state_t pll;          // lib_sw_pll controller
+    udsp_card_audio_clock_t clock;   // MCLK count reader of the reference thread
+    unsigned ratio;                  // Nominal MCLK periods per reference event
+    uint64_t last_mclk;              // MCLK periods at the previous event
+    uint64_t window_mclk;            // MCLK periods at the start of the window
+    unsigned window_events;          // Events in the current window
+    uint32_t period_min;             // Shortest event period in the window, MCLK periods
+    uint32_t period_max;             // Longest event period in the window, MCLK periods
+    sw_pll_lock_status_t lock;       // Lock status of the last control step
+    int32_t error_ppb;               // MCLK frequency error against the reference over the last window
+    uint32_t jitter;                 // Peak to peak event period jitter over the last window, MCLK periods
+    uint32_t jitter_max;             // Largest jitter of any window while locked, MCLK periods
+    uint32_t updates;                // Reference events
+    uint32_t steps;                  // Control steps
+    uint32_t locked_steps;           // Control steps that ended locked
+    uint32_t unlocks;                // Transitions from locked to unlocked
+} udsp_card_clock_recovery_t;
+
+/**
+ * @brief Take over the application PLL and start at the nominal MCLK. Must run
+ * on tile 0, on the thread that calls udsp_card_clock_recovery_update().
+ *
+ * @param cr Pointer to the clock recovery state.
+ * @param lut Lookup table generated for mclk_freq, must outlive cr.
+ * @param mclk_freq Nominal MCLK frequency in Hz, e.g. MASTER_CLOCK_FREQUENCY.
+ * @param ref_freq Reference event rate in Hz, e.g. 1000 for full speed or 8000 for high speed USB SOF.
+ * @param fs Sample rate in Hz.
+ * @return 0 on success, -1 if ref_freq does not divide mclk_freq.
+ */
+int udsp_card_clock_recovery_init(udsp_card_clock_recovery_t *cr, const udsp_card_clock_recovery_lut_t *lut,
+                                  unsigned mclk_freq, unsigned ref_freq, unsigned fs);
+
+/**
+ * @brief Report a reference event. Call it right at the event, e.g. in the SOF
+ * handler, since the MCLK count is sampled on entry.
+ *
+ * @param cr Pointer to the clock recovery state.
+ * @param ref_pt Reference timestamp that advances by one per event, e.g. the SOF count.
+ * @return Lock status of the last control step.
+ */
+sw_pll_lock_status_t udsp_card_clock_recovery_update(udsp_card_clock_recovery_t *cr, uint16_t ref_pt);
@@ -0,0 +1,149 @@
+/**
+ * @file udsp_card_ctrl.h
+ * @brief Asynchronous board control service for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * A control thread on tile 0 owns the system I2C bus and the GPIO output port
+ * and drains lock-free single-producer/single-consumer command queues. Real-time
+ * threads post commands in constant time and never touch the bus.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "es9033.h"
+
+/** @defgroup Ctrl_Defines Control Service Configuration
+ *  @brief GPIO1 of the DAC is the MCLK input, so there is no interrupt line and
+ *  the monitor polls the latched interrupt sources. This board therefore cannot
+ *  detect clock faults within a millisecond without spending bus time on polls.
+ *  Each poll is one 0xE5-0xE8 burst read of 66 bit times: 165us at 400kbps, 66us
+ *  at 1000kbps. The default period of 1000us detects a fault within about 1.1ms,
+ *  the period plus one pass of the control loop, and occupies 16.5% of the bus at
+ *  400kbps (6.6% at 1000kbps). A period of 500us gets below 1ms at 33% of the bus
+ *  at 400kbps. Polls wait for pending volume bursts, and the latched sources keep
+ *  events between two polls.
+ *  @{
+ */
+#ifndef UDSP_CARD_CTRL_QUEUE_DEPTH
+#define UDSP_CARD_CTRL_QUEUE_DEPTH 16 // Commands per queue, must be a power of two
+#endif
+
+#ifndef UDSP_CARD_CTRL_IDLE_US
+#define UDSP_CARD_CTRL_IDLE_US 100 // Sleep of the control thread when all queues are empty
+#endif
+
+#ifndef UDSP_CARD_CTRL_MONITOR_POLL_US
+#define UDSP_CARD_CTRL_MONITOR_POLL_US 1000 // DAC status poll period, fault detection takes up to this plus one loop pass
+#endif
+/** @} */
+
+/**
+ * @brief Control commands.
+ */
+typedef enum
+{
+    UDSP_CARD_CMD_VOLUME = 0, // arg0: ES9033 channel mask, arg1: volume in 0.1dB (int32_t, <= 0)
+    UDSP_CARD_CMD_MUTE = 1,   // arg0: ES9033 channel mask, arg1: 1 mute, 0 unmute
+    UDSP_CARD_CMD_FILTER = 2, // arg1: ES9033_BIT_FILTER_SHAPE_x
+    UDSP_CARD_CMD_RATE = 3,   // arg1: sample rate in Hz
+    UDSP_CARD_CMD_GPIO = 4,   // arg0: GPIO output mask, arg1: GPIO output value
+    UDSP_CARD_CMD_POWER = 5,  // arg1: UDSP_CARD_DAC_ON, UDSP_CARD_DAC_SUSPEND or UDSP_CARD_DAC_OFF
+} udsp_card_cmd_id_t;
+
+/**
+ * @brief A queued control command.
+ */
+typedef struct
+{
+    uint32_t id;   // udsp_card_cmd_id_t
+    uint32_t arg0; // Command specific argument
+    uint32_t arg1; // Command specific argument
+} udsp_card_cmd_t;
+
+/**
+ * @brief Single-producer/single-consumer command queue. Use one queue per
+ * posting thread. Sequence numbers count commands posted to this queue.
+ */
+typedef struct
+{
+    udsp_card_cmd_t cmds[UDSP_CARD_CTRL_QUEUE_DEPTH];
+    uint32_t head;      // Commands posted, written by the producer
+    uint32_t tail;      // Commands taken, written by the control thread
+    uint32_t completed; // Commands completed, written by the control thread
+    uint32_t errors;    // Commands failed, written by the control thread
+} udsp_card_ctrl_t;
+
+/**
+ * @brief Initialize an empty command queue.
+ *
+ * @param ctrl Pointer to the queue.
+ */
+void udsp_card_ctrl_init(udsp_card_ctrl_t *ctrl);
+
+/**
+ * @brief Post a command without blocking. Constant time, no bus access.
+ *
+ * @param ctrl Pointer to the queue.
+ * @param id The command.
+ * @param arg0 Command specific argument.
+ * @param arg1 Command specific argument.
+ * @param seq Pointer to store the sequence number of the command, may be NULL.
+ * @return 0 on success, -1 if the queue is full.
+ */
+int udsp_card_ctrl_post(udsp_card_ctrl_t *ctrl, udsp_card_cmd_id_t id, uint32_t arg0, uint32_t arg1, uint32_t *seq);
+
+/**
+ * @brief Check whether a posted command has completed.
+ *
+ * @param ctrl Pointer to the queue.
+ * @param seq The sequence number returned by udsp_card_ctrl_post().
+ * @return 1 if completed, 0 otherwise.
+ */
+int udsp_card_ctrl_done(udsp_card_ctrl_t *ctrl, uint32_t seq);
+
+/**
+ * @brief Set the DAC volume without using a queue slot. Constant time,
+ * callable from any tile 0 thread. Bursts of updates are coalesced and the
+ * latest value is written at most once per ES9033_VOLUME_SLOT_US.
+ *
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param db10 Volume in 0.1dB, 0 to ES9033_VOLUME_MIN_DB10.
+ */
+void udsp_card_ctrl_volume(uint8_t ch_mask, int db10);
+
+/**
+ * @brief Soft mute or unmute the DAC without using a queue slot, coalesced
+ * like udsp_card_ctrl_volume().
+ *
+ * @param ch_mask Channels to set, ES9033_CH1 and/or ES9033_CH2.
+ * @param mute 1 to mute, 0 to unmute.
+ */
+void udsp_card_ctrl_mute(uint8_t ch_mask, int mute);
+
+/**
+ * @brief Enable DAC fault and status monitoring on the control thread.
+ * Must be called before udsp_card_ctrl_task(). The callback runs on the
+ * control thread. The monitor is serviced on each pass of the control loop
+ * and reads the DAC every UDSP_CARD_CTRL_MONITOR_POLL_US, after any pending
+ * volume or mute burst. The board has no interrupt line, so detection is
+ * bounded by the poll period, not event driven. Even with an interrupt line,
+ * es9033_monitor_service() samples it with port_peek() from this loop rather
+ * than waiting on a pin change event.
+ *
+ * @param cb Event callback, see es9033_monitor_service().
+ */
+void udsp_card_ctrl_monitor(es9033_event_cb_t cb);
+
+/**
+ * @brief Control thread. Executes commands from all queues in order of
+ * posting per queue. Requires udsp_card_devices_init() to have completed on
+ * tile 0. Never returns.
+ *
+ * @param ctrl Array of queues to serve.
+ * @param num_queues Number of queues.
+ */
+void udsp_card_ctrl_task(udsp_card_ctrl_t *ctrl[], unsigned num_queues);
@@ -0,0 +1,187 @@
+/**
+ * @file udsp_card_extmem.h
+ * @brief Arena and pool allocation over the uDSP-Card LPDDR, with SRAM staged streams.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The 1Gbit LPDDR declared in udsp-card.xn is memory mapped on both tiles. Large
+ * buffers such as delay lines, reverb tails and capture history are carved from
+ * it by a bump arena that never frees, so it cannot fragment. Fixed-size block
+ * pools on top of the arena recycle equal buffers. Sequential access goes through
+ * streams that move data between LPDDR and a small tile SRAM stage in bursts, so
+ * DSP loops only touch SRAM.
+ *
+ * Allocators and streams are not thread safe, each must have a single owner.
+ * The window is mapped on both tiles, so each tile must carve its arenas from
+ * its own region. UDSP_CARD_EXTMEM_TILE_BASE() and UDSP_CARD_EXTMEM_TILE_SIZE()
+ * give the default split; two arenas over overlapping regions corrupt each other.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @defgroup Extmem_Defines External Memory Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_EXTMEM_BASE
+#define UDSP_CARD_EXTMEM_BASE 0x10000000 // Start of the LPDDR window. Move up if .ExtMem sections are linked
+#endif
+
+#ifndef UDSP_CARD_EXTMEM_SIZE
+#define UDSP_CARD_EXTMEM_SIZE (1024 / 8 * 1024 * 1024) // Bytes of LPDDR, Extmem sizeMbit="1024"
+#endif
+
+#ifndef UDSP_CARD_EXTMEM_TILE0_SIZE
+#define UDSP_CARD_EXTMEM_TILE0_SIZE (UDSP_CARD_EXTMEM_SIZE / 2) // Bytes of the window owned by tile 0, tile 1 owns the rest
+#endif
+
+#define UDSP_CARD_EXTMEM_ALIGN 32 // Alignment of every allocation, one LPDDR burst
+
+#define UDSP_CARD_EXTMEM_TILE_BASE(tile) \
+    ((void *)(UDSP_CARD_EXTMEM_BASE + ((tile) ? UDSP_CARD_EXTMEM_TILE0_SIZE : 0))) // Start of the region of a tile
+#define UDSP_CARD_EXTMEM_TILE_SIZE(tile) \
+    ((tile) ? UDSP_CARD_EXTMEM_SIZE - UDSP_CARD_EXTMEM_TILE0_SIZE : UDSP_CARD_EXTMEM_TILE0_SIZE) // Bytes in the region of a tile
+
+#ifndef UDSP_CARD_EXTMEM_STAGE_BYTES
+#define UDSP_CARD_EXTMEM_STAGE_BYTES 512 // SRAM stage per stream, multiple of UDSP_CARD_EXTMEM_ALIGN
+#endif
+
+#ifndef UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS
+#define UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS 256 // Blocks per pool, multiple of 32
+#endif
+/** @} */
+
+/**
+ * @brief Bump arena over a region of external memory.
+ */
+typedef struct
+{
+    uint8_t *base; // Start of the region
+    size_t size;   // Bytes in the region
+    size_t used;   // Bytes allocated, including alignment padding
+} udsp_card_extmem_arena_t;
+
+/**
+ * @brief Pool of equal blocks. The free map is kept in SRAM.
+ */
+typedef struct
+{
+    uint8_t *blocks;                                       // First block, in external memory
+    size_t block_size;                                     // Bytes per block, rounded up to UDSP_CARD_EXTMEM_ALIGN
+    unsigned count;                                        // Number of blocks
+    unsigned available;                                    // Number of free blocks
+    uint32_t free_map[UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS / 32]; // Bit set for every free block
+} udsp_card_extmem_pool_t;
+
+/**
+ * @brief Sequential circular access to an external buffer through an SRAM stage.
+ * A stream either reads or writes.
+ */
+typedef struct
+{
+    uint8_t stage[UDSP_CARD_EXTMEM_STAGE_BYTES] __attribute__((aligned(8)));
+    uint8_t *ext;    // External buffer
+    size_t len;      // Bytes in the external buffer
+    size_t pos;      // External offset of stage[0]
+    unsigned fill;   // Valid bytes in the stage when reading, pending bytes when writing
+    unsigned offset; // Next byte in the stage when reading
+    unsigned bursts; // Bursts moved between SRAM and external memory
+} udsp_card_extmem_stream_t;
+
+/**
+ * @brief Initialize an arena over a region of external memory. The caller owns
+ * the region: it must lie within the region of the calling tile and must not
+ * overlap any other arena.
+ *
+ * @param arena Pointer to the arena.
+ * @param base Start of the region, e.g. UDSP_CARD_EXTMEM_TILE_BASE(1).
+ * @param size Bytes in the region, e.g. UDSP_CARD_EXTMEM_TILE_SIZE(1).
+ * @return 0 on success, -1 if the region is empty. The arena is then empty as well.
+ */
+int udsp_card_extmem_arena_init(udsp_card_extmem_arena_t *arena, void *base, size_t size);
+
+/**
+ * @brief Allocate from an arena. Memory is only returned by udsp_card_extmem_arena_reset().
+ *
+ * @param arena Pointer to the arena.
+ * @param size Bytes to allocate.
+ * @return Pointer aligned to UDSP_CARD_EXTMEM_ALIGN, or NULL if the arena is exhausted.
+ */
+void *udsp_card_extmem_alloc(udsp_card_extmem_arena_t *arena, size_t size);
+
+/**
+ * @brief Return all allocations of an arena at once.
+ *
+ * @param arena Pointer to the arena.
+ */
+void udsp_card_extmem_arena_reset(udsp_card_extmem_arena_t *arena);
+
+/**
+ * @brief Carve a pool of equal blocks from an arena.
+ *
+ * @param pool Pointer to the pool.
+ * @param arena Arena to allocate the blocks from.
+ * @param block_size Bytes per block.
+ * @param count Number of blocks, 1 to UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS.
+ * @return 0 on success, -1 if count is out of range or the arena is exhausted.
+ */
+int udsp_card_extmem_pool_init(udsp_card_extmem_pool_t *pool, udsp_card_extmem_arena_t *arena, size_t block_size,
+                               unsigned count);
+
+/**
+ * @brief Take a block from a pool in bounded time.
+ *
+ * @param pool Pointer to the pool.
+ * @return Pointer to the block, or NULL if all blocks are in use.
+ */
+void *udsp_card_extmem_pool_get(udsp_card_extmem_pool_t *pool);
+
+/**
+ * @brief Return a block to its pool.
+ *
+ * @param pool Pointer to the pool.
+ * @param block Block returned by udsp_card_extmem_pool_get().
+ * @return 0 on success, -1 if block does not belong to the pool or is already free.
+ */
+int udsp_card_extmem_pool_put(udsp_card_extmem_pool_t *pool, void *block);
+
+/**
+ * @brief Open a stream on an external buffer.
+ *
+ * @param stream Pointer to the stream.
+ * @param ext External buffer, e.g. from udsp_card_extmem_alloc().
+ * @param len Bytes in the buffer, multiple of UDSP_CARD_EXTMEM_STAGE_BYTES.
+ * @param pos Start offset in the buffer, multiple of UDSP_CARD_EXTMEM_STAGE_BYTES.
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int udsp_card_extmem_stream_init(udsp_card_extmem_stream_t *stream, void *ext, size_t len, size_t pos);
+
+/**
+ * @brief Read from a stream, wrapping at the end of the buffer. The stage is
+ * refilled in UDSP_CARD_EXTMEM_STAGE_BYTES bursts.
+ *
+ * @param stream Pointer to the stream.
+ * @param dst Destination in SRAM.
+ * @param n Bytes to read.
+ */
+void udsp_card_extmem_read(udsp_card_extmem_stream_t *stream, void *dst, size_t n);
+
+/**
+ * @brief Write to a stream, wrapping at the end of the buffer. The stage is
+ * written back in UDSP_CARD_EXTMEM_STAGE_BYTES bursts.
+ *
+ * @param stream Pointer to the stream.
+ * @param src Source in SRAM.
+ * @param n Bytes to write.
+ */
+void udsp_card_extmem_write(udsp_card_extmem_stream_t *stream, const void *src, size_t n);
+
+/**
+ * @brief Write pending bytes of a write stream to external memory.
+ *
+ * @param stream Pointer to the stream.
+ */
+void udsp_card_extmem_flush(udsp_card_extmem_stream_t *stream);
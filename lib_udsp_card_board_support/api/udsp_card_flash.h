@@ -0,0 +1,138 @@
+/**
+ * @file udsp_card_flash.h
+ * @brief Read-only data store in the QSPI boot flash, accessed in place through
+ * the software memory window.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The W25Q128JV holds the boot image followed by a data partition. The data
+ * partition is a store of filter coefficients, DAC init profiles and calibration
+ * records built on the host with tools/udsp_card_flash_pack.py and programmed with
+ * xflash --data. udsp_card_flash_swmem_task() maps the partition into the xcore.ai
+ * software memory window of tile 0, so records are used in place through plain
+ * pointers and are only fetched from flash when touched.
+ *
+ * Store layout, little endian, offsets from the start of the partition:
+ *  - udsp_card_flash_header_t
+ *  - count x udsp_card_flash_entry_t
+ *  - record payloads, each aligned to 4 bytes and zero padded
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "es9033.h"
+
+/** @defgroup Flash_Defines Flash Store Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_FLASH_DATA_OFFSET
+#define UDSP_CARD_FLASH_DATA_OFFSET 0x100000 // Flash offset of the data partition, xflash --boot-partition-size
+#endif
+
+#define UDSP_CARD_FLASH_WINDOW 0x40000000 // Software memory window on xcore.ai
+#define UDSP_CARD_FLASH_MAGIC 0x46534455  // "UDSF"
+#define UDSP_CARD_FLASH_FORMAT 2          // Store format understood by this library
+/** @} */
+
+/**
+ * @brief Record types.
+ */
+typedef enum
+{
+    UDSP_CARD_FLASH_COEFFS = 1,      // int32_t filter coefficients
+    UDSP_CARD_FLASH_DAC_PROFILE = 2, // es9033_profile_t
+    UDSP_CARD_FLASH_CALIBRATION = 3, // Application defined bytes
+} udsp_card_flash_type_t;
+
+/**
+ * @brief Store header at the start of the partition.
+ */
+typedef struct
+{
+    uint32_t magic;    // UDSP_CARD_FLASH_MAGIC
+    uint16_t format;   // UDSP_CARD_FLASH_FORMAT
+    uint16_t count;    // Number of directory entries
+    uint32_t size;     // Bytes in the store, including header and directory
+    uint32_t revision; // Content revision chosen when packing
+    uint32_t dir_crc;  // CRC-32 of the directory entries
+} udsp_card_flash_header_t;
+
+/**
+ * @brief Directory entry of one record.
+ */
+typedef struct
+{
+    uint16_t type;   // udsp_card_flash_type_t
+    uint16_t id;     // Record id, unique per type
+    uint32_t offset; // Offset of the payload from the start of the store
+    uint32_t length; // Bytes in the payload, without padding
+    uint32_t crc;    // CRC-32 of the payload including its padding
+} udsp_card_flash_entry_t;
+
+/**
+ * @brief Opened store. All pointers point into the mapped partition.
+ */
+typedef struct
+{
+    const uint8_t *base;
+    const udsp_card_flash_header_t *header;
+    const udsp_card_flash_entry_t *entries;
+} udsp_card_flash_t;
+
+/**
+ * @brief Serve software memory fills of the flash window from the data partition.
+ * Owns the PORT_SQI_* ports and never returns. Must run on tile 0 and be started
+ * before the window is accessed.
+ */
+void udsp_card_flash_swmem_task();
+
+/**
+ * @brief Open a store and check its header and directory. Payloads are not read.
+ *
+ * @param store Pointer to the store.
+ * @param base Start of the store, NULL for the flash window.
+ * @return 0 on success, -1 if there is no valid store of a supported format.
+ */
+int udsp_card_flash_open(udsp_card_flash_t *store, const void *base);
+
+/**
+ * @brief Find a record.
+ *
+ * @param store Pointer to an opened store.
+ * @param type Record type.
+ * @param id Record id.
+ * @param len Receives the payload length in bytes, may be NULL.
+ * @return Pointer to the payload, or NULL if there is no such record.
+ */
+const void *udsp_card_flash_find(const udsp_card_flash_t *store, udsp_card_flash_type_t type, unsigned id,
+                                 uint32_t *len);
+
+/**
+ * @brief Find a coefficient table.
+ *
+ * @param store Pointer to an opened store.
+ * @param id Record id.
+ * @param count Receives the number of coefficients.
+ * @return Pointer to the coefficients, or NULL if there is no such record.
+ */
+const int32_t *udsp_card_flash_coeffs(const udsp_card_flash_t *store, unsigned id, unsigned *count);
+
+/**
+ * @brief Find a DAC init profile, to be passed to es9033_init_profile().
+ *
+ * @param store Pointer to an opened store.
+ * @param id Record id.
+ * @return Pointer to the profile, or NULL if there is no such record or its size does not match.
+ */
+const es9033_profile_t *udsp_card_flash_dac_profile(const udsp_card_flash_t *store, unsigned id);
+
+/**
+ * @brief Check the CRC of every payload. Reads the whole store.
+ *
+ * @param store Pointer to an opened store.
+ * @return 0 if all payloads are intact, -1 otherwise.
+ */
+int udsp_card_flash_verify(const udsp_card_flash_t *store);
@@ -0,0 +1,104 @@
+/**
+ * @file udsp_card_gpio.h
+ * @brief Event-driven GPIO service for the uDSP-Card: debounced buttons, timestamped
+ * IMU interrupts and LED dimming.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * One thread on tile 0 waits on a pin change event of UDSP_CARD_PORT_GPIO_IN and
+ * a single hardware timer, it never polls. IMU interrupt edges are reported at
+ * once with the reference time of the event. Button changes restart a debounce
+ * timer and are reported once the pins have been stable for
+ * UDSP_CARD_GPIO_DEBOUNCE_US. LEDs with a brightness between off and full are
+ * dimmed with a timer driven PWM, at most three timer events per PWM period.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @defgroup GPIO_Service_Defines GPIO Service Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_GPIO_DEBOUNCE_US
+#define UDSP_CARD_GPIO_DEBOUNCE_US 20000 // Time the button pins must be stable
+#endif
+
+#ifndef UDSP_CARD_GPIO_PWM_HZ
+#define UDSP_CARD_GPIO_PWM_HZ 1000 // LED PWM frequency
+#endif
+
+#ifndef UDSP_CARD_GPIO_BUTTON_ACTIVE_LOW
+#define UDSP_CARD_GPIO_BUTTON_ACTIVE_LOW 1 // Buttons pull their pin low when pressed
+#endif
+
+#define UDSP_CARD_GPIO_LEDS 2             // UDSP_CARD_GPIO_OUT_LED_0 and UDSP_CARD_GPIO_OUT_LED_1
+#define UDSP_CARD_GPIO_BRIGHTNESS_MAX 255 // Full brightness, no PWM
+/** @} */
+
+/**
+ * @brief Button callback, runs on the GPIO thread.
+ *
+ * @param button UDSP_CARD_GPIO_IN_BUTTON_0 or UDSP_CARD_GPIO_IN_BUTTON_1.
+ * @param pressed 1 if pressed, 0 if released.
+ * @param time Reference time of the last edge before the pin settled.
+ */
+typedef void (*udsp_card_gpio_button_cb_t)(unsigned button, int pressed, uint32_t time);
+
+/**
+ * @brief IMU interrupt callback, runs on the GPIO thread.
+ *
+ * @param irq UDSP_CARD_GPIO_IN_IMU_IRQ_1 and/or UDSP_CARD_GPIO_IN_IMU_IRQ_2.
+ * @param time Reference time of the rising edge.
+ */
+typedef void (*udsp_card_gpio_irq_cb_t)(unsigned irq, uint32_t time);
+
+/**
+ * @brief GPIO service state.
+ */
+typedef struct
+{
+    udsp_card_gpio_button_cb_t button_cb;
+    udsp_card_gpio_irq_cb_t irq_cb;
+    uint8_t brightness[UDSP_CARD_GPIO_LEDS]; // Requested, written by any tile 0 thread
+    int running;                             // Cleared by udsp_card_gpio_stop()
+    uint32_t pins;                           // Last sampled input pins
+    uint32_t buttons;                        // Debounced button pins, set when pressed
+    uint32_t irq_count;                      // IMU interrupt edges reported
+    uint32_t press_count;                    // Button presses reported
+} udsp_card_gpio_t;
+
+/**
+ * @brief Initialize the service. Does not touch any hardware.
+ *
+ * @param gpio Pointer to the service state.
+ * @param button_cb Button callback, may be NULL.
+ * @param irq_cb IMU interrupt callback, may be NULL.
+ */
+void udsp_card_gpio_init(udsp_card_gpio_t *gpio, udsp_card_gpio_button_cb_t button_cb, udsp_card_gpio_irq_cb_t irq_cb);
+
+/**
+ * @brief Set the brightness of an LED. 0 and UDSP_CARD_GPIO_BRIGHTNESS_MAX switch
+ * it steadily, values between are dimmed by PWM. Takes effect at the next PWM period.
+ *
+ * @param gpio Pointer to the service state.
+ * @param led 0 for UDSP_CARD_GPIO_OUT_LED_0, 1 for UDSP_CARD_GPIO_OUT_LED_1.
+ * @param brightness 0 to UDSP_CARD_GPIO_BRIGHTNESS_MAX.
+ */
+void udsp_card_gpio_led(udsp_card_gpio_t *gpio, unsigned led, unsigned brightness);
+
+/**
+ * @brief GPIO thread. Requires udsp_card_devices_init() to have completed on
+ * tile 0. Runs until udsp_card_gpio_stop() is called.
+ *
+ * @param gpio Pointer to the service state.
+ */
+void udsp_card_gpio_task(udsp_card_gpio_t *gpio);
+
+/**
+ * @brief Stop the GPIO thread within one PWM period.
+ *
+ * @param gpio Pointer to the service state.
+ */
+void udsp_card_gpio_stop(udsp_card_gpio_t *gpio);
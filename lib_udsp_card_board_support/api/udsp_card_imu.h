@@ -0,0 +1,135 @@
+/**
+ * @file udsp_card_imu.h
+ * @brief Interrupt driven SPI IMU driver with FIFO burst reads and audio clock timestamps.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The IMU thread on tile 0 owns the SPI ports and sleeps until udsp_card_imu_irq()
+ * reports an interrupt edge, typically from the udsp_card_gpio.h IRQ callback. It
+ * then reads the FIFO count and all complete FIFO records in a single SPI burst
+ * and hands them to a callback, tagged with the audio clock time of the edge.
+ *
+ * The register defaults fit the TDK ICM-42688-P, where FIFO_COUNTH, FIFO_COUNTL and
+ * FIFO_DATA are consecutive and FIFO_DATA does not auto-increment. Other sensors
+ * with the same layout only need different defines.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <xcore/channel_streaming.h>
+
+#include "udsp_card_audio_clock.h"
+
+/** @defgroup IMU_Defines IMU Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_IMU_CS
+#define UDSP_CARD_IMU_CS (1 << 0) // Chip select pin of the IMU in UDSP_CARD_PORT_SPI_CS, active low
+#endif
+
+#ifndef UDSP_CARD_IMU_REG_FIFO_COUNT
+#define UDSP_CARD_IMU_REG_FIFO_COUNT 0x2E // FIFO byte count, big endian, followed by the FIFO data register
+#endif
+
+#ifndef UDSP_CARD_IMU_RECORD_BYTES
+#define UDSP_CARD_IMU_RECORD_BYTES 16 // Bytes per FIFO record, accel + gyro + temperature + timestamp
+#endif
+
+#ifndef UDSP_CARD_IMU_FIFO_BYTES
+#define UDSP_CARD_IMU_FIFO_BYTES 2048 // Largest burst, the sensor FIFO size
+#endif
+
+#define UDSP_CARD_IMU_SPI_READ 0x80           // Read flag in the register address byte
+#define UDSP_CARD_IMU_CLOCK_REFRESH_MS 500     // Audio clock read while no interrupts arrive
+/** @} */
+
+/**
+ * @brief FIFO records read for one interrupt.
+ */
+typedef struct
+{
+    const uint8_t *data; // records * UDSP_CARD_IMU_RECORD_BYTES bytes, valid during the callback
+    unsigned records;    // Number of records
+    uint32_t ref_time;   // Reference time of the interrupt edge
+    uint64_t mclk;       // Audio clock at the edge in MCLK periods
+    uint64_t frame;      // Audio clock at the edge in frames
+} udsp_card_imu_batch_t;
+
+/**
+ * @brief Batch callback, runs on the IMU thread.
+ */
+typedef void (*udsp_card_imu_cb_t)(const udsp_card_imu_batch_t *batch);
+
+/**
+ * @brief IMU driver state.
+ */
+typedef struct
+{
+    udsp_card_imu_cb_t cb;
+    streaming_channel_t irq;          // end_a written by udsp_card_imu_irq(), end_b read by the IMU thread
+    int pending;                      // Set while an interrupt is queued for the IMU thread
+    int running;                      // Cleared by udsp_card_imu_stop()
+    udsp_card_audio_clock_t clock;    // Audio clock reader of the IMU thread
+    uint32_t irqs;                    // Interrupts handled
+    uint32_t coalesced;               // Interrupts merged into a pending one
+    uint32_t records;                 // FIFO records read
+    uint32_t truncated;               // Bursts cut to UDSP_CARD_IMU_FIFO_BYTES
+    uint8_t fifo[UDSP_CARD_IMU_FIFO_BYTES] __attribute__((aligned(4)));
+} udsp_card_imu_t;
+
+/**
+ * @brief Initialize the driver, enable the SPI bus and take the SPI ports. Must
+ * run on the thread that later runs udsp_card_imu_task(), after
+ * udsp_card_devices_init() on tile 0. Configure the sensor with
+ * udsp_card_imu_write() before starting the task.
+ *
+ * @param imu Pointer to the driver state.
+ * @param cb Batch callback.
+ * @param mclk_freq Nominal MCLK frequency in Hz.
+ * @param fs Sample rate in Hz.
+ */
+void udsp_card_imu_init(udsp_card_imu_t *imu, udsp_card_imu_cb_t cb, unsigned mclk_freq, unsigned fs);
+
+/**
+ * @brief Write a sensor register.
+ *
+ * @param reg Register address.
+ * @param val Register value.
+ */
+void udsp_card_imu_write(uint8_t reg, uint8_t val);
+
+/**
+ * @brief Read consecutive sensor registers in one burst.
+ *
+ * @param reg First register address.
+ * @param buf Buffer for len bytes.
+ * @param len Number of registers.
+ */
+void udsp_card_imu_read(uint8_t reg, uint8_t *buf, unsigned len);
+
+/**
+ * @brief Report an interrupt edge. Constant time, callable from any tile 0 thread,
+ * e.g. a udsp_card_gpio_irq_cb_t. Edges arriving while one is pending are merged.
+ *
+ * @param imu Pointer to the driver state.
+ * @param ref_time Reference time of the edge.
+ */
+void udsp_card_imu_irq(udsp_card_imu_t *imu, uint32_t ref_time);
+
+/**
+ * @brief IMU thread. Reads the FIFO on every reported interrupt until
+ * udsp_card_imu_stop() is called.
+ *
+ * @param imu Pointer to the driver state.
+ */
+void udsp_card_imu_task(udsp_card_imu_t *imu);
+
+/**
+ * @brief Stop the IMU thread within UDSP_CARD_IMU_CLOCK_REFRESH_MS.
+ *
+ * @param imu Pointer to the driver state.
+ */
+void udsp_card_imu_stop(udsp_card_imu_t *imu);
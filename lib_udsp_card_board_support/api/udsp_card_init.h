@@ -0,0 +1,81 @@
+/**
+ * @file udsp_card_init.h
+ * @brief Dependency-aware bring-up scheduler, runs independent init steps in parallel.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * A bring-up is a table of steps, each with a mask of the steps it depends on.
+ * UDSP_CARD_INIT_THREADS worker threads pick up any step whose dependencies have
+ * completed, so a step that waits on hardware, such as the application PLL
+ * locking, no longer holds up unrelated steps. Readiness that depends on the
+ * hardware rather than on another step is checked by the step itself, e.g. the
+ * DAC clocked registers wait for the DAC to report a valid MCLK. Steps whose
+ * dependencies failed are skipped and count as failed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @defgroup Init_Defines Bring-Up Scheduler Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_INIT_THREADS
+#define UDSP_CARD_INIT_THREADS 2 // Worker threads including the calling one, 1 to 3
+#endif
+
+#define UDSP_CARD_INIT_MAX_STEPS 32 // Steps per table, one bit each in the dependency masks
+#define UDSP_CARD_INIT_DEP(step) (1u << (step)) // Dependency mask of a step index
+/** @} */
+
+/**
+ * @brief Step functions are called through a pointer from the worker threads.
+ * On the device, this function pointer group lets the tools bound their stacks.
+ */
+#ifdef __XS3A__
+#define UDSP_CARD_INIT_FN __attribute__((fptrgroup("udsp_card_init_step")))
+#else
+#define UDSP_CARD_INIT_FN
+#endif
+
+/**
+ * @brief Init step function.
+ *
+ * @param arg Step argument.
+ * @return 0 on success, non-zero on failure.
+ */
+typedef int (*udsp_card_init_fn_t)(void *arg);
+
+/**
+ * @brief One step of a bring-up table.
+ */
+typedef struct
+{
+    UDSP_CARD_INIT_FN udsp_card_init_fn_t fn; // Step function, declared with UDSP_CARD_INIT_FN
+    void *arg;                                // Step argument
+    uint32_t deps;                            // UDSP_CARD_INIT_DEP() of every step that must complete first
+} udsp_card_init_step_t;
+
+/**
+ * @brief Progress of a bring-up, shared by the worker threads.
+ */
+typedef struct
+{
+    const udsp_card_init_step_t *steps;
+    unsigned num_steps;
+    uint32_t claimed;  // Steps taken by a worker
+    uint32_t finished; // Steps completed or skipped
+    uint32_t failed;   // Steps that failed or were skipped
+} udsp_card_init_t;
+
+/**
+ * @brief Run a bring-up table and return when every step has finished. Uses
+ * UDSP_CARD_INIT_THREADS - 1 additional threads of the calling tile.
+ *
+ * @param init Pointer to the progress state, filled in by this call.
+ * @param steps The steps, dependencies must point to other steps of the table.
+ * @param num_steps Number of steps, at most UDSP_CARD_INIT_MAX_STEPS.
+ * @return 0 if all steps succeeded, -1 otherwise. init->failed shows which did not.
+ */
+int udsp_card_init_run(udsp_card_init_t *init, const udsp_card_init_step_t *steps, unsigned num_steps);
@@ -0,0 +1,125 @@
+/**
+ * @file udsp_card_pdm.h
+ * @brief 8-channel PDM microphone front end for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * Two threads on tile 1 run the front end. The capture thread clocks the microphones,
+ * reads all eight channels from the 4-bit data port on both clock edges and moves
+ * every port word into a ring. It never waits on decimation: the port delivers a
+ * word every 8 port clocks (1.3us at a 3.072MHz PDM clock) and holds only one more.
+ * Words the capture thread misses show up as a gap in the port timestamps. The
+ * decimation thread takes the words from the ring and decimates them to PCM in two
+ * stages:
+ *  1. A 4th order CIC, decimating by 32. It runs as its equivalent FIR directly on
+ *     the packed 1-bit samples through byte lookup tables, 16 lookups per output.
+ *  2. A windowed-sinc low pass on the vector unit (lib_xcore_math filter_fir_s32),
+ *     decimating by 1 to UDSP_CARD_PDM_MAX_DECIMATION.
+ * PCM blocks are handed to the consumer through a ping-pong pair without copying.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "xmath/xmath.h"
+
+#include "udsp_card_board.h"
+
+/** @defgroup PDM_Defines PDM Front End Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_PDM_BLOCK_FRAMES
+#define UDSP_CARD_PDM_BLOCK_FRAMES 32 // PCM frames per block
+#endif
+
+#ifndef UDSP_CARD_PDM_FIR_TAPS
+#define UDSP_CARD_PDM_FIR_TAPS 64 // Taps of the second stage low pass
+#endif
+
+#ifndef UDSP_CARD_PDM_RING_WORDS
+#define UDSP_CARD_PDM_RING_WORDS 64 // Port words between the capture and decimation threads, a power of 2
+#endif
+
+#define UDSP_CARD_PDM_CIC_DECIMATION 32 // First stage decimation, one port word per microphone
+#define UDSP_CARD_PDM_CIC_ORDER 4
+#define UDSP_CARD_PDM_CIC_TAPS (UDSP_CARD_PDM_CIC_ORDER * (UDSP_CARD_PDM_CIC_DECIMATION - 1) + 1)
+#define UDSP_CARD_PDM_HISTORY 4     // 32 bit words of 1-bit history per microphone, covers the CIC taps
+#define UDSP_CARD_PDM_MAX_DECIMATION 6 // Largest second stage decimation, 16kHz from a 3.072MHz PDM clock
+/** @} */
+
+/**
+ * @brief Front end state. Channel m of frame f is at block[f * PDM_MICS + m].
+ */
+typedef struct
+{
+    int32_t blocks[2][UDSP_CARD_PDM_BLOCK_FRAMES * PDM_MICS];
+    uint32_t filled;     // Blocks completed by the PDM thread
+    uint32_t consumed;   // Blocks released by the consumer
+    uint32_t overruns;   // Blocks dropped because the consumer held both, written by the decimation thread
+    uint32_t stalls;     // Gaps in the port timestamps, each loses port words, written by the capture thread
+    uint32_t dropped;    // Port words dropped because the ring was full, written by the capture thread
+    uint32_t captured;   // Port words written to the ring by the capture thread
+    uint32_t decimated;  // Port words taken from the ring by the decimation thread
+    unsigned clk_div;    // MCLK periods per PDM clock period
+    unsigned decimation; // Second stage decimation
+    unsigned poll_ticks; // Reference timer ticks per first stage output, the decimation thread's wait for words
+    int running;         // Cleared by udsp_card_pdm_stop()
+    uint32_t ring[UDSP_CARD_PDM_RING_WORDS];                  // Port words, low nibble rising and high nibble falling edge
+    uint32_t history[PDM_MICS][UDSP_CARD_PDM_HISTORY];        // Newest word first, newest bit is the MSB
+    int32_t coef[UDSP_CARD_PDM_FIR_TAPS];                     // Second stage coefficients, Q30 with a DC gain of 2
+    int32_t state[PDM_MICS][UDSP_CARD_PDM_FIR_TAPS];          // Second stage sample history
+    filter_fir_s32_t fir[PDM_MICS];
+} udsp_card_pdm_t;
+
+/**
+ * @brief Initialize the front end and compute its filter tables. Does not touch any hardware.
+ *
+ * @param pdm Pointer to the front end state.
+ * @param mclk_freq MCLK frequency at UDSP_CARD_PORT_MCLK in Hz. The PDM clock is
+ * MCLK scaled by PDM_CLOCK_FREQUENCY / MASTER_CLOCK_FREQUENCY.
+ * @param fs Output sample rate in Hz, the PDM clock / 32 divided by 1 to UDSP_CARD_PDM_MAX_DECIMATION.
+ * @return 0 on success, -1 if the output rate cannot be reached.
+ */
+int udsp_card_pdm_init(udsp_card_pdm_t *pdm, unsigned mclk_freq, unsigned fs);
+
+/**
+ * @brief Get the oldest completed PCM block without blocking.
+ *
+ * @param pdm Pointer to the front end state.
+ * @return UDSP_CARD_PDM_BLOCK_FRAMES frames of PDM_MICS samples, or NULL if no block is ready.
+ */
+const int32_t *udsp_card_pdm_acquire(udsp_card_pdm_t *pdm);
+
+/**
+ * @brief Return the block from udsp_card_pdm_acquire() to the decimation thread.
+ *
+ * @param pdm Pointer to the front end state.
+ */
+void udsp_card_pdm_release(udsp_card_pdm_t *pdm);
+
+/**
+ * @brief Capture thread. Starts the microphone clock and moves port words into the
+ * ring until udsp_card_pdm_stop() is called. Must run on tile 1, in parallel with
+ * udsp_card_pdm_task().
+ *
+ * @param pdm Pointer to the front end state.
+ */
+void udsp_card_pdm_capture_task(udsp_card_pdm_t *pdm);
+
+/**
+ * @brief Decimation thread. Produces PCM blocks from the words of the capture thread
+ * until udsp_card_pdm_stop() is called. Must run on tile 1, in parallel with
+ * udsp_card_pdm_capture_task().
+ *
+ * @param pdm Pointer to the front end state.
+ */
+void udsp_card_pdm_task(udsp_card_pdm_t *pdm);
+
+/**
+ * @brief Stop both front end threads after the current port word.
+ *
+ * @param pdm Pointer to the front end state.
+ */
+void udsp_card_pdm_stop(udsp_card_pdm_t *pdm);
@@ -0,0 +1,116 @@
+/**
+ * @file udsp_card_recorder.h
+ * @brief Streaming multi-channel WAV/RF64 recorder for a block device.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * Audio threads push frames into a ring buffer in constant time and never wait
+ * for the card. A writer thread drains the ring in large sector-aligned batches
+ * straight from the ring memory, so write-latency spikes of the card are absorbed
+ * by the ring. The ring may be placed in LPDDR (udsp_card_extmem.h) to cover
+ * spikes of several seconds.
+ *
+ * The recording is a contiguous WAV image starting at a given sector: a raw card
+ * region or a pre-allocated contiguous file. The header occupies the first sector
+ * and is rewritten on stop. Recordings over 4GB are finalized as RF64.
+ *
+ * udsp_card_sd.h provides the block device for the card slot of the board.
+ *
+ * Pushing and servicing must happen on the same tile.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @defgroup Recorder_Defines Recorder Configuration
+ *  @{
+ */
+#define UDSP_CARD_RECORDER_SECTOR 512 // Block device sector size in bytes
+
+#ifndef UDSP_CARD_RECORDER_BATCH_SECTORS
+#define UDSP_CARD_RECORDER_BATCH_SECTORS 128 // Sectors per write, 64KB
+#endif
+
+#define UDSP_CARD_RECORDER_BATCH_BYTES (UDSP_CARD_RECORDER_BATCH_SECTORS * UDSP_CARD_RECORDER_SECTOR)
+/** @} */
+
+/**
+ * @brief Block device backend. Sectors are UDSP_CARD_RECORDER_SECTOR bytes.
+ */
+typedef struct
+{
+    int (*write)(void *ctx, uint32_t sector, const void *buf, uint32_t count); // 0 on success
+    int (*sync)(void *ctx);                                                     // 0 on success, may be NULL
+    void *ctx;                                                                  // Backend state
+} udsp_card_blockdev_t;
+
+/**
+ * @brief Recorder state.
+ */
+typedef struct
+{
+    const udsp_card_blockdev_t *dev;
+    uint32_t first_sector;   // Sector of the WAV header
+    uint32_t max_sectors;    // Sectors available for the recording, including the header
+    uint32_t next_sector;    // Next data sector to write
+    uint8_t *ring;           // Ring memory, ring_size bytes
+    uint32_t ring_size;      // Power of two, multiple of UDSP_CARD_RECORDER_BATCH_BYTES
+    uint32_t head;           // Bytes pushed, written by the producer
+    uint32_t tail;           // Bytes written to the device, written by the writer
+    uint64_t data_bytes;     // Bytes of audio data written, writer only
+    unsigned channels;       // Channels per frame
+    unsigned fs;             // Sample rate in Hz
+    int recording;           // Cleared by udsp_card_recorder_stop() or a full device
+    uint32_t dropped;        // Frames dropped because the ring was full, written by the producer
+    uint32_t ring_peak;      // Highest ring fill in bytes, writer only
+    uint32_t batches;        // Batches written, writer only
+    uint32_t write_max;      // Longest batch write in reference ticks, writer only
+    uint32_t errors;         // Failed device writes, writer only
+} udsp_card_recorder_t;
+
+/**
+ * @brief Start a recording and write a provisional header.
+ *
+ * @param rec Pointer to the recorder.
+ * @param dev Block device backend.
+ * @param first_sector First sector of the recording region.
+ * @param max_sectors Sectors in the recording region.
+ * @param ring Ring memory, e.g. from udsp_card_extmem_alloc().
+ * @param ring_size Bytes of ring memory, power of two and multiple of UDSP_CARD_RECORDER_BATCH_BYTES.
+ * @param channels Channels per frame of 32 bit samples.
+ * @param fs Sample rate in Hz.
+ * @return 0 on success, -1 on invalid arguments or a failed header write.
+ */
+int udsp_card_recorder_start(udsp_card_recorder_t *rec, const udsp_card_blockdev_t *dev, uint32_t first_sector,
+                             uint32_t max_sectors, uint8_t *ring, uint32_t ring_size, unsigned channels, unsigned fs);
+
+/**
+ * @brief Push interleaved frames without blocking. If the ring cannot take all
+ * frames, none are pushed and they are counted as dropped.
+ *
+ * @param rec Pointer to the recorder.
+ * @param frames Interleaved 32 bit samples, channels per frame.
+ * @param num_frames Number of frames.
+ * @return 0 on success, -1 if the frames were dropped.
+ */
+int udsp_card_recorder_push(udsp_card_recorder_t *rec, const int32_t *frames, unsigned num_frames);
+
+/**
+ * @brief Write one batch if a full batch is buffered. Call from the writer thread.
+ *
+ * @param rec Pointer to the recorder.
+ * @return 1 if a batch was written, 0 if there was nothing to do, -1 on a device error.
+ */
+int udsp_card_recorder_service(udsp_card_recorder_t *rec);
+
+/**
+ * @brief Write the remaining data, finalize the header and sync the device.
+ * Call from the writer thread after the producers have stopped pushing.
+ *
+ * @param rec Pointer to the recorder.
+ * @return 0 on success, -1 on a device error.
+ */
+int udsp_card_recorder_stop(udsp_card_recorder_t *rec);
@@ -0,0 +1,135 @@
+/**
+ * @file udsp_card_remote.h
+ * @brief Cross-tile board control over a streaming channel.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The I2C and GPIO ports are on tile 0. A server thread on tile 0 receives
+ * requests from tile 1 over a streaming channel and forwards control commands
+ * to udsp_card_ctrl_task() through its own command queue, so a request never
+ * waits for the bus. All threads of tile 1 share one channel through a client
+ * that serializes calls with a hardware lock.
+ *
+ * Every request is UDSP_CARD_REMOTE_REQUEST_WORDS words {op, arg0, arg1} and is
+ * answered with UDSP_CARD_REMOTE_RESPONSE_WORDS words {status, value}.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <xcore/chanend.h>
+#include <xcore/lock.h>
+
+#include "udsp_card_ctrl.h"
+
+/** @defgroup Remote_Defines Remote Control Protocol
+ *  @{
+ */
+#define UDSP_CARD_REMOTE_REQUEST_WORDS 3
+#define UDSP_CARD_REMOTE_RESPONSE_WORDS 2
+/** @} */
+
+/**
+ * @brief Request opcodes. Opcodes below UDSP_CARD_REMOTE_DONE are udsp_card_cmd_id_t
+ * commands, posted to the control thread and answered with their sequence number.
+ */
+typedef enum
+{
+    UDSP_CARD_REMOTE_DONE = 0x10,   // arg0: sequence number, value: 1 if completed
+    UDSP_CARD_REMOTE_STATUS = 0x11, // arg0: udsp_card_remote_status_t, value: the status item
+} udsp_card_remote_op_t;
+
+/**
+ * @brief Status items.
+ */
+typedef enum
+{
+    UDSP_CARD_REMOTE_STATUS_RATE = 0,      // Current sample rate in Hz
+    UDSP_CARD_REMOTE_STATUS_COMPLETED = 1, // Forwarded commands completed
+    UDSP_CARD_REMOTE_STATUS_ERRORS = 2,    // Forwarded commands failed
+    UDSP_CARD_REMOTE_STATUS_REJECTED = 3,  // Requests rejected by the server
+} udsp_card_remote_status_t;
+
+/**
+ * @brief Client end of the control channel, shared by the threads of tile 1.
+ */
+typedef struct
+{
+    chanend_t c;
+    lock_t lock;
+} udsp_card_remote_t;
+
+/**
+ * @brief Server thread. Serves one client channel and forwards commands through
+ * queue, which must also be passed to udsp_card_ctrl_task(). Must run on tile 0.
+ * Never returns.
+ *
+ * @param c Streaming channel end connected to the client on tile 1.
+ * @param queue Command queue owned by this server.
+ */
+void udsp_card_remote_server(chanend_t c, udsp_card_ctrl_t *queue);
+
+/**
+ * @brief Initialize the client end.
+ *
+ * @param remote Pointer to the client.
+ * @param c Streaming channel end connected to the server on tile 0.
+ * @return 0 on success, -1 if no hardware lock is available.
+ */
+int udsp_card_remote_init(udsp_card_remote_t *remote, chanend_t c);
+
+/**
+ * @brief Send a request and wait for its response.
+ *
+ * @param remote Pointer to the client.
+ * @param op A udsp_card_cmd_id_t or udsp_card_remote_op_t.
+ * @param arg0 Request specific argument.
+ * @param arg1 Request specific argument.
+ * @param value Pointer to store the response value, may be NULL.
+ * @return 0 on success, -1 if the server rejected the request.
+ */
+int udsp_card_remote_call(udsp_card_remote_t *remote, uint32_t op, uint32_t arg0, uint32_t arg1, uint32_t *value);
+
+/**
+ * @brief Post a control command, see udsp_card_ctrl_post().
+ *
+ * @param remote Pointer to the client.
+ * @param id The command.
+ * @param arg0 Command specific argument.
+ * @param arg1 Command specific argument.
+ * @param seq Pointer to store the sequence number of the command, may be NULL.
+ * @return 0 on success, -1 if the server queue is full.
+ */
+int udsp_card_remote_post(udsp_card_remote_t *remote, udsp_card_cmd_id_t id, uint32_t arg0, uint32_t arg1,
+                          uint32_t *seq);
+
+/**
+ * @brief Check whether a posted command has completed.
+ *
+ * @param remote Pointer to the client.
+ * @param seq The sequence number returned by udsp_card_remote_post().
+ * @return 1 if completed, 0 otherwise.
+ */
+int udsp_card_remote_done(udsp_card_remote_t *remote, uint32_t seq);
+
+/**
+ * @brief Switch LEDs, a GPIO command limited to UDSP_CARD_GPIO_OUT_LED_x.
+ *
+ * @param remote Pointer to the client.
+ * @param led_mask UDSP_CARD_GPIO_OUT_LED_0 and/or UDSP_CARD_GPIO_OUT_LED_1.
+ * @param on 1 to switch on, 0 to switch off.
+ * @return 0 on success, -1 if the server queue is full.
+ */
+int udsp_card_remote_led(udsp_card_remote_t *remote, unsigned led_mask, int on);
+
+/**
+ * @brief Read a status item.
+ *
+ * @param remote Pointer to the client.
+ * @param item The status item.
+ * @param value Pointer to store the value.
+ * @return 0 on success, -1 if the item is unknown.
+ */
+int udsp_card_remote_status(udsp_card_remote_t *remote, udsp_card_remote_status_t item, uint32_t *value);
@@ -0,0 +1,84 @@
+/**
+ * @file udsp_card_sd.h
+ * @brief SD card block device on the card slot of the uDSP-Card, the target backend
+ * of udsp_card_recorder.h.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ *
+ * The card runs in the 1-bit SD bus mode. SPI mode would need the chip select on
+ * DAT3 driven while DAT0 is read, which the shared 4-bit UDSP_CARD_PORT_SD_SIO
+ * port cannot do. The clock is generated in software on UDSP_CARD_PORT_SD_CLK, the
+ * card is identified at UDSP_CARD_SD_INIT_KHZ and then written as fast as the
+ * thread toggles the pins. Commands and their responses use UDSP_CARD_PORT_SD_CMD,
+ * data uses DAT0, bit 0 of UDSP_CARD_PORT_SD_SIO, and DAT1-3 are driven high while
+ * the host sends a block. Released lines rely on the pull-ups of the card slot.
+ *
+ * Writes use CMD25 multiple block writes with a CRC16 per block, as the recorder
+ * writes whole batches. SDSC, SDHC and SDXC cards are supported. Reads, the 4-bit
+ * bus and high speed mode are not implemented, so the sustained write rate depends
+ * on the MIPS of the writer thread; check rec.write_max against the ring before
+ * relying on it for many channels. Must run on tile 0.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "udsp_card_recorder.h"
+
+/** @defgroup SD_Defines SD Card Configuration
+ *  @{
+ */
+#ifndef UDSP_CARD_SD_INIT_KHZ
+#define UDSP_CARD_SD_INIT_KHZ 400 // Clock during card identification, at most 400kHz
+#endif
+
+#ifndef UDSP_CARD_SD_INIT_TIMEOUT_MS
+#define UDSP_CARD_SD_INIT_TIMEOUT_MS 1000 // Time the card may take to power up in ACMD41
+#endif
+
+#ifndef UDSP_CARD_SD_BUSY_TIMEOUT_MS
+#define UDSP_CARD_SD_BUSY_TIMEOUT_MS 500 // Time the card may hold DAT0 low while programming a block
+#endif
+/** @} */
+
+/**
+ * @brief Card state.
+ */
+typedef struct
+{
+    uint16_t rca;          // Relative card address assigned by CMD3
+    int block_addressing;  // SDHC and SDXC address sectors, SDSC addresses bytes
+    unsigned half_period;  // Reference timer ticks per half clock, 0 at full rate
+    uint32_t errors;       // Failed commands or blocks the card did not accept
+} udsp_card_sd_t;
+
+/**
+ * @brief Identify the card, select it and set up a block device for the recorder.
+ *
+ * @param sd Pointer to the card state.
+ * @param dev Block device to set up, valid while sd is.
+ * @return 0 on success, -1 if no card answers or the card cannot be used.
+ */
+int udsp_card_sd_init(udsp_card_sd_t *sd, udsp_card_blockdev_t *dev);
+
+/**
+ * @brief Write consecutive sectors. Block device write of udsp_card_sd_init().
+ *
+ * @param ctx Pointer to the card state.
+ * @param sector First sector.
+ * @param buf count * UDSP_CARD_RECORDER_SECTOR bytes.
+ * @param count Number of sectors.
+ * @return 0 on success, -1 on failure.
+ */
+int udsp_card_sd_write(void *ctx, uint32_t sector, const void *buf, uint32_t count);
+
+/**
+ * @brief Check that the card has finished programming and is ready for data.
+ * Block device sync of udsp_card_sd_init().
+ *
+ * @param ctx Pointer to the card state.
+ * @return 0 on success, -1 on failure.
+ */
+int udsp_card_sd_sync(void *ctx);
@@ -0,0 +1,106 @@
+/**
+ * @file udsp_card_trace.h
+ * @brief Timestamped bring-up trace for the uDSP-Card, exported over xscope.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @defgroup Trace_Defines Bring-Up Trace Configuration
+ *  @brief Build with -DUDSP_CARD_TRACE=1 to record trace events. When disabled,
+ *  UDSP_CARD_TRACE_EVENT() compiles to nothing. Events are recorded only from
+ *  UDSP_CARD_TRACE_START up to and including UDSP_CARD_TRACE_DONE, so register
+ *  writes at runtime do not touch the bring-up timeline.
+ *  @{
+ */
+#ifndef UDSP_CARD_TRACE
+#define UDSP_CARD_TRACE 0
+#endif
+
+#ifndef UDSP_CARD_TRACE_DEPTH
+#define UDSP_CARD_TRACE_DEPTH 64 // Number of entries in the trace buffer, later entries are dropped when it is full
+#endif
+
+#ifndef UDSP_CARD_TRACE_XSCOPE_PROBE
+#define UDSP_CARD_TRACE_XSCOPE_PROBE 0 // Index of the xscope probe declared in the application's config.xscope
+#endif
+/** @} */
+
+/**
+ * @brief Trace events. Each event is recorded when its phase has completed,
+ * so the time since the previous entry of the same bring-up step is the
+ * duration of the phase. Steps running in parallel interleave their entries.
+ */
+typedef enum
+{
+    UDSP_CARD_TRACE_START = 0,       // Bring-up started
+    UDSP_CARD_TRACE_PLL_CONFIG = 1,  // Application PLL configured
+    UDSP_CARD_TRACE_I2C_INIT = 2,    // I2C master initialized
+    UDSP_CARD_TRACE_GPIO_ENABLE = 3, // GPIO outputs enabled. arg0: port value
+    UDSP_CARD_TRACE_DAC_WRITE = 4,   // DAC register burst written. arg0: register, arg1: length
+    UDSP_CARD_TRACE_DAC_WAIT = 5,    // DAC ready wait finished. arg0: state mask, arg1: 0 ready, 1 timeout
+    UDSP_CARD_TRACE_DELAY = 6,       // Fixed delay elapsed. arg1: microseconds
+    UDSP_CARD_TRACE_DONE = 7,        // Bring-up finished. arg1: 0 success, 1 failure
+} udsp_card_trace_event_t;
+
+/**
+ * @brief One trace entry as stored in the buffer and sent over xscope (8 bytes, little endian).
+ */
+typedef struct
+{
+    uint32_t timestamp; // Reference timer ticks (100MHz)
+    uint8_t event;      // udsp_card_trace_event_t
+    uint8_t arg0;       // Event specific argument
+    uint16_t arg1;      // Event specific argument
+} udsp_card_trace_entry_t;
+
+#if UDSP_CARD_TRACE
+#define UDSP_CARD_TRACE_EVENT(event, arg0, arg1) udsp_card_trace_record(event, arg0, arg1)
+#else
+#define UDSP_CARD_TRACE_EVENT(event, arg0, arg1)
+#endif
+
+/**
+ * @brief Record a trace event with the current reference timer timestamp.
+ * Safe to call from the parallel bring-up steps of a tile. UDSP_CARD_TRACE_START
+ * clears the buffer and opens the recording window, UDSP_CARD_TRACE_DONE closes
+ * it. Events outside the window are ignored.
+ *
+ * @param event The trace event.
+ * @param arg0 Event specific argument.
+ * @param arg1 Event specific argument.
+ */
+void udsp_card_trace_record(udsp_card_trace_event_t event, uint8_t arg0, uint16_t arg1);
+
+/**
+ * @brief Copy the recorded entries sorted by timestamp, oldest first. Entries
+ * of events still being recorded by another thread are skipped.
+ *
+ * @param entries Pointer to store the entries.
+ * @param max_entries Maximum number of entries to copy.
+ * @return Number of entries copied.
+ */
+unsigned udsp_card_trace_get(udsp_card_trace_entry_t *entries, unsigned max_entries);
+
+/**
+ * @brief Send all recorded entries as udsp_card_trace_get() returns them over xscope on probe
+ * UDSP_CARD_TRACE_XSCOPE_PROBE and clear the buffer. Decode the stream on the
+ * host with tools/udsp_card_trace.py.
+ */
+void udsp_card_trace_dump();
+
+/**
+ * @brief Clear the trace buffer and close the recording window.
+ */
+void udsp_card_trace_clear();
+
+/**
+ * @brief Number of events dropped since the last start because the buffer was full.
+ *
+ * @return Number of dropped events.
+ */
+unsigned udsp_card_trace_dropped();
@@ -9,111 +9,1588 @@
 #include <platform.h>
 #include <xclib.h>
 #include <xs1.h>
+#include <xcore/hwtimer.h>
 
 #include <stdio.h>
+#include <string.h>
 
 #include "debug_print.h"
 #include "i2c.h"
 
 #include "es9033.h"
+#include "udsp_card_trace.h"
+
+/** Bus statistics for all ES9033 transactions issued by this driver. */
+static es9033_i2c_stats_t es9033_stats;
+
+/** Shadow index of the first write-only slave register (0xC0). */
+#define ES9033_SHADOW_SS_BASE (ES9033_REG_MASTER_TRIM + 1)
+/** Marks a shadow register as documented in es9033.h. */
+#define ES9033_DOC 0x100
+
+/**
+ * @brief Reset defaults of the writable register file, indexed by shadow index.
+ * Entries without ES9033_DOC are reserved and never written by a flush.
+ */
+static const uint16_t es9033_reg_defaults[ES9033_SHADOW_SIZE] = {
+	[ES9033_REG_SYSTEM_CONFIG] = ES9033_DOC | 0x3C,
+	[ES9033_REG_SYS_MODE_CONFIG] = ES9033_DOC | 0x01,
+	[ES9033_REG_DAC_CLOCK_CONFIG] = ES9033_DOC | 0x07,
+	[ES9033_REG_MASTER_CLOCK_CONFIG] = ES9033_DOC | 0x07,
+	[ES9033_REG_CP_CLOCK_DIV] = ES9033_DOC | 0x1F,
+	[ES9033_REG_INTERRUPT_MASK_P_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INTERRUPT_MASK_P_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INTERRUPT_MASK_N_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INTERRUPT_MASK_N_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INTERRUPT_CLEAR_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INTERRUPT_CLEAR_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_ANALOG_CTRL_CONFIG] = ES9033_DOC | 0x60,
+	[ES9033_REG_LDRV_CTRL] = ES9033_DOC | 0x00,
+	[ES9033_REG_ANALOG_CONTROL_OVERRIDE] = ES9033_DOC | 0xC0,
+	[ES9033_REG_GPIO_CONFIG] = ES9033_DOC | 0x00,
+	[ES9033_REG_GPIO_CONFIG2] = ES9033_DOC | 0x00,
+	[ES9033_REG_INPUT_ENABLE] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM1_COUNT] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM1_FREQUENCY_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM1_FREQUENCY_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM2_COUNT] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM2_FREQUENCY_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM2_FREQUENCY_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM3_COUNT] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM3_FREQUENCY_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_PWM3_FREQUENCY_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_INPUT_CONFIG] = ES9033_DOC | 0x80,
+	[ES9033_REG_MASTER_MODE_CONFIG] = ES9033_DOC | 0x01,
+	[ES9033_REG_TDM_CONFIG1] = ES9033_DOC | 0x01,
+	[ES9033_REG_TDM_CONFIG2] = ES9033_DOC | 0x01,
+	[ES9033_REG_TDM_CONFIG3] = ES9033_DOC | 0x00,
+	[ES9033_REG_TDM_SLOT_CONFIG] = ES9033_DOC | 0x10,
+	[ES9033_REG_RESYNC_CONFIG] = ES9033_DOC | 0x40,
+	[ES9033_REG_DSD_2DB_DOWN] = ES9033_DOC | 0x80,
+	[ES9033_REG_VOLUME1] = ES9033_DOC | 0x00,
+	[ES9033_REG_VOLUME2] = ES9033_DOC | 0x00,
+	[ES9033_REG_DAC_VOL_UP_RATE] = ES9033_DOC | 150,
+	[ES9033_REG_DAC_VOL_DOWN_RATE] = ES9033_DOC | 150,
+	[ES9033_REG_DAC_VOL_DOWN_RATE_FAST] = ES9033_DOC | 0x00,
+	[ES9033_REG_MUTE_CTRL] = ES9033_DOC | 0x00,
+	[ES9033_REG_FILTER_CONFIG] = ES9033_DOC | 0x44,
+	[ES9033_REG_DATAPATH_CONTROL] = ES9033_DOC | 0x00,
+	[ES9033_REG_THD_COMP_C2_CH1_LSB] = ES9033_DOC | (360 & 0xFF),
+	[ES9033_REG_THD_COMP_C2_CH1_MSB] = ES9033_DOC | (360 >> 8),
+	[ES9033_REG_THD_COMP_C3_CH1_LSB] = ES9033_DOC | (141 & 0xFF),
+	[ES9033_REG_THD_COMP_C3_CH1_MSB] = ES9033_DOC | (141 >> 8),
+	[ES9033_REG_THD_COMP_C2_CH2_LSB] = ES9033_DOC | (360 & 0xFF),
+	[ES9033_REG_THD_COMP_C2_CH2_MSB] = ES9033_DOC | (360 >> 8),
+	[ES9033_REG_THD_COMP_C3_CH2_LSB] = ES9033_DOC | (141 & 0xFF),
+	[ES9033_REG_THD_COMP_C3_CH2_MSB] = ES9033_DOC | (141 >> 8),
+	[ES9033_REG_AUTOMUTE_TIME_LSB] = ES9033_DOC | 0x0F,
+	[ES9033_REG_AUTOMUTE_TIME_MSB] = ES9033_DOC | 0xD8,
+	[ES9033_REG_AUTOMUTE_LEVEL_LSB] = ES9033_DOC | 8,
+	[ES9033_REG_AUTOMUTE_LEVEL_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_AUTOMUTE_OFF_LEVEL_LSB] = ES9033_DOC | 10,
+	[ES9033_REG_AUTOMUTE_OFF_LEVEL_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_SOFT_RAMP_CONFIG] = ES9033_DOC | 0x02,
+	[ES9033_REG_DRE_FORCE] = ES9033_DOC | 0xC0,
+	[ES9033_REG_DRE_GAIN_CH1_LSB] = ES9033_DOC | 0x34,
+	[ES9033_REG_DRE_GAIN_CH1_MSB] = ES9033_DOC | 0x1A,
+	[ES9033_REG_DRE_GAIN_CH2_LSB] = ES9033_DOC | 0x34,
+	[ES9033_REG_DRE_GAIN_CH2_MSB] = ES9033_DOC | 0x1A,
+	[ES9033_REG_DRE_ON_THRESH_LSB] = ES9033_DOC | 0xF1,
+	[ES9033_REG_DRE_ON_THRESH_MSB] = ES9033_DOC | 0x0C,
+	[ES9033_REG_DRE_OFF_THRESH_LSB] = ES9033_DOC | 0x84,
+	[ES9033_REG_DRE_OFF_THRESH_MSB] = ES9033_DOC | 0x81,
+	[ES9033_REG_DRE_DECAY_RATE] = ES9033_DOC | 0xA0,
+	[ES9033_REG_DC_OFFSET_CH1_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_DC_OFFSET_CH1_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_DC_OFFSET_CH2_LSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_DC_OFFSET_CH2_MSB] = ES9033_DOC | 0x00,
+	[ES9033_REG_DC_RAMP_RATE] = ES9033_DOC | 0x00,
+	[ES9033_REG_MASTER_TRIM] = ES9033_DOC | 0x00,
+	[ES9033_SHADOW_SS_BASE + 0x0] = ES9033_DOC | 0x01, // RESET_PLL1
+	[ES9033_SHADOW_SS_BASE + 0x1] = ES9033_DOC | 0x00, // PLL2
+	[ES9033_SHADOW_SS_BASE + 0x2] = ES9033_DOC | 0x00, // PLL3
+	[ES9033_SHADOW_SS_BASE + 0x3] = ES9033_DOC | 0x00, // PLL4
+	[ES9033_SHADOW_SS_BASE + 0x4] = ES9033_DOC | 0x00, // PLL5
+	[ES9033_SHADOW_SS_BASE + 0x5] = ES9033_DOC | 0x00, // PLL6 LSB
+	[ES9033_SHADOW_SS_BASE + 0x6] = ES9033_DOC | 0x00, // PLL6 MID
+	[ES9033_SHADOW_SS_BASE + 0x7] = ES9033_DOC | 0x00, // PLL6 MSB
+	[ES9033_SHADOW_SS_BASE + 0x8] = ES9033_DOC | 0x00, // PLL7 LSB
+	[ES9033_SHADOW_SS_BASE + 0x9] = ES9033_DOC | 0x00, // PLL7 MID
+	[ES9033_SHADOW_SS_BASE + 0xA] = ES9033_DOC | 0x00, // PLL7 MSB
+	[ES9033_SHADOW_SS_BASE + 0xB] = ES9033_DOC | 0x00, // PLL8
+};
+
+/** Device addressed by the functions without a handle, e.g. es9033_flush(). */
+static es9033_dev_t es9033_default = {
+	.addr = ES9033_I2C_DEVICE_ADDR,
+	.addr_ss = ES9033_I2C_DEVICE_ADDR_SS,
+};
+
+/**
+ * @brief Map a writable register address to its shadow index.
+ * @param reg The register address.
+ * @return The shadow index, or -1 if the register is not a documented writable register.
+ **/
+static inline int es9033_shadow_index(unsigned reg)
+{
+	int idx;
+
+	if (reg <= ES9033_REG_MASTER_TRIM)
+	{
+		idx = reg;
+	}
+	else if (ES9033_REG_RESET_PLL1 <= reg && reg <= ES9033_REG_PLL8)
+	{
+		idx = ES9033_SHADOW_SS_BASE + reg - ES9033_REG_RESET_PLL1;
+	}
+	else
+	{
+		return -1;
+	}
+
+	return (es9033_reg_defaults[idx] & ES9033_DOC) ? idx : -1;
+}
+
+/**
+ * @brief Map a shadow index back to its register address.
+ **/
+static inline uint8_t es9033_shadow_reg(int idx)
+{
+	return idx < ES9033_SHADOW_SS_BASE ? idx : ES9033_REG_RESET_PLL1 + idx - ES9033_SHADOW_SS_BASE;
+}
+
+static inline int es9033_shadow_is_dirty(const es9033_dev_t *dev, int idx)
+{
+	return (dev->shadow.dirty[idx >> 5] >> (idx & 31)) & 1;
+}
+
+static inline void es9033_shadow_mark(es9033_dev_t *dev, int idx, int dirty)
+{
+	if (dirty)
+	{
+		dev->shadow.dirty[idx >> 5] |= 1u << (idx & 31);
+	}
+	else
+	{
+		dev->shadow.dirty[idx >> 5] &= ~(1u << (idx & 31));
+	}
+}
+
+/**
+ * @brief Update the shadow after registers have been written on the bus.
+ **/
+static void es9033_shadow_written(es9033_dev_t *dev, uint8_t reg, const uint8_t *vals, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		int idx = es9033_shadow_index(reg + i);
+
+		if (idx >= 0)
+		{
+			dev->shadow.regs[idx] = vals[i];
+			es9033_shadow_mark(dev, idx, 0);
+		}
+	}
+}
+
+/**
+ * @brief Resolve the I2C device address of a writable register range.
+ * @param dev The device.
+ * @param reg The first register address of the range.
+ * @param len The number of consecutive registers in the range.
+ * @param addr Pointer to store the resolved device address.
+ * @return 0 on success, -1 if the range is not writable or spans both register banks.
+ **/
+static inline int es9033_reg_addr(const es9033_dev_t *dev, uint8_t reg, size_t len, uint8_t *addr)
+{
+	unsigned last = reg + len - 1;
+
+	if (len == 0)
+	{
+		return -1;
+	}
+
+	if (last <= ES9033_REG_MASTER_TRIM)
+	{
+		*addr = dev->addr;
+	}
+	else if (ES9033_REG_RESET_PLL1 <= reg && last <= ES9033_REG_PLL8)
+	{
+		*addr = dev->addr_ss;
+	}
+	else
+	{
+		debug_printf("ES9033: Reg 0x%x-0x%x is not writable\n", reg, last);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Write consecutive registers of the ES9033 DAC in a single transaction.
+ * The DAC auto-increments the register address after every data byte, so
+ * a burst only pays the start/address/stop overhead once. The range is not
+ * checked, callers must pass a writable range of the given device address.
+ * @param dev The device, its shadow is updated once the write is acknowledged.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param addr The I2C device address of the register bank.
+ * @param reg The first register address to write to.
+ * @param vals The values to write, starting at reg.
+ * @param len The number of registers to write, at most ES9033_BURST_MAX_LEN.
+ * @return 0 on success, -1 on failure.
+ **/
+static int es9033_bus_write(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t addr, uint8_t reg, const uint8_t *vals,
+							size_t len)
+{
+	uint8_t buf[1 + ES9033_BURST_MAX_LEN];
+	size_t sent = 0;
+	i2c_res_t ret;
+
+	buf[0] = reg;
+	memcpy(&buf[1], vals, len);
+
+	// Register writes are idempotent, so a write that was not acknowledged is simply repeated
+	for (int attempt = 0; attempt <= ES9033_WRITE_RETRIES; attempt++)
+	{
+		if (attempt)
+		{
+			es9033_stats.retries++;
+		}
+
+		ret = i2c_master_write(i2c_ctx, addr, buf, len + 1, &sent, 1);
+
+		es9033_stats.transactions++;
+		es9033_stats.bytes += sent + 1;
+
+		if (ret == I2C_ACK && sent == len + 1)
+		{
+			break;
+		}
+	}
+
+	if (ret != I2C_ACK || sent != len + 1)
+	{
+		es9033_stats.errors++;
+		debug_printf("ES9033: Failed to write reg 0x%x len %d\n", reg, (int)len);
+		return -1;
+	}
+
+	es9033_shadow_written(dev, reg, &buf[1], len);
+
+	UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_DAC_WRITE, reg, len);
+
+	return 0;
+}
+
+/**
+ * @brief Read consecutive registers of the ES9033 DAC in a single transaction.
+ * Failures are not reported, as a NACK is expected while the DAC has no clock.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param addr The I2C device address of the register bank.
+ * @param reg The first register address to read from.
+ * @param vals Pointer to store the values, starting at reg.
+ * @param len The number of registers to read.
+ * @return 0 on success, -1 on failure.
+ **/
+static int es9033_bus_read(i2c_master_t *i2c_ctx, uint8_t addr, uint8_t reg, uint8_t *vals, size_t len)
+{
+	size_t sent = 0;
+	i2c_res_t ret;
+
+	// Set the register pointer, then read with a repeated start
+	ret = i2c_master_write(i2c_ctx, addr, &reg, 1, &sent, 0);
+
+	es9033_stats.transactions++;
+	es9033_stats.bytes += sent + 1;
+
+	if (ret != I2C_ACK || sent != 1)
+	{
+		i2c_master_stop_bit_send(i2c_ctx);
+		return -1;
+	}
+
+	ret = i2c_master_read(i2c_ctx, addr, vals, len, 1);
+
+	es9033_stats.bytes += len + 1;
+
+	return ret == I2C_ACK ? 0 : -1;
+}
+
+/**
+ * @brief Write consecutive registers of the ES9033 DAC in a single transaction.
+ * @param dev The device.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param reg The first register address to write to.
+ * @param vals The values to write, starting at reg.
+ * @param len The number of registers to write.
+ * @return 0 on success, -1 on failure.
+ **/
+static int es9033_reg_write_burst(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, const uint8_t *vals, size_t len)
+{
+	uint8_t addr;
+
+	if (len > ES9033_BURST_MAX_LEN || es9033_reg_addr(dev, reg, len, &addr))
+	{
+		return -1;
+	}
+
+	return es9033_bus_write(dev, i2c_ctx, addr, reg, vals, len);
+}
+
+/**
+ * @brief Write a register to the ES9033 DAC.
+ * @param dev The device.
+ * @param i2c_ctx Pointer to the I2C context for communication.
+ * @param reg The register address to write to.
+ * @param val The value to write to the register.
+ * @return 0 on success, -1 on failure.
+ **/
+static inline int es9033_reg_write(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, uint8_t val)
+{
+	return es9033_reg_write_burst(dev, i2c_ctx, reg, &val, 1);
+}
+
+void es9033_dev_init(es9033_dev_t *dev, unsigned pins)
+{
+	dev->addr = ES9033_I2C_ADDR(pins);
+	dev->addr_ss = ES9033_I2C_ADDR_SS(pins);
+	dev->suspend.suspended = 0;
+	es9033_dev_shadow_reset(dev);
+}
+
+es9033_dev_t *es9033_dev_default()
+{
+	return &es9033_default;
+}
+
+int es9033_dev_reg_read(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, uint8_t *val)
+{
+	if (ES9033_REG_MASTER_TRIM < reg && reg < ES9033_REG_SYS_READ)
+	{
+		debug_printf("ES9033: Reg 0x%x is not readable\n", reg);
+		return -1;
+	}
+
+	if (es9033_bus_read(i2c_ctx, dev->addr, reg, val, 1))
+	{
+		es9033_stats.errors++;
+		debug_printf("ES9033: Failed to read reg 0x%x\n", reg);
+		return -1;
+	}
+
+	return 0;
+}
+
+int es9033_reg_read(i2c_master_t *i2c_ctx, uint8_t reg, uint8_t *val)
+{
+	return es9033_dev_reg_read(&es9033_default, i2c_ctx, reg, val);
+}
+
+int es9033_dev_handshake(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t *chip_id)
+{
+	uint8_t first[2];
+	uint8_t second[2];
+
+	// SYS_READ and CHIP_ID are adjacent, a corrupted bit on either read shows up as a mismatch
+	if (es9033_bus_read(i2c_ctx, dev->addr, ES9033_REG_SYS_READ, first, sizeof(first)) ||
+		es9033_bus_read(i2c_ctx, dev->addr, ES9033_REG_SYS_READ, second, sizeof(second)) ||
+		first[0] != second[0] || first[1] != second[1] ||
+		(first[0] & (ES9033_BIT_SYS_ADDR1 | ES9033_BIT_SYS_ADDR0)) != ((dev->addr & 0x03) << 1))
+	{
+		es9033_stats.errors++;
+		return -1;
+	}
+
+	if (chip_id)
+	{
+		*chip_id = first[1];
+	}
+
+	return 0;
+}
+
+int es9033_handshake(i2c_master_t *i2c_ctx, uint8_t *chip_id)
+{
+	return es9033_dev_handshake(&es9033_default, i2c_ctx, chip_id);
+}
+
+int es9033_dev_probe(es9033_dev_t *dev, i2c_master_t *i2c_ctx)
+{
+	uint8_t reg = ES9033_REG_RESET_PLL1;
+	size_t sent = 0;
+	i2c_res_t ret;
+
+	ret = i2c_master_write(i2c_ctx, dev->addr_ss, &reg, 1, &sent, 1);
+
+	es9033_stats.transactions++;
+	es9033_stats.bytes += sent + 1;
+
+	if (ret != I2C_ACK || sent != 1)
+	{
+		es9033_stats.errors++;
+		return -1;
+	}
+
+	return 0;
+}
+
+int es9033_probe(i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_probe(&es9033_default, i2c_ctx);
+}
+
+int es9033_dev_wait_status(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t reg, uint8_t mask, unsigned timeout_us)
+{
+	uint32_t start = get_reference_time();
+	uint8_t state;
+
+	do
+	{
+		if (es9033_bus_read(i2c_ctx, dev->addr, reg, &state, 1) == 0 &&
+			(state & mask) == mask)
+		{
+			return 0;
+		}
+		// Bound the wait by time, not by back-to-back bus reads
+		delay_microseconds(ES9033_POLL_INTERVAL_US);
+	} while (get_reference_time() - start < timeout_us * XS1_TIMER_MHZ);
+
+	debug_printf("ES9033: Timeout waiting for reg 0x%x state 0x%x\n", reg, mask);
+	return -1;
+}
+
+int es9033_wait_status(i2c_master_t *i2c_ctx, uint8_t reg, uint8_t mask, unsigned timeout_us)
+{
+	return es9033_dev_wait_status(&es9033_default, i2c_ctx, reg, mask, timeout_us);
+}
+
+int es9033_dev_wait_ready(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t mask, unsigned timeout_us)
+{
+	return es9033_dev_wait_status(dev, i2c_ctx, ES9033_REG_INTERRUPT_STATE2, mask, timeout_us);
+}
+
+int es9033_wait_ready(i2c_master_t *i2c_ctx, uint8_t mask, unsigned timeout_us)
+{
+	return es9033_dev_wait_ready(&es9033_default, i2c_ctx, mask, timeout_us);
+}
+
+void es9033_i2c_stats_get(es9033_i2c_stats_t *stats)
+{
+	*stats = es9033_stats;
+}
+
+void es9033_i2c_stats_reset()
+{
+	es9033_stats.transactions = 0;
+	es9033_stats.bytes = 0;
+	es9033_stats.errors = 0;
+	es9033_stats.retries = 0;
+}
+
+void es9033_dev_shadow_reset(es9033_dev_t *dev)
+{
+	for (int idx = 0; idx < ES9033_SHADOW_SIZE; idx++)
+	{
+		dev->shadow.regs[idx] = es9033_reg_defaults[idx] & 0xFF;
+	}
+
+	memset(dev->shadow.dirty, 0, sizeof(dev->shadow.dirty));
+}
+
+void es9033_shadow_reset()
+{
+	es9033_dev_shadow_reset(&es9033_default);
+}
+
+int es9033_dev_reg_set(es9033_dev_t *dev, uint8_t reg, uint8_t val)
+{
+	int idx = es9033_shadow_index(reg);
+
+	if (idx < 0)
+	{
+		debug_printf("ES9033: Reg 0x%x is not cached\n", reg);
+		return -1;
+	}
+
+	if (dev->shadow.regs[idx] != val)
+	{
+		dev->shadow.regs[idx] = val;
+		es9033_shadow_mark(dev, idx, 1);
+	}
+
+	return 0;
+}
+
+int es9033_reg_set(uint8_t reg, uint8_t val)
+{
+	return es9033_dev_reg_set(&es9033_default, reg, val);
+}
+
+uint8_t es9033_dev_reg_get(const es9033_dev_t *dev, uint8_t reg)
+{
+	int idx = es9033_shadow_index(reg);
+
+	return idx < 0 ? 0 : dev->shadow.regs[idx];
+}
+
+uint8_t es9033_reg_get(uint8_t reg)
+{
+	return es9033_dev_reg_get(&es9033_default, reg);
+}
+
+int es9033_dev_field_set(es9033_dev_t *dev, uint8_t reg, uint32_t mask, uint32_t val)
+{
+	uint32_t field;
+	int ret = 0;
+
+	if (mask == 0)
+	{
+		return -1;
+	}
+
+	field = (val << __builtin_ctz(mask)) & mask;
+
+	for (int i = 0; i < 4; i++)
+	{
+		if ((uint8_t)(mask >> (8 * i)) && es9033_shadow_index(reg + i) < 0)
+		{
+			debug_printf("ES9033: Reg 0x%x is not cached\n", reg + i);
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		uint8_t byte_mask = mask >> (8 * i);
+
+		if (byte_mask)
+		{
+			uint8_t old = es9033_dev_reg_get(dev, reg + i);
+			ret |= es9033_dev_reg_set(dev, reg + i, (old & ~byte_mask) | ((field >> (8 * i)) & byte_mask));
+		}
+	}
+
+	return ret;
+}
+
+int es9033_field_set(uint8_t reg, uint32_t mask, uint32_t val)
+{
+	return es9033_dev_field_set(&es9033_default, reg, mask, val);
+}
+
+uint32_t es9033_dev_field_get(const es9033_dev_t *dev, uint8_t reg, uint32_t mask)
+{
+	uint32_t val = 0;
+
+	if (mask == 0)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		if ((uint8_t)(mask >> (8 * i)))
+		{
+			val |= (uint32_t)es9033_dev_reg_get(dev, reg + i) << (8 * i);
+		}
+	}
+
+	return (val & mask) >> __builtin_ctz(mask);
+}
+
+uint32_t es9033_field_get(uint8_t reg, uint32_t mask)
+{
+	return es9033_dev_field_get(&es9033_default, reg, mask);
+}
+
+/**
+ * @brief Write the dirty registers with shadow index first <= idx < end.
+ **/
+static int es9033_flush_range(es9033_dev_t *dev, i2c_master_t *i2c_ctx, int first_idx, int end)
+{
+	int ret = 0;
+	int idx = first_idx;
+
+	while (idx < end)
+	{
+		int first, last, next;
+
+		if (!es9033_shadow_is_dirty(dev, idx))
+		{
+			idx++;
+			continue;
+		}
+
+		// Grow the burst over dirty registers, bridging short runs of clean
+		// documented registers when that is cheaper than a new transaction
+		first = last = idx;
+		for (next = idx + 1; next < end && next - first < ES9033_BURST_MAX_LEN; next++)
+		{
+			if (next == ES9033_SHADOW_SS_BASE || !(es9033_reg_defaults[next] & ES9033_DOC) ||
+				next - last > ES9033_FLUSH_MAX_GAP + 1)
+			{
+				break;
+			}
+
+			if (es9033_shadow_is_dirty(dev, next))
+			{
+				last = next;
+			}
+		}
+
+		ret |= es9033_reg_write_burst(dev, i2c_ctx, es9033_shadow_reg(first), &dev->shadow.regs[first],
+									  last - first + 1);
+		idx = last + 1;
+	}
+
+	return ret;
+}
+
+int es9033_dev_flush(es9033_dev_t *dev, i2c_master_t *i2c_ctx)
+{
+	return es9033_flush_range(dev, i2c_ctx, 0, ES9033_SHADOW_SIZE);
+}
+
+int es9033_flush(i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_flush(&es9033_default, i2c_ctx);
+}
+
+const es9033_profile_t es9033_profile_44k1 = ES9033_PROFILE(45158400, 44100);
+const es9033_profile_t es9033_profile_48k = ES9033_PROFILE(49152000, 48000);
+const es9033_profile_t es9033_profile_96k = ES9033_PROFILE(49152000, 96000);
+const es9033_profile_t es9033_profile_192k = ES9033_PROFILE(49152000, 192000);
+const es9033_profile_t es9033_profile_384k = ES9033_PROFILE(49152000, 384000);
+
+/**
+ * @brief Number of leading profile steps that write the slave bank, which needs no system clock.
+ **/
+static int es9033_profile_ss_steps(const es9033_profile_t *profile)
+{
+	int n = 0;
+
+	while (n < ES9033_PROFILE_STEPS && profile->steps[n].addr == ES9033_I2C_DEVICE_ADDR_SS)
+	{
+		n++;
+	}
+
+	return n;
+}
+
+/**
+ * @brief Map the bank address of a profile step to the address pair of a device.
+ **/
+static inline uint8_t es9033_step_addr(const es9033_dev_t *dev, const es9033_step_t *step)
+{
+	return step->addr == ES9033_I2C_DEVICE_ADDR_SS ? dev->addr_ss : dev->addr;
+}
+
+/**
+ * @brief Wait until every device reports the INTERRUPT_STATE2 flags in mask.
+ * The devices run from the same MCLK, so once the first one is ready the others
+ * pass on their first poll.
+ **/
+static int es9033_devs_wait_ready(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx, uint8_t mask)
+{
+	int ret = 0;
+
+	for (unsigned d = 0; d < num; d++)
+	{
+		ret |= es9033_dev_wait_ready(devs[d], i2c_ctx, mask, ES9033_READY_TIMEOUT_US);
+	}
+
+	UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_DAC_WAIT, mask, ret != 0);
+
+	return ret;
+}
+
+/**
+ * @brief Run the profile steps first <= i < end on every device. The wait of
+ * the last step is skipped if wait_last is 0.
+ **/
+static int es9033_profile_run(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx,
+							  const es9033_profile_t *profile, int first, int end, int wait_last)
+{
+	int ret = 0;
+
+	// Every step has been checked for a writable range at build time
+	for (int i = first; i < end; i++)
+	{
+		const es9033_step_t *step = &profile->steps[i];
+
+		// The burst goes to every device back to back, the wait and delay after it are paid once.
+		// Profiles with fewer steps, e.g. from the flash store, end in empty ones.
+		for (unsigned d = 0; d < num && step->len; d++)
+		{
+			ret |= es9033_bus_write(devs[d], i2c_ctx, es9033_step_addr(devs[d], step), step->reg, step->vals,
+									step->len);
+		}
+
+		if (step->wait_mask && (wait_last || i < end - 1))
+		{
+			ret |= es9033_devs_wait_ready(devs, num, i2c_ctx, step->wait_mask);
+		}
+
+		if (step->delay_us)
+		{
+			delay_microseconds(step->delay_us);
+			UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_DELAY, 0, step->delay_us);
+		}
+	}
+
+	return ret;
+}
+
+static int es9033_devs_init_profile_ss(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx,
+									   const es9033_profile_t *profile)
+{
+	for (unsigned d = 0; d < num; d++)
+	{
+		// The DAC has just been enabled, so the register file holds its reset values
+		es9033_dev_shadow_reset(devs[d]);
+		devs[d]->suspend.suspended = 0;
+	}
+
+	if (es9033_profile_run(devs, num, i2c_ctx, profile, 0, es9033_profile_ss_steps(profile), 0))
+	{
+		debug_printf("ES9033: Error during configuration\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int es9033_devs_init_profile_clocked(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx,
+											const es9033_profile_t *profile)
+{
+	int first = es9033_profile_ss_steps(profile);
+	int ret = 0;
+
+	// The wait deferred by es9033_init_profile_ss(), the MCLK may only just have settled
+	if (first && profile->steps[first - 1].wait_mask)
+	{
+		ret |= es9033_devs_wait_ready(devs, num, i2c_ctx, profile->steps[first - 1].wait_mask);
+	}
+
+	ret |= es9033_profile_run(devs, num, i2c_ctx, profile, first, ES9033_PROFILE_STEPS, 1);
+
+	if (ret)
+	{
+		debug_printf("ES9033: Error during configuration\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int es9033_devs_init_profile(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx,
+									const es9033_profile_t *profile)
+{
+	int ret = 0;
+
+	ret |= es9033_devs_init_profile_ss(devs, num, i2c_ctx, profile);
+	ret |= es9033_devs_init_profile_clocked(devs, num, i2c_ctx, profile);
+
+	return ret ? -1 : 0;
+}
+
+int es9033_dev_init_profile_ss(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile_ss(&dev, 1, i2c_ctx, profile);
+}
+
+int es9033_init_profile_ss(i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_dev_init_profile_ss(&es9033_default, i2c_ctx, profile);
+}
+
+int es9033_dev_init_profile_clocked(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile_clocked(&dev, 1, i2c_ctx, profile);
+}
+
+int es9033_init_profile_clocked(i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_dev_init_profile_clocked(&es9033_default, i2c_ctx, profile);
+}
+
+int es9033_dev_init_profile(es9033_dev_t *dev, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile(&dev, 1, i2c_ctx, profile);
+}
+
+int es9033_init_profile(i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_dev_init_profile(&es9033_default, i2c_ctx, profile);
+}
+
+int es9033_init(i2c_master_t *i2c_ctx)
+{
+	return es9033_init_profile(i2c_ctx, &es9033_profile_192k);
+}
+
+int es9033_dev_set_volume(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t ch_mask, uint8_t attenuation)
+{
+	if (ch_mask & ES9033_CH1)
+	{
+		es9033_dev_reg_set(dev, ES9033_REG_VOLUME1, attenuation);
+	}
+
+	if (ch_mask & ES9033_CH2)
+	{
+		es9033_dev_reg_set(dev, ES9033_REG_VOLUME2, attenuation);
+	}
+
+	// Toggle RUN_VOLUME to apply the new volume
+	es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_RUN_VOLUME,
+						 !es9033_dev_field_get(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_RUN_VOLUME));
+
+	return es9033_dev_flush(dev, i2c_ctx);
+}
+
+int es9033_set_volume(i2c_master_t *i2c_ctx, uint8_t ch_mask, uint8_t attenuation)
+{
+	return es9033_dev_set_volume(&es9033_default, i2c_ctx, ch_mask, attenuation);
+}
+
+int es9033_dev_set_mute(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t ch_mask, int mute)
+{
+	if (ch_mask & ES9033_CH1)
+	{
+		es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_DAC_MUTE_CH1, mute != 0);
+	}
+
+	if (ch_mask & ES9033_CH2)
+	{
+		es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_DAC_MUTE_CH2, mute != 0);
+	}
+
+	return es9033_dev_flush(dev, i2c_ctx);
+}
+
+int es9033_set_mute(i2c_master_t *i2c_ctx, uint8_t ch_mask, int mute)
+{
+	return es9033_dev_set_mute(&es9033_default, i2c_ctx, ch_mask, mute);
+}
+
+int es9033_dev_set_filter(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t shape)
+{
+	es9033_dev_field_set(dev, ES9033_REG_FILTER_CONFIG, ES9033_MASK_FILTER_SHAPE, shape);
+
+	return es9033_dev_flush(dev, i2c_ctx);
+}
+
+int es9033_set_filter(i2c_master_t *i2c_ctx, uint8_t shape)
+{
+	return es9033_dev_set_filter(&es9033_default, i2c_ctx, shape);
+}
+
+void es9033_volume_init(es9033_volume_t *vol)
+{
+	memset(vol, 0, sizeof(*vol));
+}
+
+int es9033_dev_volume_ramp(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint8_t up_rate, uint8_t down_rate)
+{
+	es9033_dev_reg_set(dev, ES9033_REG_DAC_VOL_UP_RATE, up_rate);
+	es9033_dev_reg_set(dev, ES9033_REG_DAC_VOL_DOWN_RATE, down_rate);
+
+	return es9033_dev_flush(dev, i2c_ctx);
+}
+
+int es9033_volume_ramp(i2c_master_t *i2c_ctx, uint8_t up_rate, uint8_t down_rate)
+{
+	return es9033_dev_volume_ramp(&es9033_default, i2c_ctx, up_rate, down_rate);
+}
+
+void es9033_volume_set(es9033_volume_t *vol, uint8_t ch_mask, int db10)
+{
+	if (ch_mask & ES9033_CH1)
+	{
+		vol->target_db10[0] = db10;
+	}
+
+	if (ch_mask & ES9033_CH2)
+	{
+		vol->target_db10[1] = db10;
+	}
+
+	__atomic_fetch_add(&vol->requests, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&vol->seq, 1, __ATOMIC_RELEASE);
+}
+
+void es9033_volume_mute(es9033_volume_t *vol, uint8_t ch_mask, int mute)
+{
+	if (mute)
+	{
+		__atomic_fetch_or(&vol->target_mute, ch_mask, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		__atomic_fetch_and(&vol->target_mute, (uint8_t)~ch_mask, __ATOMIC_RELAXED);
+	}
+
+	__atomic_fetch_add(&vol->requests, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&vol->seq, 1, __ATOMIC_RELEASE);
+}
+
+int es9033_dev_volume_service(es9033_dev_t *dev, es9033_volume_t *vol, i2c_master_t *i2c_ctx)
+{
+	uint32_t seq = __atomic_load_n(&vol->seq, __ATOMIC_ACQUIRE);
+	uint32_t now = get_reference_time();
+	uint8_t vol1, vol2, mute;
+
+	if (seq == vol->applied_seq || (vol->writes && now - vol->last_write < ES9033_VOLUME_SLOT_US * XS1_TIMER_MHZ))
+	{
+		return 0;
+	}
+
+	// Everything posted up to seq is visible, later requests are picked up in the next slot
+	vol->applied_seq = seq;
+
+	vol1 = ES9033_VOLUME_FROM_DB10(vol->target_db10[0]);
+	vol2 = ES9033_VOLUME_FROM_DB10(vol->target_db10[1]);
+	mute = vol->target_mute;
+
+	// Toggle RUN_VOLUME only if a volume register changes, a mute change needs no volume update
+	if (vol1 != es9033_dev_reg_get(dev, ES9033_REG_VOLUME1) || vol2 != es9033_dev_reg_get(dev, ES9033_REG_VOLUME2))
+	{
+		es9033_dev_reg_set(dev, ES9033_REG_VOLUME1, vol1);
+		es9033_dev_reg_set(dev, ES9033_REG_VOLUME2, vol2);
+		es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_RUN_VOLUME,
+							 !es9033_dev_field_get(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_RUN_VOLUME));
+	}
+
+	es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_DAC_MUTE_CH1, (mute & ES9033_CH1) != 0);
+	es9033_dev_field_set(dev, ES9033_REG_MUTE_CTRL, ES9033_BIT_DAC_MUTE_CH2, (mute & ES9033_CH2) != 0);
+
+	vol->last_write = now;
+	vol->writes++;
+
+	return es9033_dev_flush(dev, i2c_ctx) ? -1 : 1;
+}
+
+int es9033_volume_service(es9033_volume_t *vol, i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_volume_service(&es9033_default, vol, i2c_ctx);
+}
+
+int es9033_volume_pending(const es9033_volume_t *vol)
+{
+	uint32_t seq = __atomic_load_n(&vol->seq, __ATOMIC_ACQUIRE);
+
+	return seq != vol->applied_seq &&
+		   (!vol->writes || get_reference_time() - vol->last_write >= ES9033_VOLUME_SLOT_US * XS1_TIMER_MHZ);
+}
+
+void es9033_monitor_init(es9033_monitor_t *mon, port_t irq_port, uint32_t irq_mask, unsigned poll_us, es9033_event_cb_t cb)
+{
+	memset(mon, 0, sizeof(*mon));
+	mon->irq_port = irq_port;
+	mon->irq_mask = irq_mask;
+	mon->poll_us = poll_us;
+	mon->cb = cb;
+}
 
 /**
- * @brief Write a register to the ES9033 DAC.
- * @param i2c_ctx Pointer to the I2C context for communication.
- * @param reg The register address to write to.
- * @param val The value to write to the register.
- * @return 0 on success, -1 on failure.
+ * @brief Clear latched interrupt sources, write 1 then 0 to the clear bits.
  **/
-static inline int es9033_reg_write(i2c_master_t *i2c_ctx, uint8_t reg, uint8_t val)
+static int es9033_irq_clear(es9033_dev_t *dev, i2c_master_t *i2c_ctx, uint16_t mask)
 {
-	i2c_regop_res_t ret;
-	uint8_t addr;
+	int ret = 0;
 
-	if (reg <= ES9033_REG_MASTER_TRIM)
+	es9033_dev_field_set(dev, ES9033_REG_INTERRUPT_CLEAR_LSB, 0xFFFF, mask);
+	ret |= es9033_dev_flush(dev, i2c_ctx);
+	es9033_dev_field_set(dev, ES9033_REG_INTERRUPT_CLEAR_LSB, 0xFFFF, 0);
+	ret |= es9033_dev_flush(dev, i2c_ctx);
+
+	return ret;
+}
+
+int es9033_dev_monitor_arm(es9033_dev_t *dev, es9033_monitor_t *mon, i2c_master_t *i2c_ctx)
+{
+	int ret = 0;
+
+	if (mon->irq_port)
 	{
-		addr = ES9033_I2C_DEVICE_ADDR;
+		port_enable(mon->irq_port);
 	}
-	else if (ES9033_REG_RESET_PLL1 <= reg && reg <= ES9033_REG_PLL8)
+
+	// MASK_P and MASK_N are adjacent and go out in one burst
+	es9033_dev_field_set(dev, ES9033_REG_INTERRUPT_MASK_P_LSB, 0xFFFF, ES9033_MONITOR_MASK_P);
+	es9033_dev_field_set(dev, ES9033_REG_INTERRUPT_MASK_N_LSB, 0xFFFF, ES9033_MONITOR_MASK_N);
+	ret |= es9033_dev_flush(dev, i2c_ctx);
+	ret |= es9033_irq_clear(dev, i2c_ctx, ES9033_MONITOR_MASK_P | ES9033_MONITOR_MASK_N);
+
+	mon->last_poll = get_reference_time();
+
+	return ret;
+}
+
+int es9033_monitor_arm(es9033_monitor_t *mon, i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_monitor_arm(&es9033_default, mon, i2c_ctx);
+}
+
+void es9033_monitor_defer(es9033_monitor_t *mon, const es9033_volume_t *vol)
+{
+	mon->vol = vol;
+}
+
+/**
+ * @brief Decode latched interrupt sources into ES9033_EVENT_x flags.
+ **/
+static unsigned es9033_irq_decode(const es9033_irq_status_t *status)
+{
+	unsigned events = 0;
+
+	if (status->source2 & ES9033_BIT_CLK_AVALID_SOURCE)
+	{
+		events |= (status->state2 & ES9033_BIT_CLK_AVALID_INT) ? ES9033_EVENT_CLK_VALID : ES9033_EVENT_CLK_LOST;
+	}
+
+	if (status->source2 & ES9033_BIT_BCK_WS_FAIL_SOURCE)
 	{
-		addr = ES9033_I2C_DEVICE_ADDR_SS;
+		events |= ES9033_EVENT_BCK_WS_FAIL;
+	}
+
+	if ((status->source2 & ES9033_BIT_PLL_LOCKED_R_SOURCE) && !(status->state2 & ES9033_BIT_PLL_LOCKED_R_INT))
+	{
+		events |= ES9033_EVENT_PLL_UNLOCK;
+	}
+
+	if (status->source & ES9033_MASK_AUTOMUTE_INTSOURCE)
+	{
+		events |= (status->state & ES9033_MASK_AUTOMUTE_INTSTATE) ? ES9033_EVENT_AUTOMUTE_ON : ES9033_EVENT_AUTOMUTE_OFF;
+	}
+
+	return events;
+}
+
+int es9033_dev_monitor_service(es9033_dev_t *dev, es9033_monitor_t *mon, i2c_master_t *i2c_ctx)
+{
+	es9033_irq_status_t status;
+	unsigned events;
+	uint32_t now;
+
+	if (mon->irq_port)
+	{
+		// Interrupt line wired: the bus stays idle until the DAC raises it
+		if (!(port_peek(mon->irq_port) & mon->irq_mask))
+		{
+			return 0;
+		}
 	}
 	else
 	{
-		debug_printf("ES9033: Reg 0x%x\n is not writable", reg);
+		now = get_reference_time();
+
+		if (now - mon->last_poll < mon->poll_us * XS1_TIMER_MHZ)
+		{
+			return 0;
+		}
+
+		// A poll holds the bus for a whole burst read, the volume change goes first
+		if (mon->vol && es9033_volume_pending(mon->vol))
+		{
+			mon->deferred++;
+			return 0;
+		}
+
+		mon->last_poll = now;
+	}
+
+	// 0xE5-0xE8 in one burst
+	if (es9033_bus_read(i2c_ctx, dev->addr, ES9033_REG_INTERRUPT_STATE, (uint8_t *)&status, sizeof(status)))
+	{
+		return -1;
+	}
+
+	if (!status.source && !status.source2)
+	{
+		return 0;
+	}
+
+	events = es9033_irq_decode(&status);
+
+	if (es9033_irq_clear(dev, i2c_ctx, ES9033_MONITOR_MASK_P | ES9033_MONITOR_MASK_N))
+	{
+		return -1;
+	}
+
+	if (events && mon->cb)
+	{
+		mon->event_count++;
+		mon->cb(events, &status);
+	}
+
+	return events;
+}
+
+int es9033_monitor_service(es9033_monitor_t *mon, i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_monitor_service(&es9033_default, mon, i2c_ctx);
+}
+
+int es9033_dev_status_read(es9033_dev_t *dev, i2c_master_t *i2c_ctx, es9033_status_t *status)
+{
+	// 0xE0-0xF2 in one burst, the reserved registers in between read as 0
+	if (es9033_bus_read(i2c_ctx, dev->addr, ES9033_REG_SYS_READ, status->regs, ES9033_STATUS_SIZE))
+	{
+		es9033_stats.errors++;
+		debug_printf("ES9033: Failed to read status\n");
 		return -1;
 	}
 
-	ret = write_reg(i2c_ctx, addr, reg, val);
+	return 0;
+}
+
+int es9033_status_read(i2c_master_t *i2c_ctx, es9033_status_t *status)
+{
+	return es9033_dev_status_read(&es9033_default, i2c_ctx, status);
+}
+
+void es9033_status_decode(const es9033_status_t *status, es9033_status_info_t *info)
+{
+	uint8_t sys = ES9033_STATUS_REG(status, ES9033_REG_SYS_READ);
+	uint8_t state2 = ES9033_STATUS_REG(status, ES9033_REG_INTERRUPT_STATE2);
+	uint8_t tuning = ES9033_STATUS_REG(status, ES9033_REG_AUTO_TUNING_READ);
+	uint8_t dac = ES9033_STATUS_REG(status, ES9033_REG_DAC_STATUS_READ);
+	uint8_t dre = ES9033_STATUS_REG(status, ES9033_REG_DRE_STATUS_READ);
+	es9033_irq_status_t irq = {
+		.state = ES9033_STATUS_REG(status, ES9033_REG_INTERRUPT_STATE),
+		.state2 = state2,
+		.source = ES9033_STATUS_REG(status, ES9033_REG_INTERRUPT_SOURCE),
+		.source2 = ES9033_STATUS_REG(status, ES9033_REG_INTERRUPT_SOURCE2),
+	};
+
+	info->chip_id = ES9033_STATUS_REG(status, ES9033_REG_CHIP_ID);
+	info->addr_pins = (sys & (ES9033_BIT_SYS_ADDR1 | ES9033_BIT_SYS_ADDR0)) >> 1;
+	info->sys_modes = (sys & ES9033_MASK_SYS_MODES) >> 3;
+	info->clk_valid = (state2 & ES9033_BIT_CLK_AVALID_INT) != 0;
+	info->pll_locked = (state2 & ES9033_BIT_PLL_LOCKED_R_INT) != 0;
+	info->bck_ws_fail = (state2 & ES9033_BIT_BCK_WS_FAIL_INT) != 0;
+	info->ratio_valid = (tuning & ES9033_BIT_RATIO_VALID) != 0;
+	info->idac_div = tuning & ES9033_MASK_IDAC_DIV_REG;
+	info->idac_div_half = (tuning & ES9033_BIT_IDAC_DIV_HALF_REG) != 0;
+	info->tdm_valid = (dre & ES9033_BIT_TDM_DATA_VALID) != 0;
+	info->dop_valid = (dre & ES9033_BIT_DOP_VALID) != 0;
+	info->gpio1 = (ES9033_STATUS_REG(status, ES9033_REG_GPIO_READ) & ES9033_BIT_GPIO1_I_READ) != 0;
 
-	if (ret != I2C_REGOP_SUCCESS)
+	// Per channel status bits come in CH1/CH2 pairs, shifted down to ES9033_CH1/ES9033_CH2
+	info->vol_min = dac & (ES9033_BIT_VOL_MIN_CH1 | ES9033_BIT_VOL_MIN_CH2);
+	info->automute = (dac & (ES9033_BIT_AUTOMUTE_CH1 | ES9033_BIT_AUTOMUTE_CH2)) >> 2;
+	info->ramping = ((dac | dac >> 2) & (ES9033_BIT_SS_RAMP_UP_CH1 | ES9033_BIT_SS_RAMP_UP_CH2)) >> 4;
+	info->dre_select = dre & (ES9033_BIT_DRE_SELECT_CH1 | ES9033_BIT_DRE_SELECT_CH2);
+
+	info->events = es9033_irq_decode(&irq);
+}
+
+int es9033_dev_dump(es9033_dev_t *dev, i2c_master_t *i2c_ctx, es9033_dump_t *dump)
+{
+	int reg = 0;
+	int ret = 0;
+
+	memset(dump->regs, 0, sizeof(dump->regs));
+
+	// One burst per run of documented registers, the reserved ones are not read
+	while (reg < ES9033_DUMP_SIZE)
+	{
+		int end = reg;
+
+		while (end < ES9033_DUMP_SIZE && es9033_shadow_index(end) >= 0)
+		{
+			end++;
+		}
+
+		if (end > reg)
+		{
+			ret |= es9033_bus_read(i2c_ctx, dev->addr, reg, &dump->regs[reg], end - reg);
+		}
+
+		reg = end + 1;
+	}
+
+	if (ret)
 	{
-		debug_printf("ES9033: Failed to write reg 0x%x val 0x%x\n", reg, val);
+		es9033_stats.errors++;
+		debug_printf("ES9033: Failed to dump registers\n");
 		return -1;
 	}
 
 	return 0;
 }
 
-int es9033_init(i2c_master_t *i2c_ctx)
+int es9033_dump(i2c_master_t *i2c_ctx, es9033_dump_t *dump)
+{
+	return es9033_dev_dump(&es9033_default, i2c_ctx, dump);
+}
+
+void es9033_dump_profile(es9033_dump_t *dump, const es9033_profile_t *profile)
+{
+	for (int reg = 0; reg < ES9033_DUMP_SIZE; reg++)
+	{
+		dump->regs[reg] = (es9033_reg_defaults[reg] & ES9033_DOC) ? es9033_reg_defaults[reg] & 0xFF : 0;
+	}
+
+	// Later steps overwrite earlier ones, e.g. the resync toggle ends at its last value
+	for (int i = 0; i < ES9033_PROFILE_STEPS; i++)
+	{
+		const es9033_step_t *step = &profile->steps[i];
+
+		if (step->addr == ES9033_I2C_DEVICE_ADDR)
+		{
+			memcpy(&dump->regs[step->reg], step->vals, step->len);
+		}
+	}
+}
+
+void es9033_dev_dump_shadow(const es9033_dev_t *dev, es9033_dump_t *dump)
+{
+	for (int reg = 0; reg < ES9033_DUMP_SIZE; reg++)
+	{
+		dump->regs[reg] = es9033_dev_reg_get(dev, reg);
+	}
+}
+
+void es9033_dump_shadow(es9033_dump_t *dump)
+{
+	es9033_dev_dump_shadow(&es9033_default, dump);
+}
+
+unsigned es9033_dump_diff(const es9033_dump_t *dump, const es9033_dump_t *expected)
+{
+	unsigned diffs = 0;
+
+	for (int reg = 0; reg < ES9033_DUMP_SIZE; reg++)
+	{
+		if (es9033_shadow_index(reg) >= 0 && dump->regs[reg] != expected->regs[reg])
+		{
+			debug_printf("ES9033: Reg 0x%x is 0x%x, expected 0x%x\n", reg, dump->regs[reg], expected->regs[reg]);
+			diffs++;
+		}
+	}
+
+	return diffs;
+}
+
+/**
+ * @brief Sample rate change of every device. Each phase runs across all devices
+ * before the next one, so the mute ramp, the MCLK change and the clock detection
+ * are waited for once.
+ **/
+static int es9033_devs_set_sample_rate(es9033_dev_t *const devs[], unsigned num, i2c_master_t *i2c_ctx,
+									   unsigned mclk_freq, unsigned fs, void (*set_mclk)(unsigned mclk_freq))
+{
+	uint8_t mute[ES9033_GROUP_MAX];
+	int ret = 0;
+
+	if (!ES9033_CLOCK_VALID(mclk_freq, fs))
+	{
+		debug_printf("ES9033: Unsupported MCLK %u for fs %u\n", mclk_freq, fs);
+		return -1;
+	}
+
+	// Soft mute, the DACs ramp down at DAC_VOL_DOWN_RATE
+	for (unsigned d = 0; d < num; d++)
+	{
+		mute[d] = es9033_dev_reg_get(devs[d], ES9033_REG_MUTE_CTRL);
+		es9033_dev_reg_set(devs[d], ES9033_REG_MUTE_CTRL, mute[d] | ES9033_BIT_DAC_MUTE_CH1 | ES9033_BIT_DAC_MUTE_CH2);
+		ret |= es9033_dev_flush(devs[d], i2c_ctx);
+	}
+	for (unsigned d = 0; d < num; d++)
+	{
+		ret |= es9033_dev_wait_status(devs[d], i2c_ctx, ES9033_REG_DAC_STATUS_READ,
+									  ES9033_BIT_VOL_MIN_CH1 | ES9033_BIT_VOL_MIN_CH2, ES9033_MUTE_TIMEOUT_US);
+	}
+
+	// Changing the clock of a DAC that did not mute would glitch the output, leave it alone
+	if (ret)
+	{
+		for (unsigned d = 0; d < num; d++)
+		{
+			es9033_dev_reg_set(devs[d], ES9033_REG_MUTE_CTRL, mute[d]);
+			es9033_dev_flush(devs[d], i2c_ctx);
+		}
+		debug_printf("ES9033: Mute failed, sample rate unchanged\n");
+		return -1;
+	}
+
+	if (set_mclk)
+	{
+		set_mclk(mclk_freq);
+	}
+
+	// Clocked registers NACK until the DAC sees the new MCLK
+	ret |= es9033_devs_wait_ready(devs, num, i2c_ctx, ES9033_BIT_CLK_AVALID_INT);
+
+	for (unsigned d = 0; d < num; d++)
+	{
+		es9033_dev_field_set(devs[d], ES9033_REG_SYSTEM_CONFIG, ES9033_BIT_ENABLE_2X_MODE, ES9033_2X_MODE(fs));
+		es9033_dev_field_set(devs[d], ES9033_REG_DAC_CLOCK_CONFIG, ES9033_MASK_SELECT_IDAC_NUM,
+							 ES9033_IDAC_NUM(mclk_freq, fs));
+		es9033_dev_field_set(devs[d], ES9033_REG_CP_CLOCK_DIV, 0xFF, ES9033_CP_CLOCK_DIV(mclk_freq));
+		ret |= es9033_dev_flush(devs[d], i2c_ctx);
+	}
+
+	// Toggle DAC clock resync to line up all the clocks in the DAC core
+	for (unsigned d = 0; d < num; d++)
+	{
+		ret |= es9033_reg_write(devs[d], i2c_ctx, ES9033_REG_RESYNC_CONFIG,
+								ES9033_BIT_SYNC_DAC_CLK_DIV);
+	}
+	for (unsigned d = 0; d < num; d++)
+	{
+		ret |= es9033_reg_write(devs[d], i2c_ctx, ES9033_REG_RESYNC_CONFIG,
+								ES9033_BIT_DOP_CLK_RESYNC |
+									ES9033_BIT_VOL_THD_RESYNC |
+									ES9033_BIT_FIR_RESYNC |
+									ES9033_BIT_FS_RESYNC);
+	}
+	for (unsigned d = 0; d < num; d++)
+	{
+		ret |= es9033_reg_write(devs[d], i2c_ctx, ES9033_REG_RESYNC_CONFIG, 0);
+	}
+
+	// Restore the previous mute state, the DACs ramp up at DAC_VOL_UP_RATE
+	for (unsigned d = 0; d < num; d++)
+	{
+		es9033_dev_reg_set(devs[d], ES9033_REG_MUTE_CTRL, mute[d]);
+		ret |= es9033_dev_flush(devs[d], i2c_ctx);
+	}
+
+	if (ret)
+	{
+		debug_printf("ES9033: Error during sample rate change\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int es9033_dev_set_sample_rate(es9033_dev_t *dev, i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs,
+							   void (*set_mclk)(unsigned mclk_freq))
+{
+	return es9033_devs_set_sample_rate(&dev, 1, i2c_ctx, mclk_freq, fs, set_mclk);
+}
+
+int es9033_set_sample_rate(i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs, void (*set_mclk)(unsigned mclk_freq))
+{
+	return es9033_dev_set_sample_rate(&es9033_default, i2c_ctx, mclk_freq, fs, set_mclk);
+}
+
+int es9033_dev_suspend(es9033_dev_t *dev, i2c_master_t *i2c_ctx)
 {
-	uint8_t ret = 0;
+	int ret = 0;
+
+	if (dev->suspend.suspended)
+	{
+		return 0;
+	}
+
+	dev->suspend.system = es9033_dev_reg_get(dev, ES9033_REG_SYSTEM_CONFIG);
+	dev->suspend.analog = es9033_dev_reg_get(dev, ES9033_REG_ANALOG_CTRL_CONFIG);
+	dev->suspend.resync = es9033_dev_reg_get(dev, ES9033_REG_RESYNC_CONFIG);
+	dev->suspend.mute = es9033_dev_reg_get(dev, ES9033_REG_MUTE_CTRL);
+
+	// Soft mute first, so the output ramps down instead of clicking
+	es9033_dev_reg_set(dev, ES9033_REG_MUTE_CTRL, dev->suspend.mute | ES9033_BIT_DAC_MUTE_CH1 | ES9033_BIT_DAC_MUTE_CH2);
+	ret |= es9033_dev_flush(dev, i2c_ctx);
+	ret |= es9033_dev_wait_status(dev, i2c_ctx, ES9033_REG_DAC_STATUS_READ, ES9033_BIT_VOL_MIN_CH1 | ES9033_BIT_VOL_MIN_CH2,
+								  ES9033_MUTE_TIMEOUT_US);
+
+	// Amplifier off, charge pump off while muted, DAC regulator in low power mode
+	es9033_dev_field_set(dev, ES9033_REG_SYSTEM_CONFIG, ES9033_BIT_AMP_MODE_REG, 0);
+	es9033_dev_field_set(dev, ES9033_REG_RESYNC_CONFIG, ES9033_BIT_CP_PDB_ON_MUTE, 1);
+	es9033_dev_field_set(dev, ES9033_REG_ANALOG_CTRL_CONFIG, ES9033_BIT_LP_DAC_REG, 1);
+	ret |= es9033_dev_flush(dev, i2c_ctx);
 
-	// Set GPIO1/MCLK to input, Invert CLKHV phase for better DNR
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_RESET_PLL1,
-							ES9033_BIT_GPIO1_SDB_SYNC |
-								ES9033_BIT_PLL_CLKHV_PHASE);
+	dev->suspend.suspended = 1;
 
-	// Bypass PLL, Disable 10k DVDD shunt to ground, Set PLL input MUX to MCLK, Enable PLL input MUX
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_PLL2,
-							ES9033_BIT_PLL_BYPASS |
-								ES9033_BIT_DVDD_SHUNTB |
-								ES9033_BIT_EN_PLL_CLKIN);
+	if (ret)
+	{
+		debug_printf("ES9033: Error during suspend\n");
+		return -1;
+	}
 
-	ret |= es9033_reg_write(i2c_ctx, 202, 0x40);
+	return 0;
+}
 
-	delay_milliseconds(1);
+int es9033_suspend(i2c_master_t *i2c_ctx)
+{
+	return es9033_dev_suspend(&es9033_default, i2c_ctx);
+}
 
-	// Set the MCLK/FS rate, 64fs, 49.152MHz/192kHz -> divide by 2
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_DAC_CLOCK_CONFIG, 0x01);
+/**
+ * @brief Rewrite the register file after a power cycle. Only registers that
+ * differ from their reset value are written: the slave bank first, as it needs
+ * no clock, then the clocked bank once the DAC sees the MCLK, a clock resync and
+ * finally the system configuration, which enables the analog section.
+ **/
+static int es9033_restore(es9033_dev_t *dev, i2c_master_t *i2c_ctx)
+{
+	uint8_t system = es9033_dev_reg_get(dev, ES9033_REG_SYSTEM_CONFIG);
+	uint8_t resync = es9033_dev_reg_get(dev, ES9033_REG_RESYNC_CONFIG);
+	int ret = 0;
 
-	// Set the PNEG charge pump clock frequency to 768kHz
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_CP_CLOCK_DIV, 7);
+	// Both are written explicitly below, a bridging burst must not write them early
+	dev->shadow.regs[ES9033_REG_SYSTEM_CONFIG] = es9033_reg_defaults[ES9033_REG_SYSTEM_CONFIG] & 0xFF;
+	dev->shadow.regs[ES9033_REG_RESYNC_CONFIG] = es9033_reg_defaults[ES9033_REG_RESYNC_CONFIG] & 0xFF;
 
-	// Enable the TDM decoder (ES9033_REG_SYS_MODE_CONFIG) -> on by default
-	// Enable TDM slave mode (ES9033_REG_INPUT_CONFIG) -> on by default
-	// Set 2 TDM slots per frame (ES9033_REG_TDM_CONFIG1) -> on by default
-	// Set to I2S format (ES9033_REG_TDM_CONFIG2) -> on by default
-	// Set TDM_CH1_LINE_SEL = 0, TDM_CH2_SLOT_SEL = 1 (ES9033_REG_TDM_SLOT_CONFIG) -> on by default
+	for (int idx = 0; idx < ES9033_SHADOW_SIZE; idx++)
+	{
+		es9033_shadow_mark(dev, idx, (es9033_reg_defaults[idx] & ES9033_DOC) &&
+										 dev->shadow.regs[idx] != (es9033_reg_defaults[idx] & 0xFF));
+	}
 
-	// Set THD compensation (ES9033_REG_THD_COMP...) -> on by default
-	// Enable automute (ES9033_REG_AUTOMUTE_TIME) -> on by default
-	// DRE force (ES9033_REG_DRE_FORCE) -> on by default
+	ret |= es9033_flush_range(dev, i2c_ctx, ES9033_SHADOW_SS_BASE, ES9033_SHADOW_SIZE);
+	ret |= es9033_dev_wait_ready(dev, i2c_ctx, ES9033_BIT_CLK_AVALID_INT, ES9033_READY_TIMEOUT_US);
+	ret |= es9033_flush_range(dev, i2c_ctx, 0, ES9033_SHADOW_SS_BASE);
 
-	// Toggle DAC clock resync to line up all the clocks in the DAC core for best analog performance
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_RESYNC_CONFIG,
-							ES9033_BIT_SYNC_DAC_CLK_DIV);
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_RESYNC_CONFIG,
-							ES9033_BIT_DOP_CLK_RESYNC |
+	// Toggle DAC clock resync to line up all the clocks in the DAC core
+	resync &= ~(ES9033_BIT_SYNC_DAC_CLK_DIV | ES9033_BIT_DOP_CLK_RESYNC | ES9033_BIT_VOL_THD_RESYNC |
+				ES9033_BIT_FIR_RESYNC | ES9033_BIT_FS_RESYNC);
+	ret |= es9033_reg_write(dev, i2c_ctx, ES9033_REG_RESYNC_CONFIG, resync | ES9033_BIT_SYNC_DAC_CLK_DIV);
+	ret |= es9033_reg_write(dev, i2c_ctx, ES9033_REG_RESYNC_CONFIG,
+							resync |
+								ES9033_BIT_DOP_CLK_RESYNC |
 								ES9033_BIT_VOL_THD_RESYNC |
 								ES9033_BIT_FIR_RESYNC |
 								ES9033_BIT_FS_RESYNC);
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_RESYNC_CONFIG, 0);
+	ret |= es9033_reg_write(dev, i2c_ctx, ES9033_REG_RESYNC_CONFIG, resync);
+
+	ret |= es9033_reg_write(dev, i2c_ctx, ES9033_REG_SYSTEM_CONFIG, system);
+
+	return ret;
+}
 
-	// Enable audio, Enable interpolation and modulator clock, Enable analog section
-	ret |= es9033_reg_write(i2c_ctx, ES9033_REG_SYSTEM_CONFIG,
-							ES9033_BIT_ENABLE_ANALOG_DAC_CH1 |
-								ES9033_BIT_ENABLE_ANALOG_DAC_CH2 |
-								ES9033_BIT_ENABLE_NSMOD |
-								ES9033_BIT_ENABLE_DAC |
-								ES9033_BIT_AMP_MODE_REG);
+int es9033_dev_resume(es9033_dev_t *dev, i2c_master_t *i2c_ctx, int power_lost)
+{
+	int suspended = dev->suspend.suspended;
+	int ret = 0;
+
+	if (!suspended && !power_lost)
+	{
+		return 0;
+	}
+
+	if (suspended)
+	{
+		es9033_dev_reg_set(dev, ES9033_REG_SYSTEM_CONFIG, dev->suspend.system);
+		es9033_dev_reg_set(dev, ES9033_REG_ANALOG_CTRL_CONFIG, dev->suspend.analog);
+		es9033_dev_reg_set(dev, ES9033_REG_RESYNC_CONFIG, dev->suspend.resync);
+	}
+
+	if (power_lost)
+	{
+		if (suspended)
+		{
+			es9033_dev_reg_set(dev, ES9033_REG_MUTE_CTRL, dev->suspend.mute);
+		}
+		ret |= es9033_restore(dev, i2c_ctx);
+	}
+	else
+	{
+		// Power up the analog section while still muted, then ramp up at DAC_VOL_UP_RATE
+		ret |= es9033_dev_flush(dev, i2c_ctx);
+		es9033_dev_reg_set(dev, ES9033_REG_MUTE_CTRL, dev->suspend.mute);
+		ret |= es9033_dev_flush(dev, i2c_ctx);
+	}
 
-	delay_microseconds(10);
+	dev->suspend.suspended = 0;
 
 	if (ret)
 	{
-		debug_printf("ES9033: Error during configuration\n");
+		debug_printf("ES9033: Error during resume\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+int es9033_resume(i2c_master_t *i2c_ctx, int power_lost)
+{
+	return es9033_dev_resume(&es9033_default, i2c_ctx, power_lost);
+}
+
+int es9033_dev_is_suspended(const es9033_dev_t *dev)
+{
+	return dev->suspend.suspended;
+}
+
+int es9033_is_suspended()
+{
+	return es9033_dev_is_suspended(&es9033_default);
+}
+
+void es9033_group_init(es9033_group_t *group)
+{
+	group->num = 0;
+}
+
+int es9033_group_add(es9033_group_t *group, es9033_dev_t *dev)
+{
+	for (unsigned d = 0; d < group->num; d++)
+	{
+		if (group->devs[d]->addr == dev->addr)
+		{
+			debug_printf("ES9033: Address 0x%x is already in the group\n", dev->addr);
+			return -1;
+		}
+	}
+
+	if (group->num == ES9033_GROUP_MAX)
+	{
 		return -1;
 	}
 
+	group->devs[group->num++] = dev;
+
 	return 0;
 }
+
+int es9033_group_init_profile_ss(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile_ss(group->devs, group->num, i2c_ctx, profile);
+}
+
+int es9033_group_init_profile_clocked(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile_clocked(group->devs, group->num, i2c_ctx, profile);
+}
+
+int es9033_group_init_profile(es9033_group_t *group, i2c_master_t *i2c_ctx, const es9033_profile_t *profile)
+{
+	return es9033_devs_init_profile(group->devs, group->num, i2c_ctx, profile);
+}
+
+int es9033_group_set_sample_rate(es9033_group_t *group, i2c_master_t *i2c_ctx, unsigned mclk_freq, unsigned fs,
+								 void (*set_mclk)(unsigned mclk_freq))
+{
+	return es9033_devs_set_sample_rate(group->devs, group->num, i2c_ctx, mclk_freq, fs, set_mclk);
+}
+
+int es9033_group_field_set(es9033_group_t *group, uint8_t reg, uint32_t mask, uint32_t val)
+{
+	int ret = 0;
+
+	for (unsigned d = 0; d < group->num; d++)
+	{
+		ret |= es9033_dev_field_set(group->devs[d], reg, mask, val);
+	}
+
+	return ret;
+}
+
+int es9033_group_flush(es9033_group_t *group, i2c_master_t *i2c_ctx)
+{
+	int ret = 0;
+
+	for (unsigned d = 0; d < group->num; d++)
+	{
+		ret |= es9033_dev_flush(group->devs[d], i2c_ctx);
+	}
+
+	return ret;
+}
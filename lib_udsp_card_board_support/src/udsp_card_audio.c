@@ -0,0 +1,196 @@
+/**
+ * @file udsp_card_audio.c
+ * @brief Double-buffered multi-line I2S/TDM output engine for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <string.h>
+
+#include <xs1.h>
+#include <xclib.h>
+#include <xcore/clock.h>
+#include <xcore/port.h>
+
+#include "udsp_card_audio.h"
+
+static const port_t udsp_card_audio_data[I2S_LINES] = {
+    UDSP_CARD_PORT_I2S_D0,
+    UDSP_CARD_PORT_I2S_D1,
+    UDSP_CARD_PORT_I2S_D2,
+    UDSP_CARD_PORT_I2S_D3,
+    UDSP_CARD_PORT_I2S_D4,
+};
+
+/** Frame played when the DSP thread has not released a block in time. */
+static const int32_t udsp_card_audio_silence[UDSP_CARD_AUDIO_MAX_CHANS];
+
+int udsp_card_audio_init(udsp_card_audio_t *audio, unsigned mclk_freq, unsigned fs, unsigned lines, unsigned slots)
+{
+    unsigned bclk_freq = fs * slots * I2S_DATA_BITS;
+    unsigned ratio;
+
+    if (lines < 1 || lines > I2S_LINES || slots < 2 || slots > UDSP_CARD_AUDIO_MAX_SLOTS || !fs ||
+        mclk_freq % bclk_freq)
+    {
+        return -1;
+    }
+
+    ratio = mclk_freq / bclk_freq;
+    if (ratio != 1 && ratio & 1)
+    {
+        return -1;
+    }
+
+    memset(audio, 0, sizeof(*audio));
+    audio->lines = lines;
+    audio->slots = slots;
+    audio->chans = lines * slots;
+    audio->bclk_div = ratio / 2;
+    audio->running = 1;
+
+    return 0;
+}
+
+int32_t *udsp_card_audio_acquire(udsp_card_audio_t *audio)
+{
+    uint32_t filled = audio->filled;
+    uint32_t played = __atomic_load_n(&audio->played, __ATOMIC_ACQUIRE);
+
+    // One block may be playing while the other is filled
+    if (filled - played >= 2)
+    {
+        return NULL;
+    }
+
+    return audio->blocks[filled & 1];
+}
+
+void udsp_card_audio_release(udsp_card_audio_t *audio)
+{
+    // Publish the block after its samples
+    __atomic_store_n(&audio->filled, audio->filled + 1, __ATOMIC_RELEASE);
+}
+
+void udsp_card_audio_stop(udsp_card_audio_t *audio)
+{
+    __atomic_store_n(&audio->running, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Frame sync word of a slot. Ports shift out LSB first.
+ **/
+static inline uint32_t udsp_card_audio_lrclk(const udsp_card_audio_t *audio, unsigned slot)
+{
+    if (audio->slots == 2)
+    {
+        // I2S: low for the left channel, high for the right channel
+        return slot ? 0xFFFFFFFF : 0;
+    }
+    // TDM: one bit clock pulse at the start of slot 0
+    return slot ? 0 : 1;
+}
+
+/**
+ * @brief Output one frame, slot by slot across all lines.
+ **/
+static inline void udsp_card_audio_frame(const udsp_card_audio_t *audio, const int32_t *frame)
+{
+    for (unsigned slot = 0; slot < audio->slots; slot++)
+    {
+        for (unsigned line = 0; line < audio->lines; line++)
+        {
+            // I2S and TDM are MSB first
+            port_out(udsp_card_audio_data[line], bitrev(frame[line * audio->slots + slot]));
+        }
+        port_out(UDSP_CARD_PORT_I2S_LRCLK, udsp_card_audio_lrclk(audio, slot));
+    }
+}
+
+/**
+ * @brief Configure the clock block and ports and queue a silent first frame.
+ * The frame sync leads the data by one bit clock.
+ **/
+static void udsp_card_audio_start(const udsp_card_audio_t *audio)
+{
+    xclock_t bclk = UDSP_CARD_CLKBLK_I2S_BCLK;
+
+    // The MCLK port is shared with the PDM front end and left enabled on stop
+    port_enable(UDSP_CARD_PORT_MCLK);
+    clock_enable(bclk);
+    clock_set_source_port(bclk, UDSP_CARD_PORT_MCLK);
+    clock_set_divide(bclk, audio->bclk_div);
+
+    port_enable(UDSP_CARD_PORT_I2S_BCLK);
+    port_set_clock(UDSP_CARD_PORT_I2S_BCLK, bclk);
+    port_set_out_clock(UDSP_CARD_PORT_I2S_BCLK);
+
+    port_start_buffered(UDSP_CARD_PORT_I2S_LRCLK, 32);
+    port_set_clock(UDSP_CARD_PORT_I2S_LRCLK, bclk);
+    port_clear_buffer(UDSP_CARD_PORT_I2S_LRCLK);
+
+    for (unsigned line = 0; line < audio->lines; line++)
+    {
+        port_start_buffered(udsp_card_audio_data[line], 32);
+        port_set_clock(udsp_card_audio_data[line], bclk);
+        port_clear_buffer(udsp_card_audio_data[line]);
+        port_out_at_time(udsp_card_audio_data[line], 2, 0);
+    }
+    port_out_at_time(UDSP_CARD_PORT_I2S_LRCLK, 1, udsp_card_audio_lrclk(audio, 0));
+
+    // Remaining slots of the first frame
+    for (unsigned slot = 1; slot < audio->slots; slot++)
+    {
+        for (unsigned line = 0; line < audio->lines; line++)
+        {
+            port_out(udsp_card_audio_data[line], 0);
+        }
+        port_out(UDSP_CARD_PORT_I2S_LRCLK, udsp_card_audio_lrclk(audio, slot));
+    }
+
+    clock_start(bclk);
+}
+
+static void udsp_card_audio_shutdown(const udsp_card_audio_t *audio)
+{
+    clock_stop(UDSP_CARD_CLKBLK_I2S_BCLK);
+
+    for (unsigned line = 0; line < audio->lines; line++)
+    {
+        port_disable(udsp_card_audio_data[line]);
+    }
+    port_disable(UDSP_CARD_PORT_I2S_LRCLK);
+    port_disable(UDSP_CARD_PORT_I2S_BCLK);
+    clock_disable(UDSP_CARD_CLKBLK_I2S_BCLK);
+}
+
+void udsp_card_audio_task(udsp_card_audio_t *audio)
+{
+    udsp_card_audio_start(audio);
+
+    while (__atomic_load_n(&audio->running, __ATOMIC_RELAXED))
+    {
+        uint32_t played = audio->played;
+        int ready = __atomic_load_n(&audio->filled, __ATOMIC_ACQUIRE) != played;
+        const int32_t *frame = ready ? audio->blocks[played & 1] : udsp_card_audio_silence;
+        unsigned stride = ready ? audio->chans : 0;
+
+        for (unsigned f = 0; f < UDSP_CARD_AUDIO_BLOCK_FRAMES; f++, frame += stride)
+        {
+            udsp_card_audio_frame(audio, frame);
+        }
+
+        if (ready)
+        {
+            // Return the block to the DSP thread once its last sample is in the ports
+            __atomic_store_n(&audio->played, played + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            audio->underruns++;
+        }
+    }
+
+    udsp_card_audio_shutdown(audio);
+}
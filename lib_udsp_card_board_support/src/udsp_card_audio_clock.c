@@ -0,0 +1,67 @@
+/**
+ * @file udsp_card_audio_clock.c
+ * @brief Audio clock time base on tile 0, counting MCLK periods with the MCLK count port.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xs1.h>
+#include <xcore/clock.h>
+#include <xcore/hwtimer.h>
+#include <xcore/port.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_audio_clock.h"
+
+/** Set once the count port runs, shared by all readers of tile 0. */
+static int udsp_card_audio_clock_started;
+
+void udsp_card_audio_clock_init(udsp_card_audio_clock_t *clk, unsigned mclk_freq, unsigned fs)
+{
+    if (!__atomic_exchange_n(&udsp_card_audio_clock_started, 1, __ATOMIC_ACQ_REL))
+    {
+        port_enable(UDSP_CARD_PORT_MCLK_IN_USB);
+        clock_enable(UDSP_CARD_CLKBLK_AUDIO_MCLK_USB);
+        clock_set_source_port(UDSP_CARD_CLKBLK_AUDIO_MCLK_USB, UDSP_CARD_PORT_MCLK_IN_USB);
+        port_enable(UDSP_CARD_PORT_MCLK_COUNT);
+        port_set_clock(UDSP_CARD_PORT_MCLK_COUNT, UDSP_CARD_CLKBLK_AUDIO_MCLK_USB);
+        clock_start(UDSP_CARD_CLKBLK_AUDIO_MCLK_USB);
+    }
+
+    *clk = (udsp_card_audio_clock_t){0};
+    clk->mclk_freq = mclk_freq;
+    clk->fs = fs;
+}
+
+uint64_t udsp_card_audio_clock_read(udsp_card_audio_clock_t *clk)
+{
+    uint32_t ref_time = get_reference_time();
+    uint16_t count;
+
+    // The timestamp of an input is the port counter, one count per MCLK period
+    (void)port_in(UDSP_CARD_PORT_MCLK_COUNT);
+    count = port_get_trigger_time(UDSP_CARD_PORT_MCLK_COUNT);
+
+    if (clk->valid)
+    {
+        // Pick the count difference closest to what the reference time predicts
+        uint64_t expected = (uint64_t)(ref_time - clk->ref_time) * clk->mclk_freq / XS1_TIMER_HZ;
+        int16_t error = (int16_t)(uint16_t)(count - clk->count - (uint32_t)expected);
+
+        clk->mclk += expected + error;
+    }
+
+    clk->ref_time = ref_time;
+    clk->count = count;
+    clk->valid = 1;
+
+    return clk->mclk;
+}
+
+uint64_t udsp_card_audio_clock_at(udsp_card_audio_clock_t *clk, uint32_t ref_time)
+{
+    uint64_t mclk = udsp_card_audio_clock_read(clk);
+
+    return mclk - (uint64_t)(clk->ref_time - ref_time) * clk->mclk_freq / XS1_TIMER_HZ;
+}
@@ -6,28 +6,221 @@
  * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
  */
 
+#include <stddef.h>
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+
 #include "udsp_card_board.h"
 #include "es9033.h"
 #include "i2c.h"
 #include "sw_pll.h"
+#include "udsp_card_init.h"
+#include "udsp_card_trace.h"
 
-int udsp_card_devices_init()
+/** DAC init profile generated from the board clock configuration. */
+static const es9033_profile_t udsp_card_dac_profile = ES9033_PROFILE(MASTER_CLOCK_FREQUENCY, AUDIO_CLOCK_FREQUENCY);
+
+/** System I2C bus, owned by the board after udsp_card_devices_init(). */
+static i2c_master_t udsp_card_i2c;
+
+/** Statistics per bus speed, the current speed and the DAC statistics already accounted. */
+static udsp_card_i2c_speed_stats_t udsp_card_i2c_speeds[UDSP_CARD_I2C_SPEEDS] = {{.kbps = 100}, {.kbps = 400}, {.kbps = 1000}};
+static unsigned udsp_card_i2c_speed;
+static es9033_i2c_stats_t udsp_card_i2c_accounted;
+
+/** Current MCLK frequency and sample rate. */
+static unsigned udsp_card_mclk_freq = MASTER_CLOCK_FREQUENCY;
+static unsigned udsp_card_fs = AUDIO_CLOCK_FREQUENCY;
+
+/** DAC power state and statistics. */
+static unsigned udsp_card_dac_state = UDSP_CARD_DAC_ON;
+static udsp_card_dac_power_stats_t udsp_card_dac_stats;
+
+/** Current value of the GPIO output port and the lock serializing its updates. */
+static unsigned udsp_card_gpio_out;
+static char udsp_card_gpio_lock;
+
+/** Bring-up steps of udsp_card_devices_init(). */
+enum
 {
-    port_t gpio_out_port = UDSP_CARD_PORT_GPIO_OUT;
-    port_t gpio_in_port = UDSP_CARD_PORT_GPIO_IN;
-    i2c_master_t i2c_ctx;
+    UDSP_CARD_STEP_PLL,
+    UDSP_CARD_STEP_I2C,
+    UDSP_CARD_STEP_GPIO,
+    UDSP_CARD_STEP_DAC_SS,
+    UDSP_CARD_STEP_DAC,
+    UDSP_CARD_STEPS,
+};
 
-    int ret = 0;
+static UDSP_CARD_INIT_FN int udsp_card_step_pll(void *arg)
+{
+    udsp_card_pll_init();
+    UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_PLL_CONFIG, 0, 0);
 
-    sw_pll_fixed_clock(MASTER_CLOCK_FREQUENCY);
-    delay_milliseconds(100);
+    return 0;
+}
+
+/**
+ * @brief Add the DAC bus statistics since the last call to the current speed.
+ **/
+static void udsp_card_i2c_account()
+{
+    udsp_card_i2c_speed_stats_t *speed = &udsp_card_i2c_speeds[udsp_card_i2c_speed];
+    es9033_i2c_stats_t now;
+
+    es9033_i2c_stats_get(&now);
+
+    // The DAC statistics may have been reset by the application
+    if (now.transactions < udsp_card_i2c_accounted.transactions)
+    {
+        udsp_card_i2c_accounted = (es9033_i2c_stats_t){0};
+    }
+
+    speed->transactions += now.transactions - udsp_card_i2c_accounted.transactions;
+    speed->errors += now.errors - udsp_card_i2c_accounted.errors;
+    speed->retries += now.retries - udsp_card_i2c_accounted.retries;
+    udsp_card_i2c_accounted = now;
+}
+
+/**
+ * @brief (Re)start the I2C master at a speed index of udsp_card_i2c_speeds.
+ **/
+static void udsp_card_i2c_start(unsigned speed, int restart)
+{
+    if (restart)
+    {
+        udsp_card_i2c_account();
+        i2c_master_shutdown(&udsp_card_i2c);
+    }
+
+    udsp_card_i2c_speed = speed;
+    i2c_master_init(&udsp_card_i2c, UDSP_CARD_PORT_SYS_SCL, 0, 0, UDSP_CARD_PORT_SYS_SDA, 0, 0,
+                    udsp_card_i2c_speeds[speed].kbps);
+}
+
+/**
+ * @brief Drop to the next lower bus speed.
+ * @return 0 on success, -1 if the bus already runs at the lowest speed.
+ **/
+static int udsp_card_i2c_fallback()
+{
+    if (udsp_card_i2c_speed == 0)
+    {
+        return -1;
+    }
+
+    udsp_card_i2c_speeds[udsp_card_i2c_speed].fallbacks++;
+    udsp_card_i2c_start(udsp_card_i2c_speed - 1, 1);
+
+    return 0;
+}
+
+/**
+ * @brief Run the handshake, falling back in speed until it passes.
+ **/
+static int udsp_card_i2c_verify()
+{
+    while (es9033_handshake(&udsp_card_i2c, NULL))
+    {
+        if (udsp_card_i2c_fallback())
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static UDSP_CARD_INIT_FN int udsp_card_step_i2c(void *arg)
+{
+    unsigned speed = 0;
 
-    i2c_master_init(&i2c_ctx, UDSP_CARD_PORT_SYS_SCL, 0, 0, UDSP_CARD_PORT_SYS_SDA, 0, 0, 100);
+    while (speed + 1 < UDSP_CARD_I2C_SPEEDS && udsp_card_i2c_speeds[speed].kbps < UDSP_CARD_I2C_KBPS)
+    {
+        speed++;
+    }
+
+    udsp_card_i2c_start(speed, 0);
+    UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_I2C_INIT, 0, udsp_card_i2c_speeds[speed].kbps);
+
+    return 0;
+}
+
+static UDSP_CARD_INIT_FN int udsp_card_step_gpio(void *arg)
+{
+    // DAC enabled, SPI enabled (active low), LED0 on
+    port_enable(UDSP_CARD_PORT_GPIO_OUT);
+    udsp_card_gpio_out = UDSP_CARD_GPIO_OUT_DAC_EN | UDSP_CARD_GPIO_OUT_LED_0;
+    port_out(UDSP_CARD_PORT_GPIO_OUT, udsp_card_gpio_out);
+    UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_GPIO_ENABLE, UDSP_CARD_GPIO_OUT_DAC_EN | UDSP_CARD_GPIO_OUT_LED_0, 0);
+
+    return 0;
+}
 
-    port_enable(gpio_out_port);
-    port_out(gpio_out_port, UDSP_CARD_GPIO_OUT_DAC_EN | UDSP_CARD_GPIO_OUT_LED_0);
+static UDSP_CARD_INIT_FN int udsp_card_step_dac_ss(void *arg)
+{
+    int ret;
 
-    ret |= es9033_init(&i2c_ctx);
+    // The slave bank is write only, a missing acknowledge is the only sign of a bus too fast
+    while ((ret = es9033_init_profile_ss(&udsp_card_i2c, &udsp_card_dac_profile)) && udsp_card_i2c_fallback() == 0)
+        ;
+
+    return ret;
+}
+
+static UDSP_CARD_INIT_FN int udsp_card_step_dac(void *arg)
+{
+    // The handshake needs the MCLK at the DAC. Without it the clocked registers NACK
+    // at every speed, so a timeout only counts against the bus if the W-only bank,
+    // which needs no clock, does not answer either.
+    for (;;)
+    {
+        if (es9033_wait_ready(&udsp_card_i2c, ES9033_BIT_CLK_AVALID_INT, ES9033_READY_TIMEOUT_US) == 0)
+        {
+            if (es9033_handshake(&udsp_card_i2c, NULL) == 0)
+            {
+                break;
+            }
+        }
+        else if (es9033_probe(&udsp_card_i2c) == 0)
+        {
+            return -1;
+        }
+
+        if (udsp_card_i2c_fallback())
+        {
+            return -1;
+        }
+    }
+
+    return es9033_init_profile_clocked(&udsp_card_i2c, &udsp_card_dac_profile);
+}
+
+/**
+ * The slave registers of the DAC need no system clock, so they are written while
+ * the application PLL locks. The clocked registers wait until the DAC reports a
+ * valid MCLK, which is the readiness condition of the PLL.
+ */
+static const udsp_card_init_step_t udsp_card_steps[UDSP_CARD_STEPS] = {
+    [UDSP_CARD_STEP_PLL] = {udsp_card_step_pll, NULL, 0},
+    [UDSP_CARD_STEP_I2C] = {udsp_card_step_i2c, NULL, 0},
+    [UDSP_CARD_STEP_GPIO] = {udsp_card_step_gpio, NULL, 0},
+    [UDSP_CARD_STEP_DAC_SS] = {udsp_card_step_dac_ss, NULL,
+                               UDSP_CARD_INIT_DEP(UDSP_CARD_STEP_I2C) | UDSP_CARD_INIT_DEP(UDSP_CARD_STEP_GPIO)},
+    [UDSP_CARD_STEP_DAC] = {udsp_card_step_dac, NULL,
+                            UDSP_CARD_INIT_DEP(UDSP_CARD_STEP_DAC_SS) | UDSP_CARD_INIT_DEP(UDSP_CARD_STEP_PLL)},
+};
+
+int udsp_card_devices_init()
+{
+    udsp_card_init_t init;
+    int ret;
+
+    UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_START, 0, 0);
+
+    ret = udsp_card_init_run(&init, udsp_card_steps, UDSP_CARD_STEPS);
+
+    UDSP_CARD_TRACE_EVENT(UDSP_CARD_TRACE_DONE, 0, ret != 0);
 
     return ret;
 }
@@ -35,4 +228,176 @@ int udsp_card_devices_init()
 void udsp_card_pll_init()
 {
     sw_pll_fixed_clock(MASTER_CLOCK_FREQUENCY);
+    udsp_card_mclk_freq = MASTER_CLOCK_FREQUENCY;
+    udsp_card_fs = AUDIO_CLOCK_FREQUENCY;
+}
+
+i2c_master_t *udsp_card_i2c_ctx()
+{
+    return &udsp_card_i2c;
+}
+
+int udsp_card_i2c_set_speed(unsigned kbps)
+{
+    // The handshake needs an answering DAC, without it every speed would fail and fall back
+    if (udsp_card_dac_state != UDSP_CARD_DAC_ON)
+    {
+        return -1;
+    }
+
+    for (unsigned speed = 0; speed < UDSP_CARD_I2C_SPEEDS; speed++)
+    {
+        if (udsp_card_i2c_speeds[speed].kbps == kbps)
+        {
+            udsp_card_i2c_start(speed, 1);
+            return udsp_card_i2c_verify();
+        }
+    }
+
+    return -1;
+}
+
+unsigned udsp_card_i2c_get_speed()
+{
+    return udsp_card_i2c_speeds[udsp_card_i2c_speed].kbps;
+}
+
+int udsp_card_i2c_recover()
+{
+    // Without power or clock the DAC cannot answer, which says nothing about the bus
+    if (udsp_card_dac_state != UDSP_CARD_DAC_ON)
+    {
+        return 0;
+    }
+
+    return udsp_card_i2c_verify();
+}
+
+void udsp_card_i2c_speed_stats_get(udsp_card_i2c_speed_stats_t stats[UDSP_CARD_I2C_SPEEDS])
+{
+    udsp_card_i2c_account();
+
+    for (unsigned speed = 0; speed < UDSP_CARD_I2C_SPEEDS; speed++)
+    {
+        stats[speed] = udsp_card_i2c_speeds[speed];
+    }
+}
+
+static void udsp_card_set_mclk(unsigned mclk_freq)
+{
+    sw_pll_fixed_clock(mclk_freq);
+    udsp_card_mclk_freq = mclk_freq;
+}
+
+int udsp_card_set_sample_rate(unsigned fs)
+{
+    unsigned mclk_freq;
+
+    // A suspended or powered down DAC cannot mute, so the clock is left alone
+    if (!fs || udsp_card_dac_state != UDSP_CARD_DAC_ON)
+    {
+        return -1;
+    }
+
+    if (fs % 11025 == 0)
+    {
+        mclk_freq = UDSP_CARD_MCLK_FREQUENCY_44K1;
+    }
+    else if (fs % 8000 == 0)
+    {
+        mclk_freq = UDSP_CARD_MCLK_FREQUENCY_48K;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (es9033_set_sample_rate(&udsp_card_i2c, mclk_freq, fs,
+                               mclk_freq != udsp_card_mclk_freq ? udsp_card_set_mclk : NULL))
+    {
+        return -1;
+    }
+
+    udsp_card_fs = fs;
+
+    return 0;
+}
+
+unsigned udsp_card_get_sample_rate()
+{
+    return udsp_card_fs;
+}
+
+void udsp_card_gpio_set(unsigned mask, unsigned value)
+{
+    // The control and GPIO service threads both update the port
+    while (__atomic_test_and_set(&udsp_card_gpio_lock, __ATOMIC_ACQUIRE))
+        ;
+    udsp_card_gpio_out = (udsp_card_gpio_out & ~mask) | (value & mask);
+    port_out(UDSP_CARD_PORT_GPIO_OUT, udsp_card_gpio_out);
+    __atomic_clear(&udsp_card_gpio_lock, __ATOMIC_RELEASE);
+}
+
+int udsp_card_dac_power(unsigned state)
+{
+    uint32_t start = get_reference_time();
+    int ret = 0;
+
+    if (state == udsp_card_dac_state)
+    {
+        return 0;
+    }
+
+    if (state > UDSP_CARD_DAC_OFF || (state == UDSP_CARD_DAC_SUSPEND && udsp_card_dac_state == UDSP_CARD_DAC_OFF))
+    {
+        return -1;
+    }
+
+    if (state == UDSP_CARD_DAC_ON)
+    {
+        int power_lost = udsp_card_dac_state == UDSP_CARD_DAC_OFF;
+        unsigned elapsed_us;
+
+        if (power_lost)
+        {
+            udsp_card_gpio_set(UDSP_CARD_GPIO_OUT_DAC_EN, UDSP_CARD_GPIO_OUT_DAC_EN);
+        }
+
+        ret = es9033_resume(&udsp_card_i2c, power_lost);
+
+        elapsed_us = (get_reference_time() - start) / XS1_TIMER_MHZ;
+        udsp_card_dac_stats.resumes++;
+        udsp_card_dac_stats.resume_us = elapsed_us;
+        if (elapsed_us > udsp_card_dac_stats.resume_max_us)
+        {
+            udsp_card_dac_stats.resume_max_us = elapsed_us;
+        }
+    }
+    else
+    {
+        if (udsp_card_dac_state == UDSP_CARD_DAC_ON)
+        {
+            ret = es9033_suspend(&udsp_card_i2c);
+            udsp_card_dac_stats.suspends++;
+        }
+
+        if (state == UDSP_CARD_DAC_OFF)
+        {
+            udsp_card_gpio_set(UDSP_CARD_GPIO_OUT_DAC_EN, 0);
+        }
+    }
+
+    udsp_card_dac_state = state;
+
+    return ret;
+}
+
+unsigned udsp_card_dac_power_get()
+{
+    return udsp_card_dac_state;
+}
+
+void udsp_card_dac_power_stats_get(udsp_card_dac_power_stats_t *stats)
+{
+    *stats = udsp_card_dac_stats;
 }
@@ -0,0 +1,111 @@
+/**
+ * @file udsp_card_clock_recovery.c
+ * @brief Adaptive clock recovery, disciplines the MCLK to an external reference with lib_sw_pll.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+
+#include "udsp_card_clock_recovery.h"
+
+int udsp_card_clock_recovery_init(udsp_card_clock_recovery_t *cr, const udsp_card_clock_recovery_lut_t *lut,
+                                  unsigned mclk_freq, unsigned ref_freq, unsigned fs)
+{
+    if (!ref_freq || mclk_freq % ref_freq)
+    {
+        return -1;
+    }
+
+    *cr = (udsp_card_clock_recovery_t){0};
+    cr->ratio = mclk_freq / ref_freq;
+    cr->lock = SW_PLL_UNLOCKED_LOW;
+    udsp_card_audio_clock_init(&cr->clock, mclk_freq, fs);
+
+    // The reference is a measured timestamp, so no expected increment is given
+    sw_pll_lut_init(&cr->pll, UDSP_CARD_CLOCK_RECOVERY_KP, UDSP_CARD_CLOCK_RECOVERY_KI, UDSP_CARD_CLOCK_RECOVERY_KII,
+                    UDSP_CARD_CLOCK_RECOVERY_LOOP_COUNT, cr->ratio, 0, lut->table, lut->entries, lut->ctl_reg,
+                    lut->div_reg, lut->nominal, lut->ppm_range);
+
+    return 0;
+}
+
+/**
+ * @brief Close a statistics window of window_events event periods ending at mclk.
+ **/
+static void udsp_card_clock_recovery_window(udsp_card_clock_recovery_t *cr, uint64_t mclk)
+{
+    int64_t expected = (int64_t)cr->window_events * cr->ratio;
+    int64_t error = (int64_t)(mclk - cr->window_mclk) - expected;
+    int locked = cr->lock == SW_PLL_LOCKED;
+
+    cr->error_ppb = (int32_t)(error * 1000000000 / expected);
+    cr->jitter = cr->period_max - cr->period_min;
+
+    cr->steps++;
+    if (locked)
+    {
+        cr->locked_steps++;
+        if (cr->jitter > cr->jitter_max)
+        {
+            cr->jitter_max = cr->jitter;
+        }
+    }
+
+    cr->window_mclk = mclk;
+    cr->window_events = 0;
+}
+
+sw_pll_lock_status_t udsp_card_clock_recovery_update(udsp_card_clock_recovery_t *cr, uint16_t ref_pt)
+{
+    uint32_t gap = get_reference_time() - cr->clock.ref_time;
+    sw_pll_lock_status_t lock;
+    uint64_t mclk;
+    int restart;
+
+    // After a pause of the reference, e.g. USB suspend, the count cannot be extended
+    if (cr->clock.valid && gap > UDSP_CARD_AUDIO_CLOCK_MAX_GAP_S * XS1_TIMER_HZ)
+    {
+        cr->clock.valid = 0;
+    }
+    restart = !cr->clock.valid;
+
+    mclk = udsp_card_audio_clock_read(&cr->clock);
+    lock = sw_pll_lut_do_control(&cr->pll, cr->clock.count, ref_pt);
+
+    cr->updates++;
+    if (restart)
+    {
+        cr->window_mclk = mclk;
+        cr->window_events = 0;
+    }
+    else
+    {
+        uint32_t period = (uint32_t)(mclk - cr->last_mclk);
+
+        if (cr->window_events == 0 || period < cr->period_min)
+        {
+            cr->period_min = period;
+        }
+        if (cr->window_events == 0 || period > cr->period_max)
+        {
+            cr->period_max = period;
+        }
+
+        if (++cr->window_events == UDSP_CARD_CLOCK_RECOVERY_LOOP_COUNT)
+        {
+            if (cr->lock == SW_PLL_LOCKED && lock != SW_PLL_LOCKED)
+            {
+                cr->unlocks++;
+            }
+            cr->lock = lock;
+            udsp_card_clock_recovery_window(cr, mclk);
+        }
+    }
+
+    cr->last_mclk = mclk;
+
+    return lock;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file udsp_card_ctrl.c
+ * @brief Asynchronous board control service for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <string.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_ctrl.h"
+#include "es9033.h"
+#include "i2c.h"
+
+#if (UDSP_CARD_CTRL_QUEUE_DEPTH & (UDSP_CARD_CTRL_QUEUE_DEPTH - 1)) != 0
+#error "UDSP_CARD_CTRL_QUEUE_DEPTH must be a power of two"
+#endif
+
+/** Volume engine applied by the control thread. */
+static es9033_volume_t udsp_card_volume;
+
+/** DAC fault and status monitor, serviced by the control thread if enabled. */
+static es9033_monitor_t udsp_card_monitor;
+
+void udsp_card_ctrl_init(udsp_card_ctrl_t *ctrl)
+{
+    memset(ctrl, 0, sizeof(*ctrl));
+}
+
+int udsp_card_ctrl_post(udsp_card_ctrl_t *ctrl, udsp_card_cmd_id_t id, uint32_t arg0, uint32_t arg1, uint32_t *seq)
+{
+    uint32_t head = ctrl->head;
+    uint32_t tail = __atomic_load_n(&ctrl->tail, __ATOMIC_ACQUIRE);
+    udsp_card_cmd_t *cmd;
+
+    if (head - tail >= UDSP_CARD_CTRL_QUEUE_DEPTH)
+    {
+        return -1;
+    }
+
+    cmd = &ctrl->cmds[head & (UDSP_CARD_CTRL_QUEUE_DEPTH - 1)];
+    cmd->id = id;
+    cmd->arg0 = arg0;
+    cmd->arg1 = arg1;
+
+    // Publish the command after its contents
+    __atomic_store_n(&ctrl->head, head + 1, __ATOMIC_RELEASE);
+
+    if (seq)
+    {
+        *seq = head + 1;
+    }
+
+    return 0;
+}
+
+int udsp_card_ctrl_done(udsp_card_ctrl_t *ctrl, uint32_t seq)
+{
+    return (int32_t)(__atomic_load_n(&ctrl->completed, __ATOMIC_ACQUIRE) - seq) >= 0;
+}
+
+/**
+ * @brief Execute a single command on the control thread.
+ * @return 0 on success, non-zero on failure.
+ */
+static int udsp_card_ctrl_exec(const udsp_card_cmd_t *cmd)
+{
+    i2c_master_t *i2c_ctx = udsp_card_i2c_ctx();
+
+    switch (cmd->id)
+    {
+    case UDSP_CARD_CMD_VOLUME:
+        es9033_volume_set(&udsp_card_volume, cmd->arg0, (int32_t)cmd->arg1);
+        return 0;
+    case UDSP_CARD_CMD_MUTE:
+        es9033_volume_mute(&udsp_card_volume, cmd->arg0, cmd->arg1);
+        return 0;
+    case UDSP_CARD_CMD_FILTER:
+        return es9033_set_filter(i2c_ctx, cmd->arg1);
+    case UDSP_CARD_CMD_RATE:
+        return udsp_card_set_sample_rate(cmd->arg1);
+    case UDSP_CARD_CMD_GPIO:
+        udsp_card_gpio_set(cmd->arg0, cmd->arg1);
+        return 0;
+    case UDSP_CARD_CMD_POWER:
+        return udsp_card_dac_power(cmd->arg1);
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Execute all commands currently in a queue.
+ * @return Number of commands executed.
+ */
+static unsigned udsp_card_ctrl_drain(udsp_card_ctrl_t *ctrl)
+{
+    uint32_t tail = ctrl->tail;
+    uint32_t head = __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE);
+    unsigned n = head - tail;
+
+    while (tail != head)
+    {
+        udsp_card_cmd_t cmd = ctrl->cmds[tail & (UDSP_CARD_CTRL_QUEUE_DEPTH - 1)];
+        es9033_i2c_stats_t before;
+        es9033_i2c_stats_t after;
+
+        // Free the slot before the slow bus access
+        tail++;
+        __atomic_store_n(&ctrl->tail, tail, __ATOMIC_RELEASE);
+
+        es9033_i2c_stats_get(&before);
+        if (udsp_card_ctrl_exec(&cmd))
+        {
+            ctrl->errors++;
+
+            // A bus too fast for the wiring fails intermittently, slow it down before the next command.
+            // A rejected argument, e.g. an unsupported sample rate, never reached the bus.
+            es9033_i2c_stats_get(&after);
+            if (after.errors != before.errors)
+            {
+                udsp_card_i2c_recover();
+            }
+        }
+
+        __atomic_store_n(&ctrl->completed, tail, __ATOMIC_RELEASE);
+    }
+
+    return n;
+}
+
+void udsp_card_ctrl_volume(uint8_t ch_mask, int db10)
+{
+    es9033_volume_set(&udsp_card_volume, ch_mask, db10);
+}
+
+void udsp_card_ctrl_mute(uint8_t ch_mask, int mute)
+{
+    es9033_volume_mute(&udsp_card_volume, ch_mask, mute);
+}
+
+void udsp_card_ctrl_monitor(es9033_event_cb_t cb)
+{
+    es9033_monitor_init(&udsp_card_monitor, 0, 0, UDSP_CARD_CTRL_MONITOR_POLL_US, cb);
+    es9033_monitor_defer(&udsp_card_monitor, &udsp_card_volume);
+}
+
+void udsp_card_ctrl_task(udsp_card_ctrl_t *ctrl[], unsigned num_queues)
+{
+    i2c_master_t *i2c_ctx = udsp_card_i2c_ctx();
+
+    if (udsp_card_monitor.cb)
+    {
+        es9033_monitor_arm(&udsp_card_monitor, i2c_ctx);
+    }
+
+    while (1)
+    {
+        unsigned n = 0;
+
+        for (unsigned i = 0; i < num_queues; i++)
+        {
+            n += udsp_card_ctrl_drain(ctrl[i]);
+        }
+
+        // A suspended DAC keeps pending volume and mute requests until it resumes
+        if (udsp_card_dac_power_get() == UDSP_CARD_DAC_ON)
+        {
+            // Volume and mute requests are coalesced into the latest value per slot
+            n += es9033_volume_service(&udsp_card_volume, i2c_ctx) != 0;
+
+            if (udsp_card_monitor.cb)
+            {
+                es9033_monitor_service(&udsp_card_monitor, i2c_ctx);
+            }
+        }
+
+        // Sleep on a timer rather than spinning, a busy thread takes issue slots from the DSP threads
+        if (n == 0)
+        {
+            delay_microseconds(UDSP_CARD_CTRL_IDLE_US);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+/**
+ * @file udsp_card_extmem.c
+ * @brief Arena and pool allocation over the uDSP-Card LPDDR, with SRAM staged streams.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <string.h>
+
+#include "udsp_card_extmem.h"
+
+#if UDSP_CARD_EXTMEM_STAGE_BYTES % UDSP_CARD_EXTMEM_ALIGN != 0
+#error "UDSP_CARD_EXTMEM_STAGE_BYTES must be a multiple of UDSP_CARD_EXTMEM_ALIGN"
+#endif
+
+#if UDSP_CARD_EXTMEM_TILE0_SIZE % UDSP_CARD_EXTMEM_ALIGN != 0 || UDSP_CARD_EXTMEM_TILE0_SIZE > UDSP_CARD_EXTMEM_SIZE
+#error "UDSP_CARD_EXTMEM_TILE0_SIZE must be a multiple of UDSP_CARD_EXTMEM_ALIGN within UDSP_CARD_EXTMEM_SIZE"
+#endif
+
+#if UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS % 32 != 0
+#error "UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS must be a multiple of 32"
+#endif
+
+#define UDSP_CARD_EXTMEM_ROUND_UP(x) (((x) + UDSP_CARD_EXTMEM_ALIGN - 1) & ~(size_t)(UDSP_CARD_EXTMEM_ALIGN - 1))
+
+int udsp_card_extmem_arena_init(udsp_card_extmem_arena_t *arena, void *base, size_t size)
+{
+    // The window is mapped on both tiles, there is no default region that is safe to hand out
+    if (!base || !size)
+    {
+        base = NULL;
+        size = 0;
+    }
+
+    arena->base = base;
+    arena->size = size;
+    arena->used = 0;
+
+    return base ? 0 : -1;
+}
+
+void *udsp_card_extmem_alloc(udsp_card_extmem_arena_t *arena, size_t size)
+{
+    // Align the absolute address, the region itself may start unaligned
+    size_t start = UDSP_CARD_EXTMEM_ROUND_UP((uintptr_t)arena->base + arena->used) - (uintptr_t)arena->base;
+
+    if (!size || start > arena->size || size > arena->size - start)
+    {
+        return NULL;
+    }
+
+    arena->used = start + size;
+
+    return arena->base + start;
+}
+
+void udsp_card_extmem_arena_reset(udsp_card_extmem_arena_t *arena)
+{
+    arena->used = 0;
+}
+
+int udsp_card_extmem_pool_init(udsp_card_extmem_pool_t *pool, udsp_card_extmem_arena_t *arena, size_t block_size,
+                               unsigned count)
+{
+    if (!block_size || !count || count > UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS)
+    {
+        return -1;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->block_size = UDSP_CARD_EXTMEM_ROUND_UP(block_size);
+    pool->blocks = udsp_card_extmem_alloc(arena, pool->block_size * count);
+    if (!pool->blocks)
+    {
+        return -1;
+    }
+
+    pool->count = count;
+    pool->available = count;
+    for (unsigned i = 0; i < count; i++)
+    {
+        pool->free_map[i / 32] |= 1u << (i % 32);
+    }
+
+    return 0;
+}
+
+void *udsp_card_extmem_pool_get(udsp_card_extmem_pool_t *pool)
+{
+    if (!pool->available)
+    {
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < UDSP_CARD_EXTMEM_POOL_MAX_BLOCKS / 32; i++)
+    {
+        if (pool->free_map[i])
+        {
+            unsigned bit = __builtin_ctz(pool->free_map[i]);
+
+            pool->free_map[i] &= ~(1u << bit);
+            pool->available--;
+
+            return pool->blocks + (32 * i + bit) * pool->block_size;
+        }
+    }
+
+    return NULL;
+}
+
+int udsp_card_extmem_pool_put(udsp_card_extmem_pool_t *pool, void *block)
+{
+    size_t offset = (uint8_t *)block - pool->blocks;
+    unsigned idx = offset / pool->block_size;
+
+    if ((uint8_t *)block < pool->blocks || offset % pool->block_size || idx >= pool->count ||
+        (pool->free_map[idx / 32] >> (idx % 32)) & 1)
+    {
+        return -1;
+    }
+
+    pool->free_map[idx / 32] |= 1u << (idx % 32);
+    pool->available++;
+
+    return 0;
+}
+
+int udsp_card_extmem_stream_init(udsp_card_extmem_stream_t *stream, void *ext, size_t len, size_t pos)
+{
+    if (!ext || !len || len % UDSP_CARD_EXTMEM_STAGE_BYTES || pos >= len || pos % UDSP_CARD_EXTMEM_STAGE_BYTES)
+    {
+        return -1;
+    }
+
+    stream->ext = ext;
+    stream->len = len;
+    stream->pos = pos;
+    stream->fill = 0;
+    stream->offset = 0;
+    stream->bursts = 0;
+
+    return 0;
+}
+
+void udsp_card_extmem_read(udsp_card_extmem_stream_t *stream, void *dst, size_t n)
+{
+    uint8_t *out = dst;
+
+    while (n)
+    {
+        unsigned chunk;
+
+        if (stream->offset == stream->fill)
+        {
+            // Stage exhausted, fetch the next burst
+            stream->pos = (stream->pos + stream->fill) % stream->len;
+            memcpy(stream->stage, stream->ext + stream->pos, UDSP_CARD_EXTMEM_STAGE_BYTES);
+            stream->fill = UDSP_CARD_EXTMEM_STAGE_BYTES;
+            stream->offset = 0;
+            stream->bursts++;
+        }
+
+        chunk = stream->fill - stream->offset < n ? stream->fill - stream->offset : n;
+        memcpy(out, stream->stage + stream->offset, chunk);
+        stream->offset += chunk;
+        out += chunk;
+        n -= chunk;
+    }
+}
+
+void udsp_card_extmem_write(udsp_card_extmem_stream_t *stream, const void *src, size_t n)
+{
+    const uint8_t *in = src;
+
+    while (n)
+    {
+        unsigned chunk = UDSP_CARD_EXTMEM_STAGE_BYTES - stream->fill < n ? UDSP_CARD_EXTMEM_STAGE_BYTES - stream->fill : n;
+
+        memcpy(stream->stage + stream->fill, in, chunk);
+        stream->fill += chunk;
+        in += chunk;
+        n -= chunk;
+
+        if (stream->fill == UDSP_CARD_EXTMEM_STAGE_BYTES)
+        {
+            memcpy(stream->ext + stream->pos, stream->stage, UDSP_CARD_EXTMEM_STAGE_BYTES);
+            stream->pos = (stream->pos + UDSP_CARD_EXTMEM_STAGE_BYTES) % stream->len;
+            stream->fill = 0;
+            stream->bursts++;
+        }
+    }
+}
+
+void udsp_card_extmem_flush(udsp_card_extmem_stream_t *stream)
+{
+    // Pending bytes stay staged and are written again with the full burst
+    if (stream->fill)
+    {
+        memcpy(stream->ext + stream->pos, stream->stage, stream->fill);
+        stream->bursts++;
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * @file udsp_card_flash.c
+ * @brief Read-only data store in the QSPI boot flash, accessed in place through
+ * the software memory window.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <stddef.h>
+
+#include <xs1.h>
+#include <xcore/port.h>
+#include <xcore/swmem_fill.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_flash.h"
+
+#define UDSP_CARD_FLASH_CMD_QUAD_READ 0xEB // Fast Read Quad I/O, address and mode byte on 4 lines
+#define UDSP_CARD_FLASH_DUMMY_CLOCKS 4     // Dummy clocks after the mode byte
+#define UDSP_CARD_FLASH_CRC_POLY 0xEDB88320
+
+/**
+ * @brief One SCLK pulse. The flash samples on the rising and drives on the falling edge.
+ **/
+static inline void udsp_card_flash_clock()
+{
+    port_out(UDSP_CARD_PORT_SQI_SCLK, 1);
+    port_out(UDSP_CARD_PORT_SQI_SCLK, 0);
+}
+
+/**
+ * @brief Read from the flash with a software clocked quad read. The boot ROM has
+ * already set the quad enable bit of the flash.
+ **/
+static void udsp_card_flash_read(uint32_t addr, uint8_t *dst, unsigned len)
+{
+    uint32_t addr_mode = addr << 8; // Mode byte 0x00, no continuous read
+
+    port_out(UDSP_CARD_PORT_SQI_CS, 0);
+
+    // Command on IO0, /WP and /HOLD held high
+    for (int bit = 7; bit >= 0; bit--)
+    {
+        port_out(UDSP_CARD_PORT_SQI_SIO, 0xC | ((UDSP_CARD_FLASH_CMD_QUAD_READ >> bit) & 1));
+        udsp_card_flash_clock();
+    }
+
+    for (int nibble = 7; nibble >= 0; nibble--)
+    {
+        port_out(UDSP_CARD_PORT_SQI_SIO, (addr_mode >> (4 * nibble)) & 0xF);
+        udsp_card_flash_clock();
+    }
+
+    // Turn the data lines around
+    (void)port_in(UDSP_CARD_PORT_SQI_SIO);
+    for (unsigned i = 0; i < UDSP_CARD_FLASH_DUMMY_CLOCKS; i++)
+    {
+        udsp_card_flash_clock();
+    }
+
+    for (unsigned i = 0; i < len; i++)
+    {
+        uint8_t hi;
+
+        hi = port_in(UDSP_CARD_PORT_SQI_SIO) & 0xF;
+        udsp_card_flash_clock();
+        dst[i] = hi << 4 | (port_in(UDSP_CARD_PORT_SQI_SIO) & 0xF);
+        udsp_card_flash_clock();
+    }
+
+    port_out(UDSP_CARD_PORT_SQI_CS, 1);
+}
+
+void udsp_card_flash_swmem_task()
+{
+    swmem_fill_t fill = swmem_fill_get();
+    swmem_fill_buffer_t line; // One fill is exactly one cache line
+
+    port_enable(UDSP_CARD_PORT_SQI_CS);
+    port_out(UDSP_CARD_PORT_SQI_CS, 1);
+    port_enable(UDSP_CARD_PORT_SQI_SCLK);
+    port_out(UDSP_CARD_PORT_SQI_SCLK, 0);
+    port_enable(UDSP_CARD_PORT_SQI_SIO);
+
+    for (;;)
+    {
+        fill_slot_t slot = swmem_fill_in_address(fill);
+
+        udsp_card_flash_read(UDSP_CARD_FLASH_DATA_OFFSET + ((uintptr_t)slot - UDSP_CARD_FLASH_WINDOW),
+                             (uint8_t *)line, sizeof(line));
+        swmem_fill_populate_from_buffer(fill, slot, line);
+    }
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3) of len bytes, len a multiple of 4.
+ **/
+static uint32_t udsp_card_flash_crc(const void *data, uint32_t len)
+{
+    const uint32_t *words = data;
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint32_t i = 0; i < len / sizeof(uint32_t); i++)
+    {
+        crc ^= words[i];
+        for (unsigned bit = 0; bit < 32; bit++)
+        {
+            crc = crc >> 1 ^ (crc & 1 ? UDSP_CARD_FLASH_CRC_POLY : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+int udsp_card_flash_open(udsp_card_flash_t *store, const void *base)
+{
+    const udsp_card_flash_header_t *header = base ? base : (const void *)UDSP_CARD_FLASH_WINDOW;
+    uint32_t dir_end = sizeof(*header) + header->count * sizeof(udsp_card_flash_entry_t);
+
+    if (header->magic != UDSP_CARD_FLASH_MAGIC || header->format != UDSP_CARD_FLASH_FORMAT ||
+        header->size < dir_end)
+    {
+        return -1;
+    }
+
+    store->base = (const uint8_t *)header;
+    store->header = header;
+    store->entries = (const udsp_card_flash_entry_t *)(header + 1);
+
+    if (udsp_card_flash_crc(store->entries, dir_end - sizeof(*header)) != header->dir_crc)
+    {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < header->count; i++)
+    {
+        const udsp_card_flash_entry_t *entry = &store->entries[i];
+
+        if (entry->offset < dir_end || entry->offset % sizeof(uint32_t) ||
+            (uint64_t)entry->offset + ((entry->length + 3ull) & ~3ull) > header->size)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+const void *udsp_card_flash_find(const udsp_card_flash_t *store, udsp_card_flash_type_t type, unsigned id,
+                                 uint32_t *len)
+{
+    for (unsigned i = 0; i < store->header->count; i++)
+    {
+        const udsp_card_flash_entry_t *entry = &store->entries[i];
+
+        if (entry->type == type && entry->id == id)
+        {
+            if (len)
+            {
+                *len = entry->length;
+            }
+            return store->base + entry->offset;
+        }
+    }
+
+    return NULL;
+}
+
+const int32_t *udsp_card_flash_coeffs(const udsp_card_flash_t *store, unsigned id, unsigned *count)
+{
+    uint32_t len;
+    const int32_t *coeffs = udsp_card_flash_find(store, UDSP_CARD_FLASH_COEFFS, id, &len);
+
+    *count = coeffs ? len / sizeof(int32_t) : 0;
+
+    return coeffs;
+}
+
+const es9033_profile_t *udsp_card_flash_dac_profile(const udsp_card_flash_t *store, unsigned id)
+{
+    uint32_t len;
+    const es9033_profile_t *profile = udsp_card_flash_find(store, UDSP_CARD_FLASH_DAC_PROFILE, id, &len);
+
+    return profile && len == sizeof(*profile) ? profile : NULL;
+}
+
+int udsp_card_flash_verify(const udsp_card_flash_t *store)
+{
+    for (unsigned i = 0; i < store->header->count; i++)
+    {
+        const udsp_card_flash_entry_t *entry = &store->entries[i];
+
+        if (udsp_card_flash_crc(store->base + entry->offset, (entry->length + 3) & ~3u) != entry->crc)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
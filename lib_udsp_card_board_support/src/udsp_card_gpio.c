@@ -0,0 +1,266 @@
+/**
+ * @file udsp_card_gpio.c
+ * @brief Event-driven GPIO service for the uDSP-Card: debounced buttons, timestamped
+ * IMU interrupts and LED dimming.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <stddef.h>
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+#include <xcore/port.h>
+#include <xcore/select.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_gpio.h"
+
+#define UDSP_CARD_GPIO_BUTTONS (UDSP_CARD_GPIO_IN_BUTTON_0 | UDSP_CARD_GPIO_IN_BUTTON_1)
+#define UDSP_CARD_GPIO_IRQS (UDSP_CARD_GPIO_IN_IMU_IRQ_1 | UDSP_CARD_GPIO_IN_IMU_IRQ_2)
+#define UDSP_CARD_GPIO_PWM_PERIOD (XS1_TIMER_HZ / UDSP_CARD_GPIO_PWM_HZ)
+#define UDSP_CARD_GPIO_DEBOUNCE_TICKS (UDSP_CARD_GPIO_DEBOUNCE_US * XS1_TIMER_MHZ)
+
+static const unsigned udsp_card_gpio_led_pin[UDSP_CARD_GPIO_LEDS] = {UDSP_CARD_GPIO_OUT_LED_0,
+                                                                     UDSP_CARD_GPIO_OUT_LED_1};
+
+/**
+ * PWM state of the GPIO thread.
+ */
+typedef struct
+{
+    uint32_t period_start;                // Reference time the current period started
+    uint32_t off_at[UDSP_CARD_GPIO_LEDS]; // Reference time a dimmed LED switches off
+    unsigned off_pending;                 // Bit set for every LED still to switch off in this period
+    uint8_t applied[UDSP_CARD_GPIO_LEDS]; // Brightness applied at the start of the period
+} udsp_card_gpio_pwm_t;
+
+static inline int udsp_card_gpio_due(uint32_t now, uint32_t time)
+{
+    return (int32_t)(now - time) >= 0;
+}
+
+static inline uint32_t udsp_card_gpio_pressed(uint32_t pins)
+{
+    return (UDSP_CARD_GPIO_BUTTON_ACTIVE_LOW ? ~pins : pins) & UDSP_CARD_GPIO_BUTTONS;
+}
+
+void udsp_card_gpio_init(udsp_card_gpio_t *gpio, udsp_card_gpio_button_cb_t button_cb, udsp_card_gpio_irq_cb_t irq_cb)
+{
+    *gpio = (udsp_card_gpio_t){0};
+    gpio->button_cb = button_cb;
+    gpio->irq_cb = irq_cb;
+
+    // LED 0 is switched on by udsp_card_devices_init()
+    gpio->brightness[0] = UDSP_CARD_GPIO_BRIGHTNESS_MAX;
+    gpio->running = 1;
+}
+
+void udsp_card_gpio_led(udsp_card_gpio_t *gpio, unsigned led, unsigned brightness)
+{
+    if (led < UDSP_CARD_GPIO_LEDS)
+    {
+        brightness = brightness < UDSP_CARD_GPIO_BRIGHTNESS_MAX ? brightness : UDSP_CARD_GPIO_BRIGHTNESS_MAX;
+        __atomic_store_n(&gpio->brightness[led], brightness, __ATOMIC_RELAXED);
+    }
+}
+
+void udsp_card_gpio_stop(udsp_card_gpio_t *gpio)
+{
+    __atomic_store_n(&gpio->running, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Start a PWM period: switch dimmed LEDs on and schedule their off edge.
+ * Steady LEDs are only written when their brightness changed, so GPIO commands
+ * of the control thread are not overridden.
+ **/
+static void udsp_card_gpio_pwm_period(udsp_card_gpio_t *gpio, udsp_card_gpio_pwm_t *pwm)
+{
+    unsigned mask = 0;
+    unsigned value = 0;
+
+    pwm->off_pending = 0;
+
+    for (unsigned led = 0; led < UDSP_CARD_GPIO_LEDS; led++)
+    {
+        unsigned brightness = __atomic_load_n(&gpio->brightness[led], __ATOMIC_RELAXED);
+        unsigned pin = udsp_card_gpio_led_pin[led];
+
+        if (brightness > 0 && brightness < UDSP_CARD_GPIO_BRIGHTNESS_MAX)
+        {
+            mask |= pin;
+            value |= pin;
+            pwm->off_at[led] = pwm->period_start +
+                               brightness * (UDSP_CARD_GPIO_PWM_PERIOD / (UDSP_CARD_GPIO_BRIGHTNESS_MAX + 1));
+            pwm->off_pending |= 1 << led;
+        }
+        else if (brightness != pwm->applied[led])
+        {
+            mask |= pin;
+            value |= brightness ? pin : 0;
+        }
+
+        pwm->applied[led] = brightness;
+    }
+
+    if (mask)
+    {
+        udsp_card_gpio_set(mask, value);
+    }
+}
+
+/**
+ * @brief Switch off dimmed LEDs whose off edge is due and start the next period if due.
+ **/
+static void udsp_card_gpio_pwm_service(udsp_card_gpio_t *gpio, udsp_card_gpio_pwm_t *pwm, uint32_t now)
+{
+    unsigned off = 0;
+
+    for (unsigned led = 0; led < UDSP_CARD_GPIO_LEDS; led++)
+    {
+        if (pwm->off_pending & (1 << led) && udsp_card_gpio_due(now, pwm->off_at[led]))
+        {
+            off |= udsp_card_gpio_led_pin[led];
+            pwm->off_pending &= ~(1 << led);
+        }
+    }
+
+    if (off)
+    {
+        udsp_card_gpio_set(off, 0);
+    }
+
+    if (udsp_card_gpio_due(now, pwm->period_start + UDSP_CARD_GPIO_PWM_PERIOD))
+    {
+        pwm->period_start += UDSP_CARD_GPIO_PWM_PERIOD;
+
+        // Resynchronise after callbacks held the thread for more than a period
+        if (udsp_card_gpio_due(now, pwm->period_start + UDSP_CARD_GPIO_PWM_PERIOD))
+        {
+            pwm->period_start = now;
+        }
+        udsp_card_gpio_pwm_period(gpio, pwm);
+    }
+}
+
+/**
+ * @brief Earliest of the next period, pending LED off edges and the debounce deadline.
+ **/
+static uint32_t udsp_card_gpio_next(const udsp_card_gpio_pwm_t *pwm, int debouncing, uint32_t debounce_at,
+                                    uint32_t now)
+{
+    uint32_t next = pwm->period_start + UDSP_CARD_GPIO_PWM_PERIOD;
+
+    for (unsigned led = 0; led < UDSP_CARD_GPIO_LEDS; led++)
+    {
+        if (pwm->off_pending & (1 << led) && (int32_t)(pwm->off_at[led] - now) < (int32_t)(next - now))
+        {
+            next = pwm->off_at[led];
+        }
+    }
+
+    if (debouncing && (int32_t)(debounce_at - now) < (int32_t)(next - now))
+    {
+        next = debounce_at;
+    }
+
+    return next;
+}
+
+void udsp_card_gpio_task(udsp_card_gpio_t *gpio)
+{
+    hwtimer_t timer = hwtimer_alloc();
+    udsp_card_gpio_pwm_t pwm = {0};
+    uint32_t edge_time = 0;
+    int debouncing = 0;
+
+    port_enable(UDSP_CARD_PORT_GPIO_IN);
+    gpio->pins = port_in(UDSP_CARD_PORT_GPIO_IN);
+    gpio->buttons = udsp_card_gpio_pressed(gpio->pins);
+    port_set_trigger_in_not_equal(UDSP_CARD_PORT_GPIO_IN, gpio->pins);
+
+    // Leave the LEDs as they are until their brightness is changed
+    pwm.period_start = hwtimer_get_time(timer);
+    for (unsigned led = 0; led < UDSP_CARD_GPIO_LEDS; led++)
+    {
+        pwm.applied[led] = __atomic_load_n(&gpio->brightness[led], __ATOMIC_RELAXED);
+    }
+    udsp_card_gpio_pwm_period(gpio, &pwm);
+    hwtimer_set_trigger_time(timer, udsp_card_gpio_next(&pwm, 0, 0, pwm.period_start));
+
+    SELECT_RES(CASE_THEN(UDSP_CARD_PORT_GPIO_IN, on_pins), CASE_THEN(timer, on_timer))
+    {
+    on_pins:
+    {
+        uint32_t now = get_reference_time();
+        uint32_t pins = port_in(UDSP_CARD_PORT_GPIO_IN);
+        uint32_t rising = pins & ~gpio->pins & UDSP_CARD_GPIO_IRQS;
+
+        port_set_trigger_in_not_equal(UDSP_CARD_PORT_GPIO_IN, pins);
+
+        // Every bounce restarts the debounce time
+        if ((pins ^ gpio->pins) & UDSP_CARD_GPIO_BUTTONS)
+        {
+            edge_time = now;
+            debouncing = 1;
+        }
+        gpio->pins = pins;
+
+        if (rising)
+        {
+            gpio->irq_count++;
+            if (gpio->irq_cb)
+            {
+                gpio->irq_cb(rising, now);
+            }
+        }
+
+        hwtimer_set_trigger_time(timer, udsp_card_gpio_next(&pwm, debouncing, edge_time + UDSP_CARD_GPIO_DEBOUNCE_TICKS,
+                                                            now));
+        continue;
+    }
+    on_timer:
+    {
+        uint32_t now = hwtimer_get_time(timer);
+
+        if (debouncing && udsp_card_gpio_due(now, edge_time + UDSP_CARD_GPIO_DEBOUNCE_TICKS))
+        {
+            uint32_t pressed = udsp_card_gpio_pressed(gpio->pins);
+            uint32_t changed = pressed ^ gpio->buttons;
+
+            debouncing = 0;
+            gpio->buttons = pressed;
+
+            for (uint32_t button = UDSP_CARD_GPIO_IN_BUTTON_0; button <= UDSP_CARD_GPIO_IN_BUTTON_1; button <<= 1)
+            {
+                if (!(changed & button))
+                {
+                    continue;
+                }
+                gpio->press_count += (pressed & button) != 0;
+                if (gpio->button_cb)
+                {
+                    gpio->button_cb(button, (pressed & button) != 0, edge_time);
+                }
+            }
+        }
+
+        udsp_card_gpio_pwm_service(gpio, &pwm, now);
+
+        if (!__atomic_load_n(&gpio->running, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+
+        hwtimer_set_trigger_time(timer, udsp_card_gpio_next(&pwm, debouncing, edge_time + UDSP_CARD_GPIO_DEBOUNCE_TICKS,
+                                                            now));
+        continue;
+    }
+    }
+
+    port_clear_trigger_in(UDSP_CARD_PORT_GPIO_IN);
+    port_disable(UDSP_CARD_PORT_GPIO_IN);
+    hwtimer_free(timer);
+}
@@ -0,0 +1,187 @@
+/**
+ * @file udsp_card_imu.c
+ * @brief Interrupt driven SPI IMU driver with FIFO burst reads and audio clock timestamps.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+#include <xcore/port.h>
+#include <xcore/select.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_imu.h"
+
+#define UDSP_CARD_IMU_CS_IDLE 0xF // All chip selects released
+
+/**
+ * @brief Shift one byte in SPI mode 0. The sensor drives MISO on the falling
+ * edge and samples MOSI on the rising edge.
+ **/
+static inline uint8_t udsp_card_imu_spi_byte(uint8_t out)
+{
+    uint8_t in = 0;
+
+    for (int bit = 7; bit >= 0; bit--)
+    {
+        port_out(UDSP_CARD_PORT_SPI_MOSI, (out >> bit) & 1);
+        port_out(UDSP_CARD_PORT_SPI_CLK, 1);
+        in = in << 1 | (port_in(UDSP_CARD_PORT_SPI_MISO) & 1);
+        port_out(UDSP_CARD_PORT_SPI_CLK, 0);
+    }
+
+    return in;
+}
+
+static inline void udsp_card_imu_select(int select)
+{
+    port_out(UDSP_CARD_PORT_SPI_CS, select ? UDSP_CARD_IMU_CS_IDLE & ~UDSP_CARD_IMU_CS : UDSP_CARD_IMU_CS_IDLE);
+}
+
+void udsp_card_imu_write(uint8_t reg, uint8_t val)
+{
+    udsp_card_imu_select(1);
+    udsp_card_imu_spi_byte(reg);
+    udsp_card_imu_spi_byte(val);
+    udsp_card_imu_select(0);
+}
+
+void udsp_card_imu_read(uint8_t reg, uint8_t *buf, unsigned len)
+{
+    udsp_card_imu_select(1);
+    udsp_card_imu_spi_byte(reg | UDSP_CARD_IMU_SPI_READ);
+    for (unsigned i = 0; i < len; i++)
+    {
+        buf[i] = udsp_card_imu_spi_byte(0);
+    }
+    udsp_card_imu_select(0);
+}
+
+void udsp_card_imu_init(udsp_card_imu_t *imu, udsp_card_imu_cb_t cb, unsigned mclk_freq, unsigned fs)
+{
+    imu->cb = cb;
+    imu->irq = s_chan_alloc();
+    imu->pending = 0;
+    imu->running = 1;
+    imu->irqs = 0;
+    imu->coalesced = 0;
+    imu->records = 0;
+    imu->truncated = 0;
+    udsp_card_audio_clock_init(&imu->clock, mclk_freq, fs);
+
+    port_enable(UDSP_CARD_PORT_SPI_CS);
+    port_out(UDSP_CARD_PORT_SPI_CS, UDSP_CARD_IMU_CS_IDLE);
+    port_enable(UDSP_CARD_PORT_SPI_CLK);
+    port_out(UDSP_CARD_PORT_SPI_CLK, 0);
+    port_enable(UDSP_CARD_PORT_SPI_MOSI);
+    port_enable(UDSP_CARD_PORT_SPI_MISO);
+
+    udsp_card_gpio_set(UDSP_CARD_GPIO_OUT_SPI_EN_N, 0);
+}
+
+void udsp_card_imu_irq(udsp_card_imu_t *imu, uint32_t ref_time)
+{
+    // At most one word is in flight, so the streaming channel never blocks
+    if (__atomic_exchange_n(&imu->pending, 1, __ATOMIC_ACQ_REL))
+    {
+        imu->coalesced++;
+        return;
+    }
+
+    s_chan_out_word(imu->irq.end_a, ref_time);
+}
+
+void udsp_card_imu_stop(udsp_card_imu_t *imu)
+{
+    __atomic_store_n(&imu->running, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Read the FIFO count and all complete records in one burst. The register
+ * address auto-increments from the count into the FIFO data register, which then
+ * pops one byte per read.
+ * @return Number of records read.
+ **/
+static unsigned udsp_card_imu_drain(udsp_card_imu_t *imu)
+{
+    unsigned bytes;
+    unsigned records;
+
+    udsp_card_imu_select(1);
+    udsp_card_imu_spi_byte(UDSP_CARD_IMU_REG_FIFO_COUNT | UDSP_CARD_IMU_SPI_READ);
+    bytes = udsp_card_imu_spi_byte(0) << 8;
+    bytes |= udsp_card_imu_spi_byte(0);
+
+    if (bytes > UDSP_CARD_IMU_FIFO_BYTES)
+    {
+        bytes = UDSP_CARD_IMU_FIFO_BYTES;
+        imu->truncated++;
+    }
+    records = bytes / UDSP_CARD_IMU_RECORD_BYTES;
+
+    for (unsigned i = 0; i < records * UDSP_CARD_IMU_RECORD_BYTES; i++)
+    {
+        imu->fifo[i] = udsp_card_imu_spi_byte(0);
+    }
+    udsp_card_imu_select(0);
+
+    return records;
+}
+
+void udsp_card_imu_task(udsp_card_imu_t *imu)
+{
+    hwtimer_t timer = hwtimer_alloc();
+
+    udsp_card_audio_clock_read(&imu->clock);
+    hwtimer_set_trigger_time(timer, get_reference_time() + UDSP_CARD_IMU_CLOCK_REFRESH_MS * XS1_TIMER_KHZ);
+
+    SELECT_RES(CASE_THEN(imu->irq.end_b, on_irq), CASE_THEN(timer, on_refresh))
+    {
+    on_irq:
+    {
+        udsp_card_imu_batch_t batch;
+
+        batch.ref_time = s_chan_in_word(imu->irq.end_b);
+
+        // Edges from here on need a new burst
+        __atomic_store_n(&imu->pending, 0, __ATOMIC_RELEASE);
+
+        batch.mclk = udsp_card_audio_clock_at(&imu->clock, batch.ref_time);
+        batch.frame = udsp_card_audio_clock_frames(&imu->clock, batch.mclk);
+        batch.records = udsp_card_imu_drain(imu);
+        batch.data = imu->fifo;
+
+        imu->irqs++;
+        imu->records += batch.records;
+        if (batch.records && imu->cb)
+        {
+            imu->cb(&batch);
+        }
+
+        hwtimer_set_trigger_time(timer, get_reference_time() + UDSP_CARD_IMU_CLOCK_REFRESH_MS * XS1_TIMER_KHZ);
+        continue;
+    }
+    on_refresh:
+    {
+        // Keep the audio clock extension valid while no interrupts arrive
+        udsp_card_audio_clock_read(&imu->clock);
+
+        if (!__atomic_load_n(&imu->running, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+
+        hwtimer_set_trigger_time(timer, hwtimer_get_time(timer) + UDSP_CARD_IMU_CLOCK_REFRESH_MS * XS1_TIMER_KHZ);
+        continue;
+    }
+    }
+
+    hwtimer_free(timer);
+    udsp_card_gpio_set(UDSP_CARD_GPIO_OUT_SPI_EN_N, UDSP_CARD_GPIO_OUT_SPI_EN_N);
+    port_disable(UDSP_CARD_PORT_SPI_MISO);
+    port_disable(UDSP_CARD_PORT_SPI_MOSI);
+    port_disable(UDSP_CARD_PORT_SPI_CLK);
+    port_disable(UDSP_CARD_PORT_SPI_CS);
+}
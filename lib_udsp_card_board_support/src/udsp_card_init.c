@@ -0,0 +1,120 @@
+/**
+ * @file udsp_card_init.c
+ * @brief Dependency-aware bring-up scheduler, runs independent init steps in parallel.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+#include <xcore/parallel.h>
+
+#include "udsp_card_init.h"
+
+#define UDSP_CARD_INIT_IDLE_TICKS 100 // Wait of an idle worker before it looks for a ready step again, 1us
+
+/**
+ * @brief Mask with one bit per step of the table.
+ **/
+static inline uint32_t udsp_card_init_all(unsigned num_steps)
+{
+    return num_steps == UDSP_CARD_INIT_MAX_STEPS ? ~0u : UDSP_CARD_INIT_DEP(num_steps) - 1;
+}
+
+/**
+ * @brief Claim and run one step whose dependencies have finished.
+ * @return 1 if a step was run, 0 if none is ready.
+ **/
+static int udsp_card_init_step(udsp_card_init_t *init, uint32_t finished)
+{
+    uint32_t claimed = __atomic_load_n(&init->claimed, __ATOMIC_RELAXED);
+
+    for (unsigned i = 0; i < init->num_steps; i++)
+    {
+        const udsp_card_init_step_t *step = &init->steps[i];
+        uint32_t bit = UDSP_CARD_INIT_DEP(i);
+        int ret;
+
+        if ((claimed & bit) || (step->deps & finished) != step->deps)
+        {
+            continue;
+        }
+
+        // Another worker may have taken the step since the load above
+        if (__atomic_fetch_or(&init->claimed, bit, __ATOMIC_ACQ_REL) & bit)
+        {
+            continue;
+        }
+
+        ret = (step->deps & __atomic_load_n(&init->failed, __ATOMIC_RELAXED)) ? -1 : step->fn(step->arg);
+
+        if (ret)
+        {
+            __atomic_fetch_or(&init->failed, bit, __ATOMIC_RELAXED);
+        }
+
+        // Publish the effects of the step before its dependents may start
+        __atomic_fetch_or(&init->finished, bit, __ATOMIC_RELEASE);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+DECLARE_JOB(udsp_card_init_worker, (udsp_card_init_t *));
+
+void udsp_card_init_worker(udsp_card_init_t *init)
+{
+    uint32_t all = udsp_card_init_all(init->num_steps);
+
+    while (1)
+    {
+        uint32_t finished = __atomic_load_n(&init->finished, __ATOMIC_ACQUIRE);
+
+        if (finished == all)
+        {
+            break;
+        }
+
+        if (!udsp_card_init_step(init, finished))
+        {
+            // Nothing ready and nothing running means the table has a dependency cycle
+            if (__atomic_load_n(&init->claimed, __ATOMIC_RELAXED) == finished)
+            {
+                break;
+            }
+
+            delay_ticks(UDSP_CARD_INIT_IDLE_TICKS);
+        }
+    }
+}
+
+int udsp_card_init_run(udsp_card_init_t *init, const udsp_card_init_step_t *steps, unsigned num_steps)
+{
+    if (num_steps > UDSP_CARD_INIT_MAX_STEPS)
+    {
+        return -1;
+    }
+
+    init->steps = steps;
+    init->num_steps = num_steps;
+    init->claimed = 0;
+    init->finished = 0;
+    init->failed = 0;
+
+#if UDSP_CARD_INIT_THREADS >= 3
+    PAR_JOBS(PJOB(udsp_card_init_worker, (init)), PJOB(udsp_card_init_worker, (init)),
+             PJOB(udsp_card_init_worker, (init)));
+#elif UDSP_CARD_INIT_THREADS == 2
+    PAR_JOBS(PJOB(udsp_card_init_worker, (init)), PJOB(udsp_card_init_worker, (init)));
+#else
+    udsp_card_init_worker(init);
+#endif
+
+    // Steps left unfinished by a dependency cycle count as failed
+    init->failed |= udsp_card_init_all(num_steps) & ~init->finished;
+
+    return init->failed ? -1 : 0;
+}
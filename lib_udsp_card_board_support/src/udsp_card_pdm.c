@@ -0,0 +1,372 @@
+/**
+ * @file udsp_card_pdm.c
+ * @brief 8-channel PDM microphone front end for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <xs1.h>
+#include <xcore/clock.h>
+#include <xcore/port.h>
+
+#include "udsp_card_pdm.h"
+
+#define UDSP_CARD_PDM_LUTS (UDSP_CARD_PDM_HISTORY * 4) // One table per byte of history
+#define UDSP_CARD_PDM_CIC_SHIFT 10                     // CIC gain is 2^20, scale to Q30
+#define UDSP_CARD_PDM_WORD_CLOCKS (32 / 4)             // Port clocks per word of the 4-bit data port
+#define UDSP_CARD_PDM_GROUP_WORDS (UDSP_CARD_PDM_CIC_DECIMATION * 2 * 4 / 32) // Port words per first stage output
+
+#if PDM_MICS != 8
+#error "The capture path packs one PDM clock of all microphones into a byte"
+#endif
+
+#if UDSP_CARD_PDM_RING_WORDS & (UDSP_CARD_PDM_RING_WORDS - 1) || UDSP_CARD_PDM_RING_WORDS < 2 * UDSP_CARD_PDM_GROUP_WORDS
+#error "UDSP_CARD_PDM_RING_WORDS must be a power of 2 of at least two first stage outputs"
+#endif
+
+/**
+ * First stage tables. Entry [g][v] is the CIC output contribution of history byte g
+ * holding the bits v, with a set bit counting +1 and a cleared bit -1.
+ */
+static int32_t udsp_card_pdm_lut[UDSP_CARD_PDM_LUTS][256];
+
+/**
+ * @brief Build the first stage tables from the CIC impulse response.
+ **/
+static void udsp_card_pdm_lut_init()
+{
+    int32_t h[UDSP_CARD_PDM_CIC_TAPS] = {1};
+    int32_t prev[UDSP_CARD_PDM_CIC_TAPS];
+    unsigned len = 1;
+
+    // CIC impulse response: UDSP_CARD_PDM_CIC_ORDER boxcars of the decimation length
+    for (unsigned order = 0; order < UDSP_CARD_PDM_CIC_ORDER; order++)
+    {
+        memcpy(prev, h, len * sizeof(h[0]));
+        for (unsigned n = 0; n < len + UDSP_CARD_PDM_CIC_DECIMATION - 1; n++)
+        {
+            h[n] = 0;
+            for (unsigned k = 0; k < len; k++)
+            {
+                h[n] += n - k < UDSP_CARD_PDM_CIC_DECIMATION ? prev[k] : 0;
+            }
+        }
+        len += UDSP_CARD_PDM_CIC_DECIMATION - 1;
+    }
+
+    for (unsigned g = 0; g < UDSP_CARD_PDM_LUTS; g++)
+    {
+        for (unsigned v = 0; v < 256; v++)
+        {
+            int32_t acc = 0;
+
+            for (unsigned k = 0; k < 8; k++)
+            {
+                // Bit k of byte b in history word j is (32 * j + 31 - 8 * b - k) samples old
+                unsigned age = 32 * (g / 4) + 31 - 8 * (g % 4) - k;
+
+                if (age < UDSP_CARD_PDM_CIC_TAPS)
+                {
+                    acc += (v >> k) & 1 ? h[age] : -h[age];
+                }
+            }
+            udsp_card_pdm_lut[g][v] = acc;
+        }
+    }
+}
+
+/**
+ * @brief Blackman windowed-sinc low pass at 0.45 of the output rate, Q30 with a
+ * DC gain of 2 so that full scale PDM maps to full scale PCM.
+ **/
+static void udsp_card_pdm_fir_init(udsp_card_pdm_t *pdm)
+{
+    double h[UDSP_CARD_PDM_FIR_TAPS];
+    double fc = 0.45 / pdm->decimation;
+    double sum = 0;
+
+    for (unsigned n = 0; n < UDSP_CARD_PDM_FIR_TAPS; n++)
+    {
+        double x = n - (UDSP_CARD_PDM_FIR_TAPS - 1) / 2.0;
+        double w = 0.42 - 0.5 * cos(2 * M_PI * n / (UDSP_CARD_PDM_FIR_TAPS - 1)) +
+                   0.08 * cos(4 * M_PI * n / (UDSP_CARD_PDM_FIR_TAPS - 1));
+
+        h[n] = (x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x)) * w;
+        sum += h[n];
+    }
+
+    for (unsigned n = 0; n < UDSP_CARD_PDM_FIR_TAPS; n++)
+    {
+        pdm->coef[n] = (int32_t)lround(h[n] * 2 / sum * (1 << 30));
+    }
+
+    for (unsigned m = 0; m < PDM_MICS; m++)
+    {
+        filter_fir_s32_init(&pdm->fir[m], pdm->state[m], UDSP_CARD_PDM_FIR_TAPS, pdm->coef, 0);
+    }
+}
+
+int udsp_card_pdm_init(udsp_card_pdm_t *pdm, unsigned mclk_freq, unsigned fs)
+{
+    unsigned clk_div = MASTER_CLOCK_FREQUENCY / PDM_CLOCK_FREQUENCY;
+    unsigned cic_fs = mclk_freq / clk_div / UDSP_CARD_PDM_CIC_DECIMATION;
+
+    // Clock block A divides by clk_div / 2, clock block B samples both edges at twice the rate
+    if (clk_div % 4 || !fs || cic_fs % fs || cic_fs / fs < 1 || cic_fs / fs > UDSP_CARD_PDM_MAX_DECIMATION)
+    {
+        return -1;
+    }
+
+    memset(pdm, 0, sizeof(*pdm));
+    pdm->clk_div = clk_div;
+    pdm->decimation = cic_fs / fs;
+    pdm->poll_ticks = XS1_TIMER_HZ / cic_fs;
+    pdm->running = 1;
+
+    udsp_card_pdm_lut_init();
+    udsp_card_pdm_fir_init(pdm);
+
+    return 0;
+}
+
+const int32_t *udsp_card_pdm_acquire(udsp_card_pdm_t *pdm)
+{
+    uint32_t consumed = pdm->consumed;
+
+    if (__atomic_load_n(&pdm->filled, __ATOMIC_ACQUIRE) == consumed)
+    {
+        return NULL;
+    }
+
+    return pdm->blocks[consumed & 1];
+}
+
+void udsp_card_pdm_release(udsp_card_pdm_t *pdm)
+{
+    __atomic_store_n(&pdm->consumed, pdm->consumed + 1, __ATOMIC_RELEASE);
+}
+
+void udsp_card_pdm_stop(udsp_card_pdm_t *pdm)
+{
+    __atomic_store_n(&pdm->running, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Transpose 8 PDM clocks x 8 microphones, byte r bit c to byte c bit r.
+ **/
+static inline uint64_t udsp_card_pdm_transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+
+    return x;
+}
+
+/**
+ * @brief Split 32 PDM clocks of port words into one word per microphone, oldest
+ * bit first. Each byte of the port data is one PDM clock, the low nibble sampled
+ * on the rising edge (mics 0-3) and the high nibble on the falling edge (mics 4-7).
+ **/
+static inline void udsp_card_pdm_split(const uint32_t words[UDSP_CARD_PDM_GROUP_WORDS], uint32_t bits[PDM_MICS])
+{
+    memset(bits, 0, PDM_MICS * sizeof(bits[0]));
+
+    for (unsigned p = 0; p < 4; p++)
+    {
+        uint32_t lo = words[2 * p];
+        uint32_t hi = words[2 * p + 1];
+        uint64_t x = udsp_card_pdm_transpose8(lo | (uint64_t)hi << 32);
+
+        for (unsigned m = 0; m < PDM_MICS; m++)
+        {
+            bits[m] |= (uint32_t)((x >> (8 * m)) & 0xFF) << (8 * p);
+        }
+    }
+}
+
+/**
+ * @brief First stage output of one microphone from its 1-bit history.
+ **/
+static inline int32_t udsp_card_pdm_cic(const uint32_t history[UDSP_CARD_PDM_HISTORY])
+{
+    int32_t acc = 0;
+
+    for (unsigned j = 0; j < UDSP_CARD_PDM_HISTORY; j++)
+    {
+        uint32_t w = history[j];
+
+        acc += udsp_card_pdm_lut[4 * j + 0][w & 0xFF];
+        acc += udsp_card_pdm_lut[4 * j + 1][(w >> 8) & 0xFF];
+        acc += udsp_card_pdm_lut[4 * j + 2][(w >> 16) & 0xFF];
+        acc += udsp_card_pdm_lut[4 * j + 3][w >> 24];
+    }
+
+    return acc;
+}
+
+static void udsp_card_pdm_start(const udsp_card_pdm_t *pdm)
+{
+    // The MCLK port is shared with the audio engine and left enabled on stop
+    port_enable(UDSP_CARD_PORT_MCLK);
+
+    clock_enable(UDSP_CARD_CLKBLK_PDM_A);
+    clock_set_source_port(UDSP_CARD_CLKBLK_PDM_A, UDSP_CARD_PORT_MCLK);
+    clock_set_divide(UDSP_CARD_CLKBLK_PDM_A, pdm->clk_div / 2);
+
+    clock_enable(UDSP_CARD_CLKBLK_PDM_B);
+    clock_set_source_port(UDSP_CARD_CLKBLK_PDM_B, UDSP_CARD_PORT_MCLK);
+    clock_set_divide(UDSP_CARD_CLKBLK_PDM_B, pdm->clk_div / 4);
+
+    port_enable(UDSP_CARD_PORT_PDM_CLK);
+    port_set_clock(UDSP_CARD_PORT_PDM_CLK, UDSP_CARD_CLKBLK_PDM_A);
+    port_set_out_clock(UDSP_CARD_PORT_PDM_CLK);
+
+    port_start_buffered(UDSP_CARD_PORT_PDM_DATA, 32);
+    port_set_clock(UDSP_CARD_PORT_PDM_DATA, UDSP_CARD_CLKBLK_PDM_B);
+    port_clear_buffer(UDSP_CARD_PORT_PDM_DATA);
+
+    clock_start(UDSP_CARD_CLKBLK_PDM_A);
+    clock_start(UDSP_CARD_CLKBLK_PDM_B);
+}
+
+static void udsp_card_pdm_shutdown()
+{
+    clock_stop(UDSP_CARD_CLKBLK_PDM_B);
+    clock_stop(UDSP_CARD_CLKBLK_PDM_A);
+    port_disable(UDSP_CARD_PORT_PDM_DATA);
+    port_disable(UDSP_CARD_PORT_PDM_CLK);
+    clock_disable(UDSP_CARD_CLKBLK_PDM_B);
+    clock_disable(UDSP_CARD_CLKBLK_PDM_A);
+}
+
+void udsp_card_pdm_capture_task(udsp_card_pdm_t *pdm)
+{
+    uint32_t captured = 0;
+    uint16_t last = 0;
+
+    udsp_card_pdm_start(pdm);
+
+    for (int first = 1; __atomic_load_n(&pdm->running, __ATOMIC_RELAXED); first = 0)
+    {
+        uint32_t word = port_in(UDSP_CARD_PORT_PDM_DATA);
+        uint16_t stamp = port_get_trigger_time(UDSP_CARD_PORT_PDM_DATA);
+
+        // Consecutive words are 8 port clocks apart, anything else lost words in the port
+        if (!first && (uint16_t)(stamp - last) != UDSP_CARD_PDM_WORD_CLOCKS)
+        {
+            pdm->stalls++;
+        }
+        last = stamp;
+
+        if (captured - __atomic_load_n(&pdm->decimated, __ATOMIC_ACQUIRE) < UDSP_CARD_PDM_RING_WORDS)
+        {
+            pdm->ring[captured & (UDSP_CARD_PDM_RING_WORDS - 1)] = word;
+            __atomic_store_n(&pdm->captured, ++captured, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            pdm->dropped++;
+        }
+    }
+
+    udsp_card_pdm_shutdown();
+}
+
+/**
+ * @brief Wait for the port words of the next first stage output and take them from the ring.
+ * @return 0 on success, -1 if the front end was stopped.
+ **/
+static int udsp_card_pdm_take(udsp_card_pdm_t *pdm, uint32_t words[UDSP_CARD_PDM_GROUP_WORDS])
+{
+    uint32_t decimated = pdm->decimated;
+
+    while (__atomic_load_n(&pdm->captured, __ATOMIC_ACQUIRE) - decimated < UDSP_CARD_PDM_GROUP_WORDS)
+    {
+        if (!__atomic_load_n(&pdm->running, __ATOMIC_RELAXED))
+        {
+            return -1;
+        }
+        delay_ticks(pdm->poll_ticks);
+    }
+
+    for (unsigned i = 0; i < UDSP_CARD_PDM_GROUP_WORDS; i++)
+    {
+        words[i] = pdm->ring[(decimated + i) & (UDSP_CARD_PDM_RING_WORDS - 1)];
+    }
+    __atomic_store_n(&pdm->decimated, decimated + UDSP_CARD_PDM_GROUP_WORDS, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+void udsp_card_pdm_task(udsp_card_pdm_t *pdm)
+{
+    uint32_t words[UDSP_CARD_PDM_GROUP_WORDS];
+    uint32_t bits[PDM_MICS];
+    unsigned phase = 0;
+    unsigned frame = 0;
+    int32_t *out = pdm->blocks[0];
+
+    while (udsp_card_pdm_take(pdm, words) == 0)
+    {
+        udsp_card_pdm_split(words, bits);
+
+        for (unsigned m = 0; m < PDM_MICS; m++)
+        {
+            uint32_t *history = pdm->history[m];
+            int32_t sample;
+
+            memmove(&history[1], &history[0], (UDSP_CARD_PDM_HISTORY - 1) * sizeof(history[0]));
+            history[0] = bits[m];
+            sample = udsp_card_pdm_cic(history) << UDSP_CARD_PDM_CIC_SHIFT;
+
+            // Only every decimation-th output of the low pass is computed
+            if (phase + 1 < pdm->decimation)
+            {
+                filter_fir_s32_add_sample(&pdm->fir[m], sample);
+            }
+            else
+            {
+                sample = filter_fir_s32(&pdm->fir[m], sample);
+                if (out)
+                {
+                    out[frame * PDM_MICS + m] = sample;
+                }
+            }
+        }
+
+        if (++phase < pdm->decimation)
+        {
+            continue;
+        }
+        phase = 0;
+
+        if (++frame < UDSP_CARD_PDM_BLOCK_FRAMES)
+        {
+            continue;
+        }
+        frame = 0;
+
+        if (out)
+        {
+            // Publish the block after its samples
+            __atomic_store_n(&pdm->filled, pdm->filled + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            pdm->overruns++;
+        }
+
+        // Drop the next block if the consumer still holds both
+        out = pdm->filled - __atomic_load_n(&pdm->consumed, __ATOMIC_ACQUIRE) < 2 ? pdm->blocks[pdm->filled & 1] : NULL;
+    }
+}
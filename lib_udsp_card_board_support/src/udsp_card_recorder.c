@@ -0,0 +1,276 @@
+/**
+ * @file udsp_card_recorder.c
+ * @brief Streaming multi-channel WAV/RF64 recorder for a block device.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <string.h>
+
+#include <xcore/hwtimer.h>
+
+#include "udsp_card_recorder.h"
+
+/**
+ * Header sector layout. The JUNK chunk right after the RIFF header is replaced by
+ * ds64 when the recording is finalized as RF64, the second JUNK chunk pads the
+ * header so that audio data starts on a sector boundary.
+ */
+#define UDSP_CARD_RECORDER_DS64_AT 12
+#define UDSP_CARD_RECORDER_DS64_LEN 28
+#define UDSP_CARD_RECORDER_FMT_AT (UDSP_CARD_RECORDER_DS64_AT + 8 + UDSP_CARD_RECORDER_DS64_LEN)
+#define UDSP_CARD_RECORDER_FMT_LEN 40 // WAVE_FORMAT_EXTENSIBLE
+#define UDSP_CARD_RECORDER_PAD_AT (UDSP_CARD_RECORDER_FMT_AT + 8 + UDSP_CARD_RECORDER_FMT_LEN)
+#define UDSP_CARD_RECORDER_DATA_AT (UDSP_CARD_RECORDER_SECTOR - 8)
+
+#define UDSP_CARD_RECORDER_SAMPLE_BYTES 4
+
+static const uint8_t udsp_card_recorder_pcm_guid[16] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+                                                        0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+static void udsp_card_recorder_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void udsp_card_recorder_put64(uint8_t *p, uint64_t v)
+{
+    udsp_card_recorder_put32(p, (uint32_t)v);
+    udsp_card_recorder_put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static void udsp_card_recorder_chunk(uint8_t *p, const char *id, uint32_t len)
+{
+    memcpy(p, id, 4);
+    udsp_card_recorder_put32(p + 4, len);
+}
+
+/**
+ * @brief Build the header sector for data_bytes of audio. While recording the
+ * sizes are left at 0xFFFFFFFF, so a recording cut short reads up to the end of
+ * the written region.
+ **/
+static void udsp_card_recorder_header(const udsp_card_recorder_t *rec, uint8_t sector[UDSP_CARD_RECORDER_SECTOR],
+                                      int final)
+{
+    unsigned frame_bytes = rec->channels * UDSP_CARD_RECORDER_SAMPLE_BYTES;
+    uint64_t data_bytes = rec->data_bytes - rec->data_bytes % frame_bytes;
+    uint64_t riff_bytes = UDSP_CARD_RECORDER_SECTOR - 8 + data_bytes;
+    int rf64 = final && riff_bytes > 0xFFFFFFFF;
+    uint8_t *fmt = sector + UDSP_CARD_RECORDER_FMT_AT + 8;
+
+    memset(sector, 0, UDSP_CARD_RECORDER_SECTOR);
+
+    udsp_card_recorder_chunk(sector, rf64 ? "RF64" : "RIFF", final && !rf64 ? riff_bytes : 0xFFFFFFFF);
+    memcpy(sector + 8, "WAVE", 4);
+
+    udsp_card_recorder_chunk(sector + UDSP_CARD_RECORDER_DS64_AT, rf64 ? "ds64" : "JUNK", UDSP_CARD_RECORDER_DS64_LEN);
+    if (rf64)
+    {
+        uint8_t *ds64 = sector + UDSP_CARD_RECORDER_DS64_AT + 8;
+
+        udsp_card_recorder_put64(ds64, riff_bytes);
+        udsp_card_recorder_put64(ds64 + 8, data_bytes);
+        udsp_card_recorder_put64(ds64 + 16, data_bytes / frame_bytes);
+    }
+
+    udsp_card_recorder_chunk(sector + UDSP_CARD_RECORDER_FMT_AT, "fmt ", UDSP_CARD_RECORDER_FMT_LEN);
+    fmt[0] = 0xFE; // WAVE_FORMAT_EXTENSIBLE
+    fmt[1] = 0xFF;
+    fmt[2] = rec->channels;
+    fmt[3] = rec->channels >> 8;
+    udsp_card_recorder_put32(fmt + 4, rec->fs);
+    udsp_card_recorder_put32(fmt + 8, rec->fs * frame_bytes);
+    fmt[12] = frame_bytes;
+    fmt[13] = frame_bytes >> 8;
+    fmt[14] = 8 * UDSP_CARD_RECORDER_SAMPLE_BYTES;
+    fmt[16] = 22; // Extension size
+    fmt[18] = 8 * UDSP_CARD_RECORDER_SAMPLE_BYTES;
+    memcpy(fmt + 24, udsp_card_recorder_pcm_guid, sizeof(udsp_card_recorder_pcm_guid)); // Channel mask 0, unassigned
+
+    udsp_card_recorder_chunk(sector + UDSP_CARD_RECORDER_PAD_AT, "JUNK",
+                             UDSP_CARD_RECORDER_DATA_AT - UDSP_CARD_RECORDER_PAD_AT - 8);
+
+    udsp_card_recorder_chunk(sector + UDSP_CARD_RECORDER_DATA_AT, "data",
+                             final && !rf64 ? data_bytes : 0xFFFFFFFF);
+}
+
+/**
+ * @brief Write up to count data sectors, clipped to the end of the recording region.
+ * @return Sectors written, -1 on a device error.
+ **/
+static int udsp_card_recorder_write(udsp_card_recorder_t *rec, const uint8_t *buf, uint32_t count)
+{
+    uint32_t left = rec->first_sector + rec->max_sectors - rec->next_sector;
+    uint32_t start;
+    uint32_t elapsed;
+    int ret;
+
+    count = count < left ? count : left;
+    if (!count)
+    {
+        return 0;
+    }
+
+    start = get_reference_time();
+    ret = rec->dev->write(rec->dev->ctx, rec->next_sector, buf, count);
+    elapsed = get_reference_time() - start;
+
+    rec->write_max = elapsed > rec->write_max ? elapsed : rec->write_max;
+    if (ret)
+    {
+        rec->errors++;
+        return -1;
+    }
+
+    rec->next_sector += count;
+    rec->batches++;
+
+    return count;
+}
+
+int udsp_card_recorder_start(udsp_card_recorder_t *rec, const udsp_card_blockdev_t *dev, uint32_t first_sector,
+                             uint32_t max_sectors, uint8_t *ring, uint32_t ring_size, unsigned channels, unsigned fs)
+{
+    uint8_t sector[UDSP_CARD_RECORDER_SECTOR];
+
+    if (!dev || !dev->write || !ring || max_sectors < 2 || !channels || channels > 0xFFFF || !fs ||
+        ring_size < UDSP_CARD_RECORDER_BATCH_BYTES || ring_size & (ring_size - 1) || ring_size > 0x80000000)
+    {
+        return -1;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    rec->dev = dev;
+    rec->first_sector = first_sector;
+    rec->max_sectors = max_sectors;
+    rec->next_sector = first_sector + 1;
+    rec->ring = ring;
+    rec->ring_size = ring_size;
+    rec->channels = channels;
+    rec->fs = fs;
+
+    udsp_card_recorder_header(rec, sector, 0);
+    if (dev->write(dev->ctx, first_sector, sector, 1))
+    {
+        return -1;
+    }
+
+    __atomic_store_n(&rec->recording, 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int udsp_card_recorder_push(udsp_card_recorder_t *rec, const int32_t *frames, unsigned num_frames)
+{
+    uint32_t frame_bytes = rec->channels * UDSP_CARD_RECORDER_SAMPLE_BYTES;
+    uint32_t head = rec->head;
+    uint32_t offset = head & (rec->ring_size - 1);
+    uint32_t first = rec->ring_size - offset;
+    uint32_t bytes;
+
+    // Frames beyond the ring size are rejected before their byte count can wrap
+    if (!__atomic_load_n(&rec->recording, __ATOMIC_RELAXED) || num_frames > rec->ring_size / frame_bytes ||
+        rec->ring_size - (head - __atomic_load_n(&rec->tail, __ATOMIC_ACQUIRE)) < num_frames * frame_bytes)
+    {
+        rec->dropped += num_frames;
+        return -1;
+    }
+
+    bytes = num_frames * frame_bytes;
+    first = bytes < first ? bytes : first;
+    memcpy(rec->ring + offset, frames, first);
+    memcpy(rec->ring, (const uint8_t *)frames + first, bytes - first);
+
+    // Publish the frames after their samples
+    __atomic_store_n(&rec->head, head + bytes, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int udsp_card_recorder_service(udsp_card_recorder_t *rec)
+{
+    uint32_t fill = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE) - rec->tail;
+    int ret;
+
+    if (!rec->recording)
+    {
+        return 0;
+    }
+
+    rec->ring_peak = fill > rec->ring_peak ? fill : rec->ring_peak;
+    if (fill < UDSP_CARD_RECORDER_BATCH_BYTES)
+    {
+        return 0;
+    }
+
+    // The tail stays batch aligned and the ring is a multiple of the batch, so a batch never wraps
+    ret = udsp_card_recorder_write(rec, rec->ring + (rec->tail & (rec->ring_size - 1)),
+                                   UDSP_CARD_RECORDER_BATCH_SECTORS);
+    if (ret < 0)
+    {
+        return -1;
+    }
+
+    rec->data_bytes += (uint32_t)ret * UDSP_CARD_RECORDER_SECTOR;
+    __atomic_store_n(&rec->tail, rec->tail + UDSP_CARD_RECORDER_BATCH_BYTES, __ATOMIC_RELEASE);
+
+    if (ret < UDSP_CARD_RECORDER_BATCH_SECTORS)
+    {
+        // The recording region is full
+        __atomic_store_n(&rec->recording, 0, __ATOMIC_RELAXED);
+    }
+
+    return 1;
+}
+
+int udsp_card_recorder_stop(udsp_card_recorder_t *rec)
+{
+    uint8_t sector[UDSP_CARD_RECORDER_SECTOR];
+    int failed = 0;
+    int ret;
+
+    while ((ret = udsp_card_recorder_service(rec)) > 0)
+        ;
+    failed |= ret < 0;
+
+    if (rec->recording && !failed)
+    {
+        const uint8_t *rest = rec->ring + (rec->tail & (rec->ring_size - 1));
+        uint32_t fill = rec->head - rec->tail;
+        uint32_t whole = fill / UDSP_CARD_RECORDER_SECTOR;
+        uint32_t partial = fill % UDSP_CARD_RECORDER_SECTOR;
+
+        ret = udsp_card_recorder_write(rec, rest, whole);
+        failed |= ret < 0;
+        if (ret > 0)
+        {
+            rec->data_bytes += (uint32_t)ret * UDSP_CARD_RECORDER_SECTOR;
+        }
+
+        if (!failed && (uint32_t)ret == whole && partial)
+        {
+            memcpy(sector, rest + whole * UDSP_CARD_RECORDER_SECTOR, partial);
+            memset(sector + partial, 0, UDSP_CARD_RECORDER_SECTOR - partial);
+            ret = udsp_card_recorder_write(rec, sector, 1);
+            failed |= ret < 0;
+            rec->data_bytes += ret > 0 ? partial : 0;
+        }
+    }
+
+    __atomic_store_n(&rec->recording, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->tail, rec->head, __ATOMIC_RELEASE);
+
+    udsp_card_recorder_header(rec, sector, 1);
+    failed |= rec->dev->write(rec->dev->ctx, rec->first_sector, sector, 1) != 0;
+    if (rec->dev->sync)
+    {
+        failed |= rec->dev->sync(rec->dev->ctx) != 0;
+    }
+
+    return failed ? -1 : 0;
+}
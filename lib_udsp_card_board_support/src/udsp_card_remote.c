@@ -0,0 +1,126 @@
+/**
+ * @file udsp_card_remote.c
+ * @brief Cross-tile board control over a streaming channel.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xcore/channel_streaming.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_remote.h"
+
+/**
+ * @brief Read a status item on the server.
+ * @return 0 on success, -1 if the item is unknown.
+ **/
+static int udsp_card_remote_status_get(udsp_card_ctrl_t *queue, uint32_t item, uint32_t rejected, uint32_t *value)
+{
+    switch (item)
+    {
+    case UDSP_CARD_REMOTE_STATUS_RATE:
+        *value = udsp_card_get_sample_rate();
+        return 0;
+    case UDSP_CARD_REMOTE_STATUS_COMPLETED:
+        *value = __atomic_load_n(&queue->completed, __ATOMIC_ACQUIRE);
+        return 0;
+    case UDSP_CARD_REMOTE_STATUS_ERRORS:
+        *value = __atomic_load_n(&queue->errors, __ATOMIC_RELAXED);
+        return 0;
+    case UDSP_CARD_REMOTE_STATUS_REJECTED:
+        *value = rejected;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+void udsp_card_remote_server(chanend_t c, udsp_card_ctrl_t *queue)
+{
+    uint32_t rejected = 0;
+
+    while (1)
+    {
+        uint32_t op = s_chan_in_word(c);
+        uint32_t arg0 = s_chan_in_word(c);
+        uint32_t arg1 = s_chan_in_word(c);
+        uint32_t value = 0;
+        int status;
+
+        switch (op)
+        {
+        case UDSP_CARD_REMOTE_DONE:
+            value = udsp_card_ctrl_done(queue, arg0);
+            status = 0;
+            break;
+        case UDSP_CARD_REMOTE_STATUS:
+            status = udsp_card_remote_status_get(queue, arg0, rejected, &value);
+            break;
+        default:
+            status = op <= UDSP_CARD_CMD_POWER ? udsp_card_ctrl_post(queue, op, arg0, arg1, &value) : -1;
+            break;
+        }
+
+        rejected += status != 0;
+
+        s_chan_out_word(c, status);
+        s_chan_out_word(c, value);
+    }
+}
+
+int udsp_card_remote_init(udsp_card_remote_t *remote, chanend_t c)
+{
+    remote->c = c;
+    remote->lock = lock_alloc();
+
+    return remote->lock ? 0 : -1;
+}
+
+int udsp_card_remote_call(udsp_card_remote_t *remote, uint32_t op, uint32_t arg0, uint32_t arg1, uint32_t *value)
+{
+    int status;
+    uint32_t v;
+
+    lock_acquire(remote->lock);
+    s_chan_out_word(remote->c, op);
+    s_chan_out_word(remote->c, arg0);
+    s_chan_out_word(remote->c, arg1);
+    status = (int32_t)s_chan_in_word(remote->c);
+    v = s_chan_in_word(remote->c);
+    lock_release(remote->lock);
+
+    if (value)
+    {
+        *value = v;
+    }
+
+    return status ? -1 : 0;
+}
+
+int udsp_card_remote_post(udsp_card_remote_t *remote, udsp_card_cmd_id_t id, uint32_t arg0, uint32_t arg1,
+                          uint32_t *seq)
+{
+    return udsp_card_remote_call(remote, id, arg0, arg1, seq);
+}
+
+int udsp_card_remote_done(udsp_card_remote_t *remote, uint32_t seq)
+{
+    uint32_t done = 0;
+
+    udsp_card_remote_call(remote, UDSP_CARD_REMOTE_DONE, seq, 0, &done);
+
+    return done != 0;
+}
+
+int udsp_card_remote_led(udsp_card_remote_t *remote, unsigned led_mask, int on)
+{
+    led_mask &= UDSP_CARD_GPIO_OUT_LED_0 | UDSP_CARD_GPIO_OUT_LED_1;
+
+    return udsp_card_remote_call(remote, UDSP_CARD_CMD_GPIO, led_mask, on ? led_mask : 0, NULL);
+}
+
+int udsp_card_remote_status(udsp_card_remote_t *remote, udsp_card_remote_status_t item, uint32_t *value)
+{
+    return udsp_card_remote_call(remote, UDSP_CARD_REMOTE_STATUS, item, 0, value);
+}
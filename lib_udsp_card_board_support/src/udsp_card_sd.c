@@ -0,0 +1,348 @@
+/**
+ * @file udsp_card_sd.c
+ * @brief SD card block device on the card slot of the uDSP-Card, the target backend
+ * of udsp_card_recorder.h.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <string.h>
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+#include <xcore/port.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_sd.h"
+
+#define UDSP_CARD_SD_DAT_IDLE 0xF   // DAT0-3 high
+#define UDSP_CARD_SD_NCR 64         // Clocks until the card starts a response
+#define UDSP_CARD_SD_NRC 8          // Clocks after a response before the next command
+#define UDSP_CARD_SD_NCRC 16        // Clocks until the card starts the CRC status of a block
+#define UDSP_CARD_SD_INIT_CLOCKS 80 // Clocks with CMD high before the first command, at least 74
+
+/** @name Responses
+ *  @{
+ */
+#define UDSP_CARD_SD_NONE 0
+#define UDSP_CARD_SD_R1 1  // Card status, checked for errors
+#define UDSP_CARD_SD_R1B 2 // R1, then busy on DAT0
+#define UDSP_CARD_SD_R2 3  // CID or CSD, 136 bits
+#define UDSP_CARD_SD_R3 4  // OCR, without index and CRC
+#define UDSP_CARD_SD_R6 5  // RCA or interface condition (R7), index and CRC checked
+/** @} */
+
+#define UDSP_CARD_SD_STATUS_ERRORS 0xFDFFE008 // Error bits of the R1 card status
+#define UDSP_CARD_SD_STATUS_STATE(s) (((s) >> 9) & 0xF)
+#define UDSP_CARD_SD_STATE_TRAN 4
+#define UDSP_CARD_SD_OCR_BUSY (1u << 31) // Power up finished
+#define UDSP_CARD_SD_OCR_CCS (1u << 30)  // Card capacity status, block addressing
+#define UDSP_CARD_SD_OCR_HCS (1u << 30)  // Host supports high capacity cards
+#define UDSP_CARD_SD_OCR_VOLTAGE 0x00FF8000 // 2.7-3.6V
+#define UDSP_CARD_SD_IF_COND 0x1AA          // 2.7-3.6V and the check pattern of CMD8
+#define UDSP_CARD_SD_TOKEN_ACCEPTED 0x2     // CRC status of a block written without errors
+
+/**
+ * @brief One clock period, the card samples on the rising edge.
+ **/
+static inline void udsp_card_sd_clock(const udsp_card_sd_t *sd)
+{
+    port_out(UDSP_CARD_PORT_SD_CLK, 0);
+    if (sd->half_period)
+    {
+        delay_ticks(sd->half_period);
+    }
+    port_out(UDSP_CARD_PORT_SD_CLK, 1);
+    if (sd->half_period)
+    {
+        delay_ticks(sd->half_period);
+    }
+}
+
+/**
+ * @brief Drive a bit on CMD or DAT0 for one clock period.
+ **/
+static inline void udsp_card_sd_bit_out(const udsp_card_sd_t *sd, port_t p, uint32_t value)
+{
+    port_out(UDSP_CARD_PORT_SD_CLK, 0);
+    port_out(p, value);
+    if (sd->half_period)
+    {
+        delay_ticks(sd->half_period);
+    }
+    port_out(UDSP_CARD_PORT_SD_CLK, 1);
+    if (sd->half_period)
+    {
+        delay_ticks(sd->half_period);
+    }
+}
+
+/**
+ * @brief Clock one bit driven by the card on CMD or DAT0. The card changes its
+ * outputs on the falling edge, so the bit is read after the rising edge.
+ **/
+static inline unsigned udsp_card_sd_bit_in(const udsp_card_sd_t *sd, port_t p)
+{
+    udsp_card_sd_clock(sd);
+
+    return port_in(p) & 1;
+}
+
+static uint8_t udsp_card_sd_crc7(const uint8_t *buf, unsigned len)
+{
+    uint8_t crc = 0;
+
+    for (unsigned i = 0; i < len * 8; i++)
+    {
+        unsigned bit = (buf[i / 8] >> (7 - i % 8)) & 1;
+
+        crc = (crc << 1) ^ ((crc >> 6 ^ bit) & 1 ? 0x09 : 0);
+    }
+
+    return crc & 0x7F;
+}
+
+static uint32_t udsp_card_sd_get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/**
+ * @brief Wait until the card releases DAT0 after programming.
+ * @return 0 when the card is ready, -1 on timeout.
+ **/
+static int udsp_card_sd_wait_busy(const udsp_card_sd_t *sd)
+{
+    uint32_t start = get_reference_time();
+
+    while (!udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_SIO))
+    {
+        if (get_reference_time() - start > UDSP_CARD_SD_BUSY_TIMEOUT_MS * XS1_TIMER_KHZ)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send a command and read its response.
+ * @param resp Receives the response, start bit first, 6 bytes or 17 bytes for R2. May be NULL.
+ * @return 0 on success, -1 if the card did not answer or reported an error.
+ **/
+static int udsp_card_sd_cmd(udsp_card_sd_t *sd, uint8_t index, uint32_t arg, unsigned type, uint8_t *resp)
+{
+    uint8_t frame[6] = {0x40 | index, arg >> 24, arg >> 16, arg >> 8, arg};
+    uint8_t buf[17] = {0};
+    unsigned bits = type == UDSP_CARD_SD_R2 ? 136 : 48;
+    unsigned n = 0;
+
+    frame[5] = udsp_card_sd_crc7(frame, 5) << 1 | 1;
+    for (unsigned i = 0; i < 48; i++)
+    {
+        udsp_card_sd_bit_out(sd, UDSP_CARD_PORT_SD_CMD, (frame[i / 8] >> (7 - i % 8)) & 1);
+    }
+
+    if (type == UDSP_CARD_SD_NONE)
+    {
+        port_out(UDSP_CARD_PORT_SD_CMD, 1);
+        for (unsigned i = 0; i < UDSP_CARD_SD_NRC; i++)
+        {
+            udsp_card_sd_clock(sd);
+        }
+        return 0;
+    }
+
+    // Release CMD and wait for the start bit of the response
+    while (udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_CMD))
+    {
+        if (++n == UDSP_CARD_SD_NCR)
+        {
+            return -1;
+        }
+    }
+    for (unsigned i = 1; i < bits; i++)
+    {
+        buf[i / 8] |= udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_CMD) << (7 - i % 8);
+    }
+    for (unsigned i = 0; i < UDSP_CARD_SD_NRC; i++)
+    {
+        udsp_card_sd_clock(sd);
+    }
+
+    if (resp)
+    {
+        memcpy(resp, buf, bits / 8);
+    }
+
+    if ((type == UDSP_CARD_SD_R1 || type == UDSP_CARD_SD_R1B || type == UDSP_CARD_SD_R6) &&
+        ((buf[0] & 0x3F) != index || udsp_card_sd_crc7(buf, 5) != buf[5] >> 1))
+    {
+        return -1;
+    }
+    if ((type == UDSP_CARD_SD_R1 || type == UDSP_CARD_SD_R1B) &&
+        (udsp_card_sd_get32(&buf[1]) & UDSP_CARD_SD_STATUS_ERRORS))
+    {
+        return -1;
+    }
+
+    return type == UDSP_CARD_SD_R1B ? udsp_card_sd_wait_busy(sd) : 0;
+}
+
+/**
+ * @brief Send one block of a multiple block write and wait until it is programmed.
+ * @return 0 if the card accepted the block, -1 otherwise.
+ **/
+static int udsp_card_sd_block(const udsp_card_sd_t *sd, const uint8_t *data)
+{
+    uint16_t crc = 0;
+    unsigned token = 0;
+    unsigned n = 0;
+
+    udsp_card_sd_bit_out(sd, UDSP_CARD_PORT_SD_SIO, UDSP_CARD_SD_DAT_IDLE & ~1);
+
+    // The CRC16 is computed on the fly, MSB first like the data
+    for (unsigned i = 0; i < UDSP_CARD_RECORDER_SECTOR * 8; i++)
+    {
+        unsigned bit = (data[i / 8] >> (7 - i % 8)) & 1;
+
+        udsp_card_sd_bit_out(sd, UDSP_CARD_PORT_SD_SIO, (UDSP_CARD_SD_DAT_IDLE & ~1) | bit);
+        crc = (crc << 1) ^ ((crc >> 15 ^ bit) & 1 ? 0x1021 : 0);
+    }
+    for (int i = 15; i >= 0; i--)
+    {
+        udsp_card_sd_bit_out(sd, UDSP_CARD_PORT_SD_SIO, (UDSP_CARD_SD_DAT_IDLE & ~1) | ((crc >> i) & 1));
+    }
+    udsp_card_sd_bit_out(sd, UDSP_CARD_PORT_SD_SIO, UDSP_CARD_SD_DAT_IDLE);
+
+    // Release DAT0 for the CRC status token: start bit, 3 status bits, end bit
+    while (udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_SIO))
+    {
+        if (++n == UDSP_CARD_SD_NCRC)
+        {
+            return -1;
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        token = token << 1 | udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_SIO);
+    }
+    (void)udsp_card_sd_bit_in(sd, UDSP_CARD_PORT_SD_SIO);
+
+    if (token != UDSP_CARD_SD_TOKEN_ACCEPTED)
+    {
+        return -1;
+    }
+
+    return udsp_card_sd_wait_busy(sd);
+}
+
+int udsp_card_sd_init(udsp_card_sd_t *sd, udsp_card_blockdev_t *dev)
+{
+    uint8_t resp[17];
+    uint32_t ocr = 0;
+    uint32_t start;
+    int v2;
+
+    memset(sd, 0, sizeof(*sd));
+    sd->half_period = XS1_TIMER_KHZ / (2 * UDSP_CARD_SD_INIT_KHZ);
+
+    port_enable(UDSP_CARD_PORT_SD_CLK);
+    port_enable(UDSP_CARD_PORT_SD_CMD);
+    port_enable(UDSP_CARD_PORT_SD_SIO);
+    port_out(UDSP_CARD_PORT_SD_CLK, 1);
+    port_out(UDSP_CARD_PORT_SD_CMD, 1);
+    (void)port_in(UDSP_CARD_PORT_SD_SIO);
+
+    for (unsigned i = 0; i < UDSP_CARD_SD_INIT_CLOCKS; i++)
+    {
+        udsp_card_sd_clock(sd);
+    }
+
+    udsp_card_sd_cmd(sd, 0, 0, UDSP_CARD_SD_NONE, NULL);
+
+    // Only version 2 cards answer CMD8, and only they may be high capacity
+    v2 = udsp_card_sd_cmd(sd, 8, UDSP_CARD_SD_IF_COND, UDSP_CARD_SD_R6, resp) == 0 &&
+         (udsp_card_sd_get32(&resp[1]) & 0xFFF) == UDSP_CARD_SD_IF_COND;
+
+    start = get_reference_time();
+    do
+    {
+        if (udsp_card_sd_cmd(sd, 55, 0, UDSP_CARD_SD_R1, NULL) ||
+            udsp_card_sd_cmd(sd, 41, (v2 ? UDSP_CARD_SD_OCR_HCS : 0) | UDSP_CARD_SD_OCR_VOLTAGE, UDSP_CARD_SD_R3,
+                             resp))
+        {
+            return -1;
+        }
+        ocr = udsp_card_sd_get32(&resp[1]);
+    } while (!(ocr & UDSP_CARD_SD_OCR_BUSY) &&
+             get_reference_time() - start < UDSP_CARD_SD_INIT_TIMEOUT_MS * XS1_TIMER_KHZ);
+
+    if (!(ocr & UDSP_CARD_SD_OCR_BUSY) || udsp_card_sd_cmd(sd, 2, 0, UDSP_CARD_SD_R2, NULL) ||
+        udsp_card_sd_cmd(sd, 3, 0, UDSP_CARD_SD_R6, resp))
+    {
+        return -1;
+    }
+    sd->rca = resp[1] << 8 | resp[2];
+    sd->block_addressing = (ocr & UDSP_CARD_SD_OCR_CCS) != 0;
+
+    if (udsp_card_sd_cmd(sd, 7, (uint32_t)sd->rca << 16, UDSP_CARD_SD_R1B, NULL) ||
+        (!sd->block_addressing &&
+         udsp_card_sd_cmd(sd, 16, UDSP_CARD_RECORDER_SECTOR, UDSP_CARD_SD_R1, NULL)))
+    {
+        return -1;
+    }
+
+    // Identification done, clock as fast as the thread can
+    sd->half_period = 0;
+
+    dev->write = udsp_card_sd_write;
+    dev->sync = udsp_card_sd_sync;
+    dev->ctx = sd;
+
+    return 0;
+}
+
+int udsp_card_sd_write(void *ctx, uint32_t sector, const void *buf, uint32_t count)
+{
+    udsp_card_sd_t *sd = ctx;
+    const uint8_t *data = buf;
+    int ret;
+
+    ret = udsp_card_sd_cmd(sd, 25, sd->block_addressing ? sector : sector * UDSP_CARD_RECORDER_SECTOR,
+                           UDSP_CARD_SD_R1, NULL);
+
+    for (uint32_t i = 0; i < count && !ret; i++)
+    {
+        ret = udsp_card_sd_block(sd, &data[i * UDSP_CARD_RECORDER_SECTOR]);
+    }
+
+    // CMD12 also ends a transfer after a rejected block
+    ret |= udsp_card_sd_cmd(sd, 12, 0, UDSP_CARD_SD_R1B, NULL);
+
+    if (ret)
+    {
+        sd->errors++;
+        return -1;
+    }
+
+    return 0;
+}
+
+int udsp_card_sd_sync(void *ctx)
+{
+    udsp_card_sd_t *sd = ctx;
+    uint8_t resp[6];
+
+    if (udsp_card_sd_wait_busy(sd) ||
+        udsp_card_sd_cmd(sd, 13, (uint32_t)sd->rca << 16, UDSP_CARD_SD_R1, resp) ||
+        UDSP_CARD_SD_STATUS_STATE(udsp_card_sd_get32(&resp[1])) != UDSP_CARD_SD_STATE_TRAN)
+    {
+        sd->errors++;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file udsp_card_trace.c
+ * @brief Bring-up trace buffer and xscope export for the uDSP-Card.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see https://github.com/crsknr/hw_udsp-card (Hardware repository)
+ */
+
+#include <xscope.h>
+#include <xcore/hwtimer.h>
+
+#include "udsp_card_trace.h"
+
+static udsp_card_trace_entry_t trace_buf[UDSP_CARD_TRACE_DEPTH];
+static uint8_t trace_valid[UDSP_CARD_TRACE_DEPTH]; // Set once the entry of a claimed slot is written
+static unsigned trace_total; // Entries recorded since the last start, including dropped ones
+static unsigned trace_open;  // Set from UDSP_CARD_TRACE_START until UDSP_CARD_TRACE_DONE
+
+/** @brief Mark every slot as unwritten. **/
+static void udsp_card_trace_invalidate()
+{
+    for (unsigned i = 0; i < UDSP_CARD_TRACE_DEPTH; i++)
+    {
+        __atomic_store_n(&trace_valid[i], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/** @brief Number of entries held in the trace buffer. **/
+static unsigned udsp_card_trace_count()
+{
+    unsigned total = __atomic_load_n(&trace_total, __ATOMIC_RELAXED);
+
+    return total < UDSP_CARD_TRACE_DEPTH ? total : UDSP_CARD_TRACE_DEPTH;
+}
+
+void udsp_card_trace_record(udsp_card_trace_event_t event, uint8_t arg0, uint16_t arg1)
+{
+    // Taken before the slot is claimed, a step preempted in between must not stamp a later time
+    uint32_t timestamp = get_reference_time();
+
+    // Only the bring-up window is recorded, runtime register writes must not evict it
+    if (event == UDSP_CARD_TRACE_START)
+    {
+        udsp_card_trace_invalidate();
+        __atomic_store_n(&trace_total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&trace_open, 1, __ATOMIC_RELEASE);
+    }
+    else if (!__atomic_load_n(&trace_open, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    if (event == UDSP_CARD_TRACE_DONE)
+    {
+        __atomic_store_n(&trace_open, 0, __ATOMIC_RELEASE);
+    }
+
+    // Parallel bring-up steps record concurrently, each claims its own slot. A full buffer
+    // keeps the start of the timeline and drops the rest.
+    unsigned slot = __atomic_fetch_add(&trace_total, 1, __ATOMIC_RELAXED);
+    if (slot >= UDSP_CARD_TRACE_DEPTH)
+    {
+        return;
+    }
+    udsp_card_trace_entry_t *entry = &trace_buf[slot];
+
+    entry->timestamp = timestamp;
+    entry->event = event;
+    entry->arg0 = arg0;
+    entry->arg1 = arg1;
+
+    // Publish the entry after its fields
+    __atomic_store_n(&trace_valid[slot], 1, __ATOMIC_RELEASE);
+}
+
+unsigned udsp_card_trace_get(udsp_card_trace_entry_t *entries, unsigned max_entries)
+{
+    unsigned trace_count = udsp_card_trace_count();
+    unsigned n = 0;
+
+    // Slots are claimed in call order, not timestamp order, and a slot may be claimed but not yet written
+    for (unsigned i = 0; i < trace_count && n < max_entries; i++)
+    {
+        if (!__atomic_load_n(&trace_valid[i], __ATOMIC_ACQUIRE))
+        {
+            continue;
+        }
+
+        udsp_card_trace_entry_t entry = trace_buf[i];
+        unsigned j = n++;
+
+        // The timeline spans far less than half the 32 bit timer range, so signed deltas order it across a wrap
+        for (; j > 0 && (int32_t)(entry.timestamp - entries[j - 1].timestamp) < 0; j--)
+        {
+            entries[j] = entries[j - 1];
+        }
+        entries[j] = entry;
+    }
+
+    return n;
+}
+
+void udsp_card_trace_dump()
+{
+    udsp_card_trace_entry_t entries[UDSP_CARD_TRACE_DEPTH];
+    unsigned n = udsp_card_trace_get(entries, UDSP_CARD_TRACE_DEPTH);
+
+    for (unsigned i = 0; i < n; i++)
+    {
+        xscope_bytes(UDSP_CARD_TRACE_XSCOPE_PROBE, sizeof(entries[i]), (const unsigned char *)&entries[i]);
+    }
+
+    udsp_card_trace_clear();
+}
+
+void udsp_card_trace_clear()
+{
+    __atomic_store_n(&trace_open, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&trace_total, 0, __ATOMIC_RELAXED);
+    udsp_card_trace_invalidate();
+}
+
+unsigned udsp_card_trace_dropped()
+{
+    unsigned total = __atomic_load_n(&trace_total, __ATOMIC_RELAXED);
+
+    return total - udsp_card_trace_count();
+}
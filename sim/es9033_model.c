@@ -0,0 +1,362 @@
+/**
+ * @file es9033_model.c
+ * @brief Behavioural register model of the ES9033 for host simulation.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see es9033_model.h
+ */
+
+#include <string.h>
+
+#include <xs1.h>
+
+#include "es9033.h"
+#include "es9033_model.h"
+
+es9033_model_t es9033_model;
+
+/** Access class of every register address. */
+enum
+{
+    ES9033_MODEL_RESERVED = 0,
+    ES9033_MODEL_RW,
+    ES9033_MODEL_WO,
+    ES9033_MODEL_RO,
+};
+
+typedef struct
+{
+    uint8_t reg;
+    uint8_t val;
+} es9033_model_default_t;
+
+/**
+ * Documented writable registers and their reset values, taken from the datasheet
+ * register map independently of the driver's shadow table.
+ */
+static const es9033_model_default_t es9033_model_defaults[] = {
+    {0x00, 0x3C}, {0x01, 0x01}, {0x02, 0x07}, {0x03, 0x07}, {0x04, 0x1F},
+    {0x09, 0x00}, {0x0A, 0x00}, {0x0B, 0x00}, {0x0C, 0x00}, {0x0D, 0x00},
+    {0x0E, 0x00}, {0x0F, 0x60}, {0x10, 0x00}, {0x13, 0xC0}, {0x18, 0x00},
+    {0x19, 0x00}, {0x1A, 0x00}, {0x1B, 0x00}, {0x1C, 0x00}, {0x1D, 0x00},
+    {0x1E, 0x00}, {0x1F, 0x00}, {0x20, 0x00}, {0x21, 0x00}, {0x22, 0x00},
+    {0x23, 0x00}, {0x24, 0x80}, {0x25, 0x01}, {0x26, 0x01}, {0x27, 0x01},
+    {0x28, 0x00}, {0x2A, 0x10}, {0x2C, 0x40}, {0x2D, 0x80}, {0x2E, 0x00},
+    {0x2F, 0x00}, {0x30, 0x96}, {0x31, 0x96}, {0x32, 0x00}, {0x33, 0x00},
+    {0x34, 0x44}, {0x36, 0x00}, {0x37, 0x68}, {0x38, 0x01}, {0x39, 0x8D},
+    {0x3A, 0x00}, {0x3B, 0x68}, {0x3C, 0x01}, {0x3D, 0x8D}, {0x3E, 0x00},
+    {0x3F, 0x0F}, {0x40, 0xD8}, {0x41, 0x08}, {0x42, 0x00}, {0x43, 0x0A},
+    {0x44, 0x00}, {0x45, 0x02}, {0x49, 0xC0}, {0x4A, 0x34}, {0x4B, 0x1A},
+    {0x4C, 0x34}, {0x4D, 0x1A}, {0x4E, 0xF1}, {0x4F, 0x0C}, {0x50, 0x84},
+    {0x51, 0x81}, {0x52, 0xA0}, {0x53, 0x00}, {0x54, 0x00}, {0x55, 0x00},
+    {0x56, 0x00}, {0x57, 0x00}, {0x58, 0x00}, {0xC0, 0x01}, {0xC1, 0x00},
+    {0xC2, 0x00}, {0xC3, 0x00}, {0xC4, 0x00}, {0xC5, 0x00}, {0xC6, 0x00},
+    {0xC7, 0x00}, {0xC8, 0x00}, {0xC9, 0x00}, {0xCA, 0x00}, {0xCB, 0x00},
+};
+
+/** Access class per register address, built from the defaults table. */
+static uint8_t es9033_model_access[256];
+
+static void es9033_model_load(es9033_model_dac_t *dac, uint8_t first, uint8_t last)
+{
+    for (size_t i = 0; i < sizeof(es9033_model_defaults) / sizeof(es9033_model_defaults[0]); i++)
+    {
+        const es9033_model_default_t *d = &es9033_model_defaults[i];
+
+        if (d->reg >= first && d->reg <= last)
+        {
+            dac->regs[d->reg] = d->val;
+        }
+    }
+}
+
+static int es9033_model_clock_ok(uint32_t now)
+{
+    return es9033_model.powered && es9033_model.mclk_freq &&
+           (int32_t)(now - es9033_model.mclk_valid) >= 0;
+}
+
+/**
+ * @brief Channel muted or set to the lowest volume, so it ramps to or sits at VOL_MIN.
+ **/
+static int es9033_model_muted(const uint8_t *r, unsigned ch)
+{
+    return (r[ES9033_REG_MUTE_CTRL] & (ch ? ES9033_BIT_DAC_MUTE_CH2 : ES9033_BIT_DAC_MUTE_CH1)) ||
+           r[ES9033_REG_VOLUME1 + ch] == 0xFF;
+}
+
+/**
+ * @brief Channel has finished its ramp to minimum volume.
+ **/
+static int es9033_model_vol_min(const es9033_model_dac_t *dac, unsigned ch, uint32_t now)
+{
+    return es9033_model_muted(dac->regs, ch) &&
+           (!dac->ramping[ch] || (dac->ramping[ch] > 0 && (int32_t)(now - dac->vol_min_at[ch]) >= 0));
+}
+
+/**
+ * @brief Start the ramp of a channel from an attenuation to minimum volume. Without
+ * an MCLK the ramp does not advance.
+ **/
+static void es9033_model_ramp(es9033_model_dac_t *dac, unsigned ch, uint8_t attenuation, uint32_t now)
+{
+    const uint8_t *r = dac->regs;
+    unsigned rate = r[ES9033_REG_DAC_VOL_DOWN_RATE];
+    unsigned idac_num = (r[ES9033_REG_DAC_CLOCK_CONFIG] & ES9033_MASK_SELECT_IDAC_NUM) + 1;
+    unsigned fs = es9033_model.mclk_freq / (128 * idac_num);
+    uint64_t samples;
+
+    if (!rate)
+    {
+        dac->ramping[ch] = 0;
+        return;
+    }
+
+    samples = ((0xFF - attenuation) * ES9033_MODEL_RAMP_UNITS + rate - 1) / rate;
+    dac->ramping[ch] = fs ? 1 : -1;
+    dac->vol_min_at[ch] = fs ? now + (uint32_t)(samples * XS1_TIMER_HZ / fs) : now;
+}
+
+/**
+ * @brief Compute the live value of a read-only register.
+ **/
+static uint8_t es9033_model_status(es9033_model_dac_t *dac, uint8_t reg, uint32_t now)
+{
+    const uint8_t *r = dac->regs;
+    uint8_t state = 0;
+    uint8_t state2 = 0;
+
+    if (es9033_model_vol_min(dac, 0, now))
+    {
+        state |= ES9033_BIT_VOL_MIN_CH1;
+    }
+    if (es9033_model_vol_min(dac, 1, now))
+    {
+        state |= ES9033_BIT_VOL_MIN_CH2;
+    }
+    if (es9033_model_clock_ok(now))
+    {
+        state2 |= ES9033_BIT_CLK_AVALID_INT;
+        if (r[ES9033_REG_PLL2] & (ES9033_BIT_PLL_BYPASS | ES9033_BIT_EN_PLL_CLKIN))
+        {
+            state2 |= ES9033_BIT_PLL_LOCKED_R_INT;
+        }
+    }
+    dac->source[0] |= state;
+    dac->source[1] |= state2;
+
+    switch (reg)
+    {
+    case ES9033_REG_SYS_READ:
+        return (dac - es9033_model.dacs) << 1;
+    case ES9033_REG_CHIP_ID:
+        return ES9033_MODEL_CHIP_ID;
+    case ES9033_REG_INTERRUPT_STATE:
+        return state;
+    case ES9033_REG_INTERRUPT_STATE2:
+        return state2;
+    case ES9033_REG_INTERRUPT_SOURCE:
+        return dac->source[0];
+    case ES9033_REG_INTERRUPT_SOURCE2:
+        return dac->source[1];
+    case ES9033_REG_AUTO_TUNING_READ:
+        return (es9033_model_clock_ok(now) ? ES9033_BIT_RATIO_VALID : 0) |
+               (r[ES9033_REG_DAC_CLOCK_CONFIG] & (ES9033_BIT_SELECT_IDAC_HALF | ES9033_MASK_SELECT_IDAC_NUM));
+    case ES9033_REG_DAC_STATUS_READ:
+        return state;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Apply the side effects of a register write.
+ **/
+static void es9033_model_store(es9033_model_dac_t *dac, uint8_t reg, uint8_t val, uint32_t now)
+{
+    int muted[2] = {es9033_model_muted(dac->regs, 0), es9033_model_muted(dac->regs, 1)};
+    uint8_t volume[2] = {dac->regs[ES9033_REG_VOLUME1], dac->regs[ES9033_REG_VOLUME2]};
+
+    dac->regs[reg] = val;
+
+    // A channel that starts muting ramps down from the volume it played at
+    for (unsigned ch = 0; ch < 2; ch++)
+    {
+        if (!muted[ch] && es9033_model_muted(dac->regs, ch))
+        {
+            es9033_model_ramp(dac, ch, volume[ch], now);
+        }
+        else if (!es9033_model_muted(dac->regs, ch))
+        {
+            dac->ramping[ch] = 0;
+        }
+    }
+
+    switch (reg)
+    {
+    case ES9033_REG_SYSTEM_CONFIG:
+        if (val & ES9033_BIT_SOFT_RESET)
+        {
+            es9033_model_load(dac, 0x00, ES9033_REG_MASTER_TRIM);
+            memset(dac->ramping, 0, sizeof(dac->ramping));
+        }
+        break;
+    case ES9033_REG_INTERRUPT_CLEAR_LSB:
+        dac->source[0] &= ~val;
+        break;
+    case ES9033_REG_INTERRUPT_CLEAR_MSB:
+        dac->source[1] &= ~val;
+        break;
+    case ES9033_REG_RESET_PLL1:
+        if (val & ES9033_BIT_AO_SOFT_RESET)
+        {
+            es9033_model_load(dac, ES9033_REG_RESET_PLL1, ES9033_REG_PLL8);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void es9033_model_reset(void)
+{
+    memset(&es9033_model, 0, sizeof(es9033_model));
+    memset(es9033_model_access, ES9033_MODEL_RESERVED, sizeof(es9033_model_access));
+
+    for (size_t i = 0; i < sizeof(es9033_model_defaults) / sizeof(es9033_model_defaults[0]); i++)
+    {
+        uint8_t reg = es9033_model_defaults[i].reg;
+
+        es9033_model_access[reg] = reg <= ES9033_REG_MASTER_TRIM ? ES9033_MODEL_RW : ES9033_MODEL_WO;
+    }
+    for (unsigned reg = ES9033_REG_SYS_READ; reg <= ES9033_REG_DRE_STATUS_READ; reg++)
+    {
+        es9033_model_access[reg] = ES9033_MODEL_RO;
+    }
+
+    es9033_model_fit(ES9033_MODEL_DEFAULT);
+}
+
+void es9033_model_fit(unsigned pins)
+{
+    es9033_model_dac_t *dac = &es9033_model.dacs[pins & 0x03];
+
+    memset(dac, 0, sizeof(*dac));
+    dac->fitted = 1;
+    es9033_model_load(dac, 0x00, 0xFF);
+}
+
+void es9033_model_power(int enable)
+{
+    if (enable && !es9033_model.powered)
+    {
+        for (unsigned i = 0; i < ES9033_MODEL_DACS; i++)
+        {
+            es9033_model_dac_t *dac = &es9033_model.dacs[i];
+
+            es9033_model_load(dac, 0x00, 0xFF);
+            memset(dac->source, 0, sizeof(dac->source));
+            memset(dac->ramping, 0, sizeof(dac->ramping));
+        }
+    }
+    es9033_model.powered = enable != 0;
+}
+
+void es9033_model_mclk(unsigned freq, uint32_t now)
+{
+    es9033_model.mclk_freq = freq;
+    es9033_model.mclk_valid = now + ES9033_MODEL_CLOCK_DETECT_US * 100;
+}
+
+/**
+ * @brief Find the DAC answering on a device address in the current state.
+ * @return The DAC, NULL if the address is NACKed.
+ **/
+static es9033_model_dac_t *es9033_model_ack(uint8_t addr, uint32_t now)
+{
+    es9033_model_dac_t *dac = &es9033_model.dacs[addr & 0x03];
+    int rw = addr == ES9033_I2C_ADDR(addr);
+
+    es9033_model.transactions++;
+
+    if (!es9033_model.powered || !dac->fitted ||
+        (addr != ES9033_I2C_ADDR(addr) && addr != ES9033_I2C_ADDR_SS(addr)) ||
+        (rw && !es9033_model_clock_ok(now)))
+    {
+        es9033_model.nacks++;
+        return NULL;
+    }
+    return dac;
+}
+
+size_t es9033_model_write(uint8_t addr, const uint8_t *buf, size_t n, uint32_t now)
+{
+    es9033_model_dac_t *dac = es9033_model_ack(addr, now);
+
+    if (!dac)
+    {
+        return 0;
+    }
+    if (n == 0)
+    {
+        return 0;
+    }
+
+    uint8_t reg = buf[0];
+    uint8_t access = addr == ES9033_I2C_ADDR(addr) ? ES9033_MODEL_RW : ES9033_MODEL_WO;
+
+    // The address byte alone sets the read pointer of the R/W bank
+    if (access == ES9033_MODEL_RW)
+    {
+        dac->ptr = reg;
+    }
+
+    for (size_t i = 1; i < n; i++, reg++)
+    {
+        if (es9033_model_access[reg] != access)
+        {
+            // Writes to read-only, reserved or other-bank registers are ignored by the silicon
+            es9033_model.violations++;
+            continue;
+        }
+        es9033_model_store(dac, reg, buf[i], now);
+    }
+
+    return n;
+}
+
+int es9033_model_read(uint8_t addr, uint8_t *buf, size_t n, uint32_t now)
+{
+    es9033_model_dac_t *dac = es9033_model_ack(addr, now);
+
+    if (!dac)
+    {
+        return -1;
+    }
+    if (addr == ES9033_I2C_ADDR_SS(addr))
+    {
+        // The slave bank is write-only, the read returns bus idle level
+        es9033_model.violations++;
+        memset(buf, 0xFF, n);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++, dac->ptr++)
+    {
+        switch (es9033_model_access[dac->ptr])
+        {
+        case ES9033_MODEL_RW:
+            buf[i] = dac->regs[dac->ptr];
+            break;
+        case ES9033_MODEL_RO:
+            buf[i] = es9033_model_status(dac, dac->ptr, now);
+            break;
+        default:
+            es9033_model.violations++;
+            buf[i] = 0;
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file es9033_model.h
+ * @brief Behavioural register model of the ES9033 for host simulation.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see es9033.h
+ *
+ * Each fitted DAC answers on both I2C addresses of its address pin setting and the
+ * model enforces the same rules as the silicon: the R/W and R-only registers only
+ * respond while DAC_EN is high and a system clock is present, the slave registers are
+ * write-only and do not need a clock, and registers are auto-incremented per byte.
+ * Accesses the real part would not honour are counted as violations instead of
+ * silently succeeding. A mute ramps the volume down at DAC_VOL_DOWN_RATE and the
+ * sample rate set by the MCLK and SELECT_IDAC_NUM, VOL_MIN is only reported once
+ * the ramp has finished.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "es9033.h"
+
+/** @defgroup ES9033_Model ES9033 Register Model
+ *  @brief Reset defaults, access rules and counters of the simulated DAC.
+ *  @{
+ */
+#define ES9033_MODEL_CHIP_ID 0x88 // Value returned by the CHIP_ID register of the model
+#define ES9033_MODEL_CLOCK_DETECT_US 200 // Time from MCLK start until the DAC reports CLK_AVALID
+#define ES9033_MODEL_DACS 4 // One DAC per address pin setting
+#define ES9033_MODEL_DEFAULT (ES9033_I2C_DEVICE_ADDR & 0x03) // Address pins of the DAC on the board
+#define ES9033_MODEL_RAMP_UNITS 256 // Ramp units per 0.5dB VOLUME step, DAC_VOL_DOWN_RATE units per sample are assumed
+
+typedef struct
+{
+    int fitted;        // DAC present at this address pin setting
+    uint8_t regs[256]; // Register file, indexed by register address
+    uint8_t ptr;       // Register pointer of the R/W bank, set by the address byte of a write
+    uint8_t source[2]; // Latched interrupt sources, cleared through INTERRUPT_CLEAR
+    int ramping[2];          // Channel ramps down to minimum volume after a mute or a VOLUME of 0xFF
+    uint32_t vol_min_at[2];  // Reference time at which the ramp reaches minimum volume and VOL_MIN is set
+} es9033_model_dac_t;
+
+typedef struct
+{
+    es9033_model_dac_t dacs[ES9033_MODEL_DACS]; // Indexed by the address pins
+    int powered;           // DAC_EN pin state, shared by all DACs
+    unsigned mclk_freq;    // MCLK frequency at the DACs, 0 when stopped
+    uint32_t mclk_valid;   // Reference time at which the clock detector reports CLK_AVALID
+    unsigned transactions; // Addressed transactions, ACKed or not
+    unsigned nacks;        // Transactions NACKed by the model
+    unsigned violations;   // Accesses the silicon would not honour
+} es9033_model_t;
+
+extern es9033_model_t es9033_model;
+
+/**
+ * @brief Power-on reset of the model. Only the DAC of the board is fitted. Loads
+ * the register defaults and clears the counters.
+ */
+void es9033_model_reset(void);
+
+/**
+ * @brief Fit an additional DAC, e.g. of an expansion board, on the shared bus.
+ * @param pins Address pin setting 0-3.
+ */
+void es9033_model_fit(unsigned pins);
+
+/**
+ * @brief Drive the DAC_EN pin. A rising edge resets the register file.
+ * @param enable Non-zero to power the DAC.
+ */
+void es9033_model_power(int enable);
+
+/**
+ * @brief Change the MCLK at the DAC input.
+ * @param freq New MCLK frequency in Hz, 0 to stop the clock.
+ * @param now Reference time of the change, the clock detector settles from here.
+ */
+void es9033_model_mclk(unsigned freq, uint32_t now);
+
+/**
+ * @brief Handle an I2C write transaction addressed to the model.
+ * @param addr 7-bit device address.
+ * @param buf Register address followed by the data bytes.
+ * @param n Number of bytes in buf.
+ * @param now Current reference time.
+ * @return Number of bytes ACKed, 0 if the address was NACKed.
+ */
+size_t es9033_model_write(uint8_t addr, const uint8_t *buf, size_t n, uint32_t now);
+
+/**
+ * @brief Handle an I2C read transaction addressed to the model. Reads start at the
+ * register address set by the preceding write.
+ * @param addr 7-bit device address.
+ * @param buf Buffer receiving the register values.
+ * @param n Number of bytes to read.
+ * @param now Current reference time.
+ * @return 0 if ACKed, -1 if the address was NACKed.
+ */
+int es9033_model_read(uint8_t addr, uint8_t *buf, size_t n, uint32_t now);
+/** @} */
@@ -0,0 +1,480 @@
+/**
+ * @file es9033_sim_bench.c
+ * @brief Runs the board bring-up, a sample rate change, a volume burst, DAC
+ * suspend/resume cycles, I2C speed changes, a four DAC group, a status and
+ * register readback and scheduler tables with a failing step and a dependency
+ * cycle against the ES9033 model and reports transaction counts and modelled bus
+ * and boot time.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see sim.h
+ *
+ * Exits non-zero if any step fails, the model saw an access the silicon would not
+ * honour, or the driver's register shadow disagrees with the model's register file.
+ * Usage: es9033_sim_bench [trace.bin]
+ */
+
+#include <stdio.h>
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+
+#include "es9033.h"
+#include "udsp_card_board.h"
+#include "udsp_card_init.h"
+#include "udsp_card_trace.h"
+
+#include "es9033_model.h"
+#include "sim.h"
+
+#define SIM_BENCH_VOLUME_REQUESTS 1000 // Volume requests posted during the burst
+#define SIM_BENCH_VOLUME_PERIOD_US 50  // Spacing of the volume requests
+#define SIM_BENCH_MONITOR_POLL_US 1000 // Poll period of the monitor, as UDSP_CARD_CTRL_MONITOR_POLL_US
+
+static int sim_bench_failures;
+
+typedef struct
+{
+    sim_i2c_stats_t bus;
+    unsigned nacks;
+    unsigned violations;
+    uint64_t start;
+} sim_bench_mark_t;
+
+static void sim_bench_begin(sim_bench_mark_t *mark)
+{
+    mark->bus = sim_i2c_stats;
+    mark->nacks = es9033_model.nacks;
+    mark->violations = es9033_model.violations;
+    mark->start = sim_time();
+}
+
+/**
+ * @brief Print the bus activity since sim_bench_begin() and record a failure if needed.
+ **/
+static void sim_bench_end(const sim_bench_mark_t *mark, const char *name, int ret)
+{
+    unsigned violations = es9033_model.violations - mark->violations;
+
+    printf("%-22s %6s %6u %6u %6u %10.1f %10.1f %6u\n", name, ret ? "FAIL" : "ok",
+           sim_i2c_stats.transactions - mark->bus.transactions,
+           sim_i2c_stats.bytes - mark->bus.bytes,
+           es9033_model.nacks - mark->nacks,
+           (double)(sim_i2c_stats.bus_ticks - mark->bus.bus_ticks) / XS1_TIMER_MHZ,
+           (double)(sim_time() - mark->start) / XS1_TIMER_MHZ,
+           violations);
+
+    sim_bench_failures += ret != 0 || violations != 0;
+}
+
+static uint64_t sim_bench_elapsed(const sim_bench_mark_t *mark)
+{
+    return sim_time() - mark->start;
+}
+
+/**
+ * @brief Compare the register shadow of a device against the register file of its model DAC.
+ **/
+static void sim_bench_check_dev(const char *name, es9033_dev_t *dev)
+{
+    const uint8_t *regs = es9033_model.dacs[dev->addr & 0x03].regs;
+    unsigned mismatches = 0;
+
+    for (unsigned reg = 0; reg <= 0xFF; reg++)
+    {
+        if (!ES9033_WRITABLE(reg, 1) || es9033_dev_reg_set(dev, reg, es9033_dev_reg_get(dev, reg)) != 0)
+        {
+            continue;
+        }
+        if (es9033_dev_reg_get(dev, reg) != regs[reg])
+        {
+            printf("  %s: dac 0x%02X reg 0x%02X shadow 0x%02X model 0x%02X\n", name, dev->addr, reg,
+                   es9033_dev_reg_get(dev, reg), regs[reg]);
+            mismatches++;
+        }
+    }
+
+    sim_bench_failures += mismatches != 0;
+}
+
+/**
+ * @brief Compare the driver's register shadow against the model's register file.
+ **/
+static void sim_bench_check_shadow(const char *name)
+{
+    sim_bench_check_dev(name, es9033_dev_default());
+}
+
+/**
+ * @brief Scheduler test step: waits, counts its runs and returns a preset result.
+ **/
+typedef struct
+{
+    unsigned delay_us;
+    int ret;
+    unsigned runs;
+} sim_bench_step_t;
+
+static UDSP_CARD_INIT_FN int sim_bench_step(void *arg)
+{
+    sim_bench_step_t *step = arg;
+
+    delay_microseconds(step->delay_us);
+    step->runs++;
+
+    return step->ret;
+}
+
+/**
+ * @brief Run a scheduler table and check its result, the failed steps and the steps that ran.
+ * @return 0 if all match.
+ **/
+static int sim_bench_init_table(const udsp_card_init_step_t *steps, unsigned num, int ret, uint32_t failed,
+                                uint32_t ran)
+{
+    udsp_card_init_t init;
+    uint32_t runs = 0;
+
+    if (udsp_card_init_run(&init, steps, num) != ret || init.failed != failed)
+    {
+        return -1;
+    }
+    for (unsigned i = 0; i < num; i++)
+    {
+        runs |= ((sim_bench_step_t *)steps[i].arg)->runs ? UDSP_CARD_INIT_DEP(i) : 0;
+    }
+
+    return runs == ran ? 0 : -1;
+}
+
+/**
+ * @brief Check that the trace holds the bring-up window only, from START to DONE, in timestamp order.
+ **/
+static void sim_bench_check_trace(void)
+{
+    udsp_card_trace_entry_t entries[UDSP_CARD_TRACE_DEPTH];
+    unsigned n = udsp_card_trace_get(entries, UDSP_CARD_TRACE_DEPTH);
+    unsigned dropped = udsp_card_trace_dropped();
+    int ok = n > 1 && entries[0].event == UDSP_CARD_TRACE_START && entries[n - 1].event == UDSP_CARD_TRACE_DONE &&
+             dropped == 0;
+
+    for (unsigned i = 1; i < n; i++)
+    {
+        ok = ok && (int32_t)(entries[i].timestamp - entries[i - 1].timestamp) >= 0;
+    }
+
+    printf("  trace: %u entries, %u dropped, %s\n", n, dropped, ok ? "bring-up window" : "MISMATCH");
+    sim_bench_failures += !ok;
+}
+
+/**
+ * @brief Bus speed fallbacks so far, over all speeds.
+ **/
+static unsigned sim_bench_fallbacks(void)
+{
+    udsp_card_i2c_speed_stats_t speeds[UDSP_CARD_I2C_SPEEDS];
+    unsigned fallbacks = 0;
+
+    udsp_card_i2c_speed_stats_get(speeds);
+    for (unsigned i = 0; i < UDSP_CARD_I2C_SPEEDS; i++)
+    {
+        fallbacks += speeds[i].fallbacks;
+    }
+
+    return fallbacks;
+}
+
+static unsigned sim_bench_set_mclk_calls;
+
+static void sim_bench_set_mclk(unsigned mclk_freq)
+{
+    sim_bench_set_mclk_calls++;
+}
+
+/**
+ * @brief Cycle DAC_EN of the model, the DACs detect the running MCLK again afterwards.
+ **/
+static void sim_bench_power_cycle(void)
+{
+    es9033_model_power(0);
+    es9033_model_power(1);
+    es9033_model_mclk(es9033_model.mclk_freq, get_reference_time());
+}
+
+int main(int argc, char *argv[])
+{
+    sim_bench_mark_t mark;
+    es9033_volume_t vol;
+    es9033_monitor_t mon;
+    udsp_card_dac_power_stats_t power;
+    udsp_card_i2c_speed_stats_t speeds[UDSP_CARD_I2C_SPEEDS];
+    es9033_dev_t devs[3];
+    es9033_group_t group;
+    es9033_status_t status;
+    es9033_status_info_t info;
+    es9033_dump_t dump;
+    es9033_dump_t expected;
+    unsigned mclk_freq;
+    unsigned fallbacks;
+    unsigned transactions;
+    uint64_t seq[2];
+    uint64_t par[2];
+    unsigned diffs;
+    int ret;
+
+    sim_reset();
+
+    printf("%-22s %6s %6s %6s %6s %10s %10s %6s\n", "step", "result", "xfers", "bytes", "nacks", "bus [us]",
+           "time [us]", "viol");
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_devices_init();
+    sim_bench_end(&mark, "devices_init", ret);
+    sim_bench_check_shadow("devices_init");
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_set_sample_rate(44100);
+    sim_bench_end(&mark, "set_sample_rate 44k1", ret);
+    sim_bench_check_shadow("set_sample_rate 44k1");
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_set_sample_rate(96000);
+    sim_bench_end(&mark, "set_sample_rate 96k", ret);
+    sim_bench_check_shadow("set_sample_rate 96k");
+
+    // Rejected before the bus, so the control thread has nothing to recover
+    sim_bench_begin(&mark);
+    ret = udsp_card_set_sample_rate(12345) == 0 || sim_i2c_stats.transactions != mark.bus.transactions;
+    sim_bench_end(&mark, "set_sample_rate 12345", ret);
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_set_sample_rate(0) == 0 || sim_i2c_stats.transactions != mark.bus.transactions;
+    sim_bench_end(&mark, "set_sample_rate 0", ret);
+
+    es9033_volume_init(&vol);
+    sim_bench_begin(&mark);
+    ret = 0;
+    for (int i = 0; i < SIM_BENCH_VOLUME_REQUESTS; i++)
+    {
+        es9033_volume_set(&vol, ES9033_CH1 | ES9033_CH2, -(i % 600));
+        ret |= es9033_volume_service(&vol, udsp_card_i2c_ctx()) < 0;
+        delay_microseconds(SIM_BENCH_VOLUME_PERIOD_US);
+    }
+    delay_microseconds(ES9033_VOLUME_SLOT_US);
+    ret |= es9033_volume_service(&vol, udsp_card_i2c_ctx()) < 0;
+    sim_bench_end(&mark, "volume burst", ret);
+    printf("  %u requests coalesced into %u writes\n", vol.requests, vol.writes);
+    sim_bench_check_shadow("volume burst");
+
+    // A poll that is due waits for a pending volume burst and runs on the next service
+    es9033_monitor_init(&mon, 0, 0, SIM_BENCH_MONITOR_POLL_US, NULL);
+    es9033_monitor_defer(&mon, &vol);
+    ret = es9033_monitor_arm(&mon, udsp_card_i2c_ctx());
+    delay_microseconds(SIM_BENCH_MONITOR_POLL_US + ES9033_VOLUME_SLOT_US);
+    sim_bench_begin(&mark);
+    es9033_volume_set(&vol, ES9033_CH1 | ES9033_CH2, -100);
+    ret |= es9033_monitor_service(&mon, udsp_card_i2c_ctx()) != 0 || mon.deferred != 1 ||
+           sim_i2c_stats.transactions != mark.bus.transactions;
+    ret |= es9033_volume_service(&vol, udsp_card_i2c_ctx()) != 1;
+    transactions = sim_i2c_stats.transactions;
+    ret |= es9033_monitor_service(&mon, udsp_card_i2c_ctx()) < 0 || sim_i2c_stats.transactions == transactions;
+    sim_bench_end(&mark, "monitor after volume", ret);
+    sim_bench_check_shadow("monitor after volume");
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_dac_power(UDSP_CARD_DAC_SUSPEND);
+    sim_bench_end(&mark, "dac suspend", ret);
+    sim_bench_check_shadow("dac suspend");
+
+    // A suspended DAC cannot mute, so neither the MCLK nor the sample rate may change
+    mclk_freq = es9033_model.mclk_freq;
+    sim_bench_begin(&mark);
+    ret = udsp_card_set_sample_rate(44100) == 0 || es9033_model.mclk_freq != mclk_freq ||
+          udsp_card_get_sample_rate() != 96000 || sim_i2c_stats.transactions != mark.bus.transactions;
+    sim_bench_end(&mark, "rate while suspended", ret);
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_dac_power(UDSP_CARD_DAC_ON);
+    sim_bench_end(&mark, "dac resume", ret);
+    sim_bench_check_shadow("dac resume");
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_dac_power(UDSP_CARD_DAC_OFF);
+    sim_bench_end(&mark, "dac off", ret);
+
+    // The driver itself leaves the clock alone once the mute has failed on the bus
+    sim_bench_set_mclk_calls = 0;
+    sim_bench_begin(&mark);
+    ret = es9033_set_sample_rate(udsp_card_i2c_ctx(), UDSP_CARD_MCLK_FREQUENCY_44K1, 44100,
+                                 sim_bench_set_mclk) == 0 || sim_bench_set_mclk_calls != 0;
+    sim_bench_end(&mark, "es9033 rate while off", ret);
+
+    // Without a DAC to answer the handshake, the speed must neither change nor fall back
+    sim_bench_begin(&mark);
+    ret = udsp_card_i2c_set_speed(1000) == 0 || udsp_card_i2c_get_speed() != UDSP_CARD_I2C_KBPS;
+    sim_bench_end(&mark, "i2c speed while off", ret);
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_dac_power(UDSP_CARD_DAC_ON);
+    sim_bench_end(&mark, "dac resume from off", ret);
+    sim_bench_check_shadow("dac resume from off");
+
+    udsp_card_dac_power_stats_get(&power);
+    printf("  %u resumes, last %u us, max %u us\n", power.resumes, power.resume_us, power.resume_max_us);
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_i2c_set_speed(1000);
+    sim_bench_end(&mark, "i2c 1000 kbps", ret);
+
+    sim_bench_begin(&mark);
+    ret = udsp_card_i2c_set_speed(UDSP_CARD_I2C_KBPS);
+    sim_bench_end(&mark, "i2c default speed", ret);
+
+    // A missing MCLK is not a bus fault, the speed must neither change nor fall back
+    fallbacks = sim_bench_fallbacks();
+    sim_pll_fault(1);
+    sim_bench_begin(&mark);
+    sim_bench_power_cycle();
+    ret = udsp_card_devices_init() == 0 || udsp_card_i2c_get_speed() != UDSP_CARD_I2C_KBPS ||
+          sim_bench_fallbacks() != fallbacks;
+    sim_bench_end(&mark, "init without mclk", ret);
+
+    sim_pll_fault(0);
+    sim_bench_begin(&mark);
+    sim_bench_power_cycle();
+    ret = udsp_card_devices_init() || sim_bench_fallbacks() != fallbacks;
+    sim_bench_end(&mark, "init after pll fault", ret);
+    sim_bench_check_shadow("init after pll fault");
+
+    udsp_card_i2c_speed_stats_get(speeds);
+    for (unsigned i = 0; i < UDSP_CARD_I2C_SPEEDS; i++)
+    {
+        printf("  %4u kbps: %u transactions, %u errors, %u retries, %u fallbacks\n", speeds[i].kbps,
+               speeds[i].transactions, speeds[i].errors, speeds[i].retries, speeds[i].fallbacks);
+    }
+
+    // Expansion board: three more DACs on the system bus, sharing DAC_EN and the MCLK
+    es9033_group_init(&group);
+    es9033_group_add(&group, es9033_dev_default());
+    for (unsigned i = 0; i < 3; i++)
+    {
+        es9033_model_fit(i);
+        es9033_dev_init(&devs[i], i);
+        es9033_group_add(&group, &devs[i]);
+    }
+
+    // The MCLK restarts inside the window, so every init pays the clock detect wait
+    sim_bench_begin(&mark);
+    sim_bench_power_cycle();
+    ret = es9033_init_profile(udsp_card_i2c_ctx(), &es9033_profile_192k);
+    sim_bench_end(&mark, "dac init x1", ret);
+
+    // One device after the other pays every wait N times, the group writes all
+    // devices before it waits once on each
+    sim_bench_begin(&mark);
+    sim_bench_power_cycle();
+    ret = 0;
+    for (unsigned i = 0; i < group.num && !ret; i++)
+    {
+        ret = es9033_dev_init_profile(group.devs[i], udsp_card_i2c_ctx(), &es9033_profile_192k);
+    }
+    sim_bench_end(&mark, "dac init x4 seq", ret);
+    seq[0] = sim_bench_elapsed(&mark);
+
+    sim_bench_begin(&mark);
+    sim_bench_power_cycle();
+    ret = es9033_group_init_profile(&group, udsp_card_i2c_ctx(), &es9033_profile_192k);
+    sim_bench_end(&mark, "group init x4", ret);
+    par[0] = sim_bench_elapsed(&mark);
+
+    sim_bench_begin(&mark);
+    ret = 0;
+    for (unsigned i = 0; i < group.num && !ret; i++)
+    {
+        ret = es9033_dev_set_sample_rate(group.devs[i], udsp_card_i2c_ctx(), 49152000, 96000, NULL);
+    }
+    sim_bench_end(&mark, "dac 96k x4 seq", ret);
+    seq[1] = sim_bench_elapsed(&mark);
+
+    ret = es9033_group_set_sample_rate(&group, udsp_card_i2c_ctx(), 49152000, 192000, NULL);
+    sim_bench_begin(&mark);
+    ret |= es9033_group_set_sample_rate(&group, udsp_card_i2c_ctx(), 49152000, 96000, NULL);
+    sim_bench_end(&mark, "group 96k x4", ret);
+    par[1] = sim_bench_elapsed(&mark);
+
+    printf("  group saves %.1f us on init, %.1f us on retune\n", (double)(seq[0] - par[0]) / XS1_TIMER_MHZ,
+           (double)(seq[1] - par[1]) / XS1_TIMER_MHZ);
+    sim_bench_failures += par[0] >= seq[0] || par[1] >= seq[1];
+
+    for (unsigned i = 0; i < group.num; i++)
+    {
+        sim_bench_check_dev("group", group.devs[i]);
+    }
+
+    sim_bench_begin(&mark);
+    ret = es9033_status_read(udsp_card_i2c_ctx(), &status);
+    es9033_status_decode(&status, &info);
+    ret |= !info.clk_valid || !info.ratio_valid || info.addr_pins != ES9033_MODEL_DEFAULT;
+    sim_bench_end(&mark, "status snapshot", ret);
+    printf("  chip 0x%02X, pins %u, clock %s, IDAC divider %u\n", info.chip_id, info.addr_pins,
+           info.pll_locked ? "locked" : "unlocked", info.idac_div);
+
+    sim_bench_begin(&mark);
+    ret = es9033_dump(udsp_card_i2c_ctx(), &dump);
+    es9033_dump_shadow(&expected);
+    diffs = es9033_dump_diff(&dump, &expected);
+    ret |= diffs != 0;
+    sim_bench_end(&mark, "register dump", ret);
+    es9033_dump_profile(&expected, &es9033_profile_96k);
+    diffs = es9033_dump_diff(&dump, &expected);
+    printf("  %u registers differ from the 96k profile\n", diffs);
+    sim_bench_check_trace();
+
+    // Scheduler: independent steps overlap, failures and cycles end the run instead of hanging it
+    {
+        sim_bench_step_t a = {500, 0}, b = {500, 0}, c = {100, -1}, d = {100, 0}, e = {100, 0}, f = {100, 0};
+        const udsp_card_init_step_t par[] = {{sim_bench_step, &a, 0}, {sim_bench_step, &b, 0}};
+        const udsp_card_init_step_t fail[] = {{sim_bench_step, &c, 0}, {sim_bench_step, &d, UDSP_CARD_INIT_DEP(0)}};
+        const udsp_card_init_step_t cycle[] = {{sim_bench_step, &e, UDSP_CARD_INIT_DEP(1)},
+                                               {sim_bench_step, &f, UDSP_CARD_INIT_DEP(0)},
+                                               {sim_bench_step, &a, 0}};
+        uint64_t start = sim_time();
+
+        sim_bench_begin(&mark);
+        ret = sim_bench_init_table(par, 2, 0, 0, 0x3);
+        ret |= UDSP_CARD_INIT_THREADS > 1 && sim_time() - start > 500 * XS1_TIMER_MHZ + 10 * XS1_TIMER_MHZ;
+        sim_bench_end(&mark, "init 2x 500us", ret);
+
+        sim_bench_begin(&mark);
+        ret = sim_bench_init_table(fail, 2, -1, 0x3, 0x1);
+        sim_bench_end(&mark, "init failing step", ret);
+
+        sim_bench_begin(&mark);
+        a.runs = 0;
+        ret = sim_bench_init_table(cycle, 3, -1, 0x3, 0x4);
+        sim_bench_end(&mark, "init dependency cycle", ret);
+    }
+
+    if (argc > 1)
+    {
+        size_t len;
+        const uint8_t *data;
+        FILE *f = fopen(argv[1], "wb");
+
+        udsp_card_trace_dump();
+        data = sim_xscope_data(&len);
+        if (!f || fwrite(data, 1, len, f) != len)
+        {
+            printf("cannot write %s\n", argv[1]);
+            sim_bench_failures++;
+        }
+        if (f)
+        {
+            fclose(f);
+        }
+    }
+
+    printf("%s\n", sim_bench_failures ? "FAILED" : "PASSED");
+
+    return sim_bench_failures ? 1 : 0;
+}
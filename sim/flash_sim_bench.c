@@ -0,0 +1,209 @@
+/**
+ * @file flash_sim_bench.c
+ * @brief Packs a flash data store with tools/udsp_card_flash_pack.py and reads it
+ * back through udsp_card_flash.h from RAM.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see udsp_card_flash.h
+ *
+ * The DAC profile is written out from es9033_profile_48k, so the record read back
+ * must match the C es9033_profile_t byte for byte. Exits non-zero if the packer
+ * fails, a record does not read back as packed, or a corrupted store is accepted.
+ * Usage: flash_sim_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "es9033.h"
+#include "udsp_card_flash.h"
+
+#ifndef SIM_BENCH_DIR
+#define SIM_BENCH_DIR "." // Directory of the packer input and output, set to the build directory by CMake
+#endif
+
+#ifndef SIM_BENCH_PYTHON
+#define SIM_BENCH_PYTHON "python3"
+#endif
+
+#ifndef SIM_BENCH_PACK
+#define SIM_BENCH_PACK "../tools/udsp_card_flash_pack.py"
+#endif
+
+#define SIM_BENCH_STR(x) SIM_BENCH_STR_(x)
+#define SIM_BENCH_STR_(x) #x
+
+#define SIM_BENCH_REVISION 3
+#define SIM_BENCH_COEFFS 37       // Coefficients in the table
+#define SIM_BENCH_CALIBRATION 13  // Calibration bytes, not a multiple of 4
+#define SIM_BENCH_STORE_MAX 4096  // Bytes reserved for the packed store
+
+static int sim_bench_failures;
+
+static int32_t sim_bench_coeff(unsigned i)
+{
+    return (int32_t)(i * 7919u) - 100000;
+}
+
+static void sim_bench_check(const char *name, int ok)
+{
+    printf("%-22s %6s\n", name, ok ? "ok" : "FAIL");
+    sim_bench_failures += !ok;
+}
+
+/**
+ * @brief Write a profile in the text format of udsp_card_flash_pack.py.
+ **/
+static int sim_bench_write_profile(const char *path, const es9033_profile_t *profile)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f)
+    {
+        return -1;
+    }
+
+    fprintf(f, "%u %u\n", profile->mclk_freq, profile->fs);
+    for (unsigned i = 0; i < ES9033_PROFILE_STEPS; i++)
+    {
+        const es9033_step_t *step = &profile->steps[i];
+
+        fprintf(f, "0x%02x 0x%02x 0x%02x %u", step->addr, step->reg, step->wait_mask, step->delay_us);
+        for (unsigned v = 0; v < step->len; v++)
+        {
+            fprintf(f, " 0x%02x", step->vals[v]);
+        }
+        fprintf(f, "\n");
+    }
+
+    return fclose(f);
+}
+
+static int sim_bench_write_inputs(void)
+{
+    uint8_t cal[SIM_BENCH_CALIBRATION];
+    FILE *f;
+
+    if (sim_bench_write_profile(SIM_BENCH_DIR "/flash_dac_48k.txt", &es9033_profile_48k))
+    {
+        return -1;
+    }
+
+    if (!(f = fopen(SIM_BENCH_DIR "/flash_coeffs.txt", "w")))
+    {
+        return -1;
+    }
+    fprintf(f, "# test table\n");
+    for (unsigned i = 0; i < SIM_BENCH_COEFFS; i++)
+    {
+        fprintf(f, "%d%s", sim_bench_coeff(i), i % 8 == 7 ? "\n" : " ");
+    }
+    if (fclose(f))
+    {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < sizeof(cal); i++)
+    {
+        cal[i] = 0xA0 + i;
+    }
+    if (!(f = fopen(SIM_BENCH_DIR "/flash_cal.bin", "wb")) || fwrite(cal, 1, sizeof(cal), f) != sizeof(cal))
+    {
+        return -1;
+    }
+
+    return fclose(f);
+}
+
+/**
+ * @brief Read the packed store into word aligned RAM.
+ * @return Bytes read, 0 on failure.
+ **/
+static size_t sim_bench_load(uint32_t *store, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    size_t len;
+
+    if (!f)
+    {
+        return 0;
+    }
+    len = fread(store, 1, SIM_BENCH_STORE_MAX, f);
+    fclose(f);
+
+    return len < SIM_BENCH_STORE_MAX ? len : 0;
+}
+
+int main(void)
+{
+    static uint32_t image[SIM_BENCH_STORE_MAX / sizeof(uint32_t)];
+    static uint32_t copy[SIM_BENCH_STORE_MAX / sizeof(uint32_t)];
+    udsp_card_flash_t store;
+    const es9033_profile_t *profile;
+    const int32_t *coeffs;
+    const uint8_t *cal;
+    unsigned count;
+    uint32_t len;
+    size_t size;
+    int ok;
+
+    if (sim_bench_write_inputs() ||
+        system(SIM_BENCH_PYTHON " " SIM_BENCH_PACK " -o " SIM_BENCH_DIR "/flash_store.bin"
+               " --revision " SIM_BENCH_STR(SIM_BENCH_REVISION)
+               " --coeffs 5 " SIM_BENCH_DIR "/flash_coeffs.txt"
+               " --dac-profile 0 " SIM_BENCH_DIR "/flash_dac_48k.txt"
+               " --calibration 2 " SIM_BENCH_DIR "/flash_cal.bin") != 0 ||
+        !(size = sim_bench_load(image, SIM_BENCH_DIR "/flash_store.bin")))
+    {
+        printf("cannot pack the store\nFAILED\n");
+        return 1;
+    }
+
+    sim_bench_check("open", udsp_card_flash_open(&store, image) == 0 &&
+                                store.header->revision == SIM_BENCH_REVISION && store.header->size == size);
+    if (sim_bench_failures)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+    sim_bench_check("verify", udsp_card_flash_verify(&store) == 0);
+
+    // Same layout as the Python STEP struct, including the padding of every step and of the profile
+    profile = udsp_card_flash_dac_profile(&store, 0);
+    sim_bench_check("dac profile layout", profile && !memcmp(profile, &es9033_profile_48k, sizeof(*profile)));
+
+    coeffs = udsp_card_flash_coeffs(&store, 5, &count);
+    ok = coeffs && count == SIM_BENCH_COEFFS;
+    for (unsigned i = 0; ok && i < count; i++)
+    {
+        ok = coeffs[i] == sim_bench_coeff(i);
+    }
+    sim_bench_check("coeffs", ok);
+
+    cal = udsp_card_flash_find(&store, UDSP_CARD_FLASH_CALIBRATION, 2, &len);
+    ok = cal && len == SIM_BENCH_CALIBRATION;
+    for (unsigned i = 0; ok && i < len; i++)
+    {
+        ok = cal[i] == 0xA0 + i;
+    }
+    sim_bench_check("calibration", ok);
+
+    sim_bench_check("missing record", !udsp_card_flash_find(&store, UDSP_CARD_FLASH_COEFFS, 0, NULL) &&
+                                          !udsp_card_flash_dac_profile(&store, 1));
+
+    // A payload bit flip is only seen by the verify pass, a directory bit flip on open
+    memcpy(copy, image, size);
+    ((uint8_t *)copy)[size - 4] ^= 0x01; // Last calibration byte
+    sim_bench_check("corrupt payload", udsp_card_flash_open(&store, copy) == 0 && udsp_card_flash_verify(&store) != 0);
+    memcpy(copy, image, size);
+    ((uint8_t *)copy)[sizeof(udsp_card_flash_header_t)] ^= 0x01;
+    sim_bench_check("corrupt directory", udsp_card_flash_open(&store, copy) != 0);
+    memcpy(copy, image, size);
+    ((udsp_card_flash_header_t *)copy)->format++;
+    sim_bench_check("unknown format", udsp_card_flash_open(&store, copy) != 0);
+
+    printf("%s\n", sim_bench_failures ? "FAILED" : "PASSED");
+
+    return sim_bench_failures ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+/**
+ * @file debug_print.h
+ * @brief Host stand-in for lib_logging, prints only with -DDEBUG_PRINT_ENABLE=1.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#if DEBUG_PRINT_ENABLE
+#define debug_printf(...) printf(__VA_ARGS__)
+#else
+#define debug_printf(...) ((void)0)
+#endif
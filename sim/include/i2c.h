@@ -0,0 +1,47 @@
+/**
+ * @file i2c.h
+ * @brief Host stand-in for the lib_io_i2c master API, backed by the sim bus.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xs1.h>
+#include <xcore/port.h>
+
+typedef enum
+{
+    I2C_NACK = 0,
+    I2C_ACK,
+    I2C_STARTED,
+    I2C_NOT_STARTED,
+} i2c_res_t;
+
+typedef enum
+{
+    I2C_REGOP_SUCCESS,
+    I2C_REGOP_DEVICE_NACK,
+    I2C_REGOP_INCOMPLETE,
+} i2c_regop_res_t;
+
+typedef struct
+{
+    unsigned kbits_per_second; // Bus speed used to model transaction time
+    int stopped;               // 0 while a repeated start is pending
+} i2c_master_t;
+
+void i2c_master_init(i2c_master_t *ctx,
+                     const port_t p_scl, const uint32_t scl_bit_position, const uint32_t scl_other_bits_mask,
+                     const port_t p_sda, const uint32_t sda_bit_position, const uint32_t sda_other_bits_mask,
+                     const unsigned kbits_per_second);
+void i2c_master_shutdown(i2c_master_t *ctx);
+i2c_res_t i2c_master_write(i2c_master_t *ctx, uint8_t device_addr, uint8_t buf[], size_t n,
+                           size_t *num_bytes_sent, int send_stop_bit);
+i2c_res_t i2c_master_read(i2c_master_t *ctx, uint8_t device_addr, uint8_t buf[], size_t n, int send_stop_bit);
+void i2c_master_stop_bit_send(i2c_master_t *ctx);
+uint8_t read_reg(i2c_master_t *ctx, uint8_t device_addr, uint8_t reg, i2c_regop_res_t *result);
+i2c_regop_res_t write_reg(i2c_master_t *ctx, uint8_t device_addr, uint8_t reg, uint8_t data);
@@ -0,0 +1,10 @@
+/**
+ * @file platform.h
+ * @brief Host stand-in, the library needs no platform definitions on the host.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <xs1.h>
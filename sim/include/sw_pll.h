@@ -0,0 +1,10 @@
+/**
+ * @file sw_pll.h
+ * @brief Host stand-in for lib_sw_pll, drives the MCLK input of the ES9033 model.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+void sw_pll_fixed_clock(const unsigned frequency);
@@ -0,0 +1,8 @@
+/**
+ * @file xclib.h
+ * @brief Host stand-in, no xclib intrinsics are used by the simulated sources.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
@@ -0,0 +1,20 @@
+/**
+ * @file clock.h
+ * @brief Host stand-in for lib_xcore clock blocks. Clock blocks have no effect on
+ * the host, buffered ports are timed by sim_port_stream() instead.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef unsigned xclock_t;
+
+void clock_enable(xclock_t clk);
+void clock_disable(xclock_t clk);
+void clock_start(xclock_t clk);
+void clock_stop(xclock_t clk);
+void clock_set_source_port(xclock_t clk, unsigned p);
+void clock_set_divide(xclock_t clk, uint8_t divide);
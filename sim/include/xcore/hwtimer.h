@@ -0,0 +1,12 @@
+/**
+ * @file hwtimer.h
+ * @brief Host stand-in for lib_xcore hardware timers, backed by the simulated reference time.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+uint32_t get_reference_time(void);
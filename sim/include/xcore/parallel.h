@@ -0,0 +1,41 @@
+/**
+ * @file parallel.h
+ * @brief Host stand-in for lib_xcore parallel jobs, runs every job on its own thread.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ *
+ * Each job gets a pthread and its own simulated clock, starting at the time of
+ * PAR_JOBS(). One job runs at a time: whenever a job advances its clock, the job
+ * with the earliest clock runs next, so runs stay deterministic while the jobs
+ * interleave as they would on separate hardware threads. PAR_JOBS() returns at
+ * the time the last job finished. Jobs take a single pointer argument and must
+ * not start PAR_JOBS() themselves.
+ */
+
+#pragma once
+
+typedef struct
+{
+    void (*fn)(void *arg);
+    void *arg;
+} sim_job_t;
+
+/**
+ * @brief Run jobs in parallel and return when all have finished.
+ */
+void sim_par_jobs(const sim_job_t *jobs, unsigned num);
+
+#define DECLARE_JOB(name, arg_types)         \
+    static inline void sim_job_##name(void *arg) \
+    {                                        \
+        void name arg_types;                 \
+        name(arg);                           \
+    }                                        \
+    void name arg_types
+#define PJOB(name, args) {sim_job_##name, (void *)args}
+#define PAR_JOBS(...)                                                      \
+    do                                                                     \
+    {                                                                      \
+        const sim_job_t sim_jobs_[] = {__VA_ARGS__};                       \
+        sim_par_jobs(sim_jobs_, sizeof(sim_jobs_) / sizeof(sim_jobs_[0])); \
+    } while (0)
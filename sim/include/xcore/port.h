@@ -0,0 +1,25 @@
+/**
+ * @file port.h
+ * @brief Host stand-in for lib_xcore ports, output values are routed to the board model.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <xcore/clock.h>
+
+typedef unsigned port_t;
+
+void port_enable(port_t p);
+void port_disable(port_t p);
+void port_out(port_t p, uint32_t data);
+uint32_t port_in(port_t p);
+uint32_t port_peek(port_t p);
+void port_start_buffered(port_t p, unsigned transfer_width);
+void port_set_clock(port_t p, xclock_t clk);
+void port_set_out_clock(port_t p);
+void port_clear_buffer(port_t p);
+uint16_t port_get_trigger_time(port_t p);
@@ -0,0 +1,21 @@
+/**
+ * @file swmem_fill.h
+ * @brief Host stand-in for lib_xcore software memory fills. The host has no
+ * software memory window, stores are opened from RAM instead.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define SWMEM_FILL_SIZE_WORDS 8 // Words per fill, one cache line
+
+typedef unsigned swmem_fill_t;
+typedef void *fill_slot_t;
+typedef uint32_t swmem_fill_buffer_t[SWMEM_FILL_SIZE_WORDS];
+
+swmem_fill_t swmem_fill_get(void);
+fill_slot_t swmem_fill_in_address(swmem_fill_t r);
+void swmem_fill_populate_from_buffer(swmem_fill_t r, fill_slot_t address, const swmem_fill_buffer_t buf);
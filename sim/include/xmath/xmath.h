@@ -0,0 +1,29 @@
+/**
+ * @file xmath.h
+ * @brief Host stand-in for the lib_xcore_math 32-bit FIR filter used by the PDM front end.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ *
+ * Products of Q30 coefficients are rounded and shifted right by 30 bits, summed,
+ * shifted right by the filter shift and saturated to 32 bits, as on the vector unit.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef int right_shift_t;
+
+typedef struct
+{
+    unsigned num_taps;
+    unsigned head; // Index of the newest sample in state
+    right_shift_t shift;
+    const int32_t *coef;
+    int32_t *state;
+} filter_fir_s32_t;
+
+void filter_fir_s32_init(filter_fir_s32_t *filter, int32_t *sample_buffer, const unsigned tap_count,
+                         const int32_t *coefficients, const right_shift_t shift);
+void filter_fir_s32_add_sample(filter_fir_s32_t *filter, const int32_t new_sample);
+int32_t filter_fir_s32(filter_fir_s32_t *filter, const int32_t new_sample);
@@ -0,0 +1,47 @@
+/**
+ * @file xs1.h
+ * @brief Host stand-in for the XS1 resource definitions and delays used by the library.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+// Resource IDs only need to be distinct on the host
+#define XS1_PORT_1A 0x10200
+#define XS1_PORT_1B 0x10000
+#define XS1_PORT_1C 0x10100
+#define XS1_PORT_1D 0x10300
+#define XS1_PORT_1E 0x10600
+#define XS1_PORT_1F 0x10700
+#define XS1_PORT_1G 0x10400
+#define XS1_PORT_1H 0x10500
+#define XS1_PORT_1I 0x10800
+#define XS1_PORT_1J 0x10900
+#define XS1_PORT_1K 0x10a00
+#define XS1_PORT_1L 0x10b00
+#define XS1_PORT_1M 0x10c00
+#define XS1_PORT_1N 0x10d00
+#define XS1_PORT_1O 0x10e00
+#define XS1_PORT_1P 0x10f00
+#define XS1_PORT_4A 0x40000
+#define XS1_PORT_4B 0x40100
+#define XS1_PORT_4C 0x40200
+#define XS1_PORT_4D 0x40300
+#define XS1_PORT_4E 0x40400
+#define XS1_PORT_4F 0x40500
+#define XS1_PORT_16B 0x100100
+#define XS1_CLKBLK_1 0x106
+#define XS1_CLKBLK_2 0x206
+#define XS1_CLKBLK_3 0x306
+#define XS1_CLKBLK_4 0x406
+#define XS1_CLKBLK_5 0x506
+
+#define XS1_TIMER_HZ 100000000
+#define XS1_TIMER_KHZ 100000
+#define XS1_TIMER_MHZ 100
+
+// Delays advance the simulated reference timer
+void delay_ticks(unsigned ticks);
+void delay_microseconds(unsigned delay);
+void delay_milliseconds(unsigned delay);
@@ -0,0 +1,10 @@
+/**
+ * @file xscope.h
+ * @brief Host stand-in for xscope, probe data is captured by the sim.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#pragma once
+
+void xscope_bytes(unsigned char id, unsigned int length, const unsigned char *data);
@@ -0,0 +1,159 @@
+/**
+ * @file pdm_sim_bench.c
+ * @brief Runs the PDM capture and decimation threads against a buffered port model
+ * and checks that a stalled capture thread is detected.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see udsp_card_pdm.h
+ *
+ * The data port delivers a word every 8 port clocks at the rate of the board's PDM
+ * clock and holds only one completed word, so a capture thread that is held up
+ * loses words. All microphones see a 75% ones density, which decimates to half of
+ * full scale. Exits non-zero if a clean run loses words or blocks, a stall of the
+ * capture thread goes unnoticed, or a slow consumer holds up the capture thread.
+ * Usage: pdm_sim_bench
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <xs1.h>
+#include <xcore/parallel.h>
+
+#include "udsp_card_pdm.h"
+
+#include "sim.h"
+
+#define SIM_BENCH_FS 48000
+#define SIM_BENCH_BLOCKS 8
+#define SIM_BENCH_WORD_HZ (PDM_CLOCK_FREQUENCY * 2 * 4 / 32) // Both clock edges on a 4-bit port
+#define SIM_BENCH_WORD_CLOCKS 8                              // Port clocks per 32-bit word
+#define SIM_BENCH_DATA 0x00FFFFFF // Three PDM clocks of ones, one of zeros, for every microphone
+#define SIM_BENCH_LEVEL 0.5       // Expected PCM level of SIM_BENCH_DATA as a fraction of full scale
+#define SIM_BENCH_POLL_US 20      // Consumer poll interval for a block
+#define SIM_BENCH_STALL_US 5      // Stall of the capture thread, about four port words
+
+typedef struct
+{
+    const char *name;
+    unsigned stall_us; // Stall injected into the capture thread after the second block
+    unsigned hold_us;  // Time the consumer holds every block
+} sim_bench_case_t;
+
+typedef struct
+{
+    udsp_card_pdm_t *pdm;
+    const sim_bench_case_t *test;
+    unsigned received;
+    int32_t last[PDM_MICS]; // Last frame of the last block
+} sim_bench_run_t;
+
+static udsp_card_pdm_t sim_bench_pdm;
+static int sim_bench_failures;
+
+DECLARE_JOB(udsp_card_pdm_capture_task, (udsp_card_pdm_t *));
+DECLARE_JOB(udsp_card_pdm_task, (udsp_card_pdm_t *));
+DECLARE_JOB(sim_bench_consumer, (sim_bench_run_t *));
+
+void sim_bench_consumer(sim_bench_run_t *run)
+{
+    while (run->received < SIM_BENCH_BLOCKS)
+    {
+        const int32_t *block = udsp_card_pdm_acquire(run->pdm);
+
+        if (!block)
+        {
+            delay_microseconds(SIM_BENCH_POLL_US);
+            continue;
+        }
+
+        memcpy(run->last, &block[(UDSP_CARD_PDM_BLOCK_FRAMES - 1) * PDM_MICS], sizeof(run->last));
+        delay_microseconds(run->test->hold_us);
+        udsp_card_pdm_release(run->pdm);
+
+        if (++run->received == 2 && run->test->stall_us)
+        {
+            sim_port_stall(UDSP_CARD_PORT_PDM_DATA, (uint64_t)run->test->stall_us * XS1_TIMER_MHZ);
+        }
+    }
+
+    udsp_card_pdm_stop(run->pdm);
+}
+
+/**
+ * @brief Run the front end until the consumer has received its blocks.
+ * @return 0 on success, -1 if the front end cannot be set up.
+ **/
+static int sim_bench_run(sim_bench_run_t *run)
+{
+    sim_reset();
+    if (udsp_card_pdm_init(run->pdm, MASTER_CLOCK_FREQUENCY, SIM_BENCH_FS))
+    {
+        return -1;
+    }
+    sim_port_drive(UDSP_CARD_PORT_PDM_DATA, SIM_BENCH_DATA);
+    sim_port_stream(UDSP_CARD_PORT_PDM_DATA, SIM_BENCH_WORD_HZ, SIM_BENCH_WORD_CLOCKS);
+
+    PAR_JOBS(PJOB(udsp_card_pdm_capture_task, (run->pdm)), PJOB(udsp_card_pdm_task, (run->pdm)),
+             PJOB(sim_bench_consumer, (run)));
+
+    return 0;
+}
+
+/**
+ * @brief Largest deviation of the last frame from the expected level, as a fraction of full scale.
+ **/
+static double sim_bench_error(const sim_bench_run_t *run)
+{
+    double error = 0;
+
+    for (unsigned m = 0; m < PDM_MICS; m++)
+    {
+        double e = fabs(run->last[m] / 2147483648.0 - SIM_BENCH_LEVEL);
+
+        error = e > error ? e : error;
+    }
+
+    return error;
+}
+
+int main(void)
+{
+    static const sim_bench_case_t cases[] = {
+        {"clean", 0, 0},
+        {"capture stall", SIM_BENCH_STALL_US, 0},
+        {"slow consumer", 0, 2 * 1000000 * UDSP_CARD_PDM_BLOCK_FRAMES / SIM_BENCH_FS},
+    };
+
+    printf("%-22s %6s %6s %6s %8s %8s %8s\n", "case", "result", "blocks", "stalls", "dropped", "overruns",
+           "error");
+
+    for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const sim_bench_case_t *test = &cases[i];
+        sim_bench_run_t run = {.pdm = &sim_bench_pdm, .test = test};
+        const udsp_card_pdm_t *pdm = &sim_bench_pdm;
+        int ok = sim_bench_run(&run) == 0 && pdm->dropped == 0 && sim_bench_error(&run) < 0.01;
+
+        if (test->stall_us)
+        {
+            // A stall is counted once, however many words it lost
+            ok = ok && pdm->stalls == 1;
+        }
+        else
+        {
+            ok = ok && pdm->stalls == 0;
+        }
+        // Only a consumer holding both blocks costs blocks, never port words
+        ok = ok && (test->hold_us ? pdm->overruns > 0 : pdm->overruns == 0);
+
+        printf("%-22s %6s %6u %6u %8u %8u %8.4f\n", test->name, ok ? "ok" : "FAIL", run.received,
+               (unsigned)pdm->stalls, (unsigned)pdm->dropped, (unsigned)pdm->overruns, sim_bench_error(&run));
+        sim_bench_failures += !ok;
+    }
+
+    printf("%s\n", sim_bench_failures ? "FAILED" : "PASSED");
+
+    return sim_bench_failures ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/**
+ * @file recorder_sim_bench.c
+ * @brief Records a multi-channel stream through the SD card model and checks the
+ * resulting WAV image.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see sim_blockdev.h
+ * @see sim_sd_card.h
+ *
+ * Blocks are pushed at the audio block rate while the writer services the ring.
+ * Blocks due while a write is in flight are pushed when it returns, as the audio
+ * thread would have done concurrently. Exits non-zero if any block was dropped, a
+ * device write failed, the image does not read back as the pushed stream, or the
+ * final header of a recording over 4GB is not a valid RF64 header. A short recording
+ * through udsp_card_sd.h to the bit level card model on the SD ports must read back
+ * from the card image, and a push whose byte count would wrap must be dropped.
+ * Usage: recorder_sim_bench [ring_kbytes] [image.wav]
+ * The image defaults to recorder_sim.wav in the build directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xs1.h>
+
+#include "udsp_card_recorder.h"
+
+#include "udsp_card_sd.h"
+
+#include "sim.h"
+#include "sim_blockdev.h"
+#include "sim_sd_card.h"
+
+#define SIM_BENCH_CHANNELS 8     // PDM_MICS
+#define SIM_BENCH_FS 48000
+#define SIM_BENCH_BLOCK_FRAMES 32 // UDSP_CARD_PDM_BLOCK_FRAMES
+#define SIM_BENCH_SECONDS 20
+#define SIM_BENCH_BLOCKS (SIM_BENCH_SECONDS * SIM_BENCH_FS / SIM_BENCH_BLOCK_FRAMES)
+#define SIM_BENCH_REGION (1u << 20) // Sectors in the recording region, 512MB
+#define SIM_BENCH_RF64_BYTES ((5ull << 30) + 8) // Data bytes of the RF64 check, not a whole number of frames
+#define SIM_BENCH_SD_SECTORS 512 // Capacity of the card on the SD ports, 256KB
+#define SIM_BENCH_SD_FIRST 8     // Sector of the WAV header on the card
+#define SIM_BENCH_SD_BLOCKS 150  // Blocks recorded to the card, two batches and a remainder
+
+#ifndef SIM_BENCH_DIR
+#define SIM_BENCH_DIR "." // Directory of the default image, set to the build directory by CMake
+#endif
+
+static uint8_t sim_bench_accepted[SIM_BENCH_BLOCKS];
+
+static void sim_bench_block(int32_t *block, unsigned k)
+{
+    for (unsigned i = 0; i < SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS; i++)
+    {
+        block[i] = (int32_t)(k * SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS + i);
+    }
+}
+
+static uint32_t sim_bench_get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t sim_bench_get64(const uint8_t *p)
+{
+    return sim_bench_get32(p) | (uint64_t)sim_bench_get32(p + 4) << 32;
+}
+
+/**
+ * @brief RAM block device that keeps only the header sector.
+ **/
+static int sim_bench_header_write(void *ctx, uint32_t sector, const void *buf, uint32_t count)
+{
+    if (sector == 0)
+    {
+        memcpy(ctx, buf, UDSP_CARD_RECORDER_SECTOR);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Finalize a recording of more than 4GB without writing its data and check the RF64 header.
+ * @return Number of errors.
+ **/
+static unsigned sim_bench_rf64(void)
+{
+    static uint8_t ring[UDSP_CARD_RECORDER_BATCH_BYTES];
+    uint8_t header[UDSP_CARD_RECORDER_SECTOR];
+    udsp_card_blockdev_t dev = {sim_bench_header_write, NULL, header};
+    udsp_card_recorder_t rec;
+    unsigned frame_bytes = SIM_BENCH_CHANNELS * sizeof(int32_t);
+    uint64_t data_bytes = SIM_BENCH_RF64_BYTES - SIM_BENCH_RF64_BYTES % frame_bytes;
+    const uint8_t *ds64 = header + 12;
+    int ok;
+
+    if (udsp_card_recorder_start(&rec, &dev, 0, UINT32_MAX, ring, sizeof(ring), SIM_BENCH_CHANNELS, SIM_BENCH_FS))
+    {
+        printf("  cannot start the RF64 recording\n");
+        return 1;
+    }
+    rec.data_bytes = SIM_BENCH_RF64_BYTES;
+
+    // RF64 and data sizes move from their 32 bit fields into the ds64 chunk
+    ok = udsp_card_recorder_stop(&rec) == 0;
+    ok &= !memcmp(header, "RF64", 4) && sim_bench_get32(header + 4) == UINT32_MAX && !memcmp(header + 8, "WAVE", 4);
+    ok &= !memcmp(ds64, "ds64", 4) && sim_bench_get32(ds64 + 4) == 28;
+    ok &= sim_bench_get64(ds64 + 8) == UDSP_CARD_RECORDER_SECTOR - 8 + data_bytes;
+    ok &= sim_bench_get64(ds64 + 16) == data_bytes && sim_bench_get64(ds64 + 24) == data_bytes / frame_bytes;
+    ok &= !memcmp(header + UDSP_CARD_RECORDER_SECTOR - 8, "data", 4) &&
+          sim_bench_get32(header + UDSP_CARD_RECORDER_SECTOR - 4) == UINT32_MAX;
+
+    printf("%-16s %10s\n", "rf64 header", ok ? "ok" : "FAIL");
+
+    return !ok;
+}
+
+/**
+ * @brief Record through the SD card driver to the card model and read the card image back.
+ * @return Number of errors.
+ **/
+static unsigned sim_bench_sd(void)
+{
+    static uint8_t image[SIM_BENCH_SD_SECTORS * UDSP_CARD_RECORDER_SECTOR];
+    static uint8_t ring[2 * UDSP_CARD_RECORDER_BATCH_BYTES];
+    int32_t block[SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS];
+    const uint8_t *header = &image[SIM_BENCH_SD_FIRST * UDSP_CARD_RECORDER_SECTOR];
+    uint32_t data_bytes = SIM_BENCH_SD_BLOCKS * sizeof(block);
+    udsp_card_blockdev_t dev;
+    udsp_card_recorder_t rec;
+    udsp_card_sd_t sd;
+    uint32_t head;
+    int ok;
+
+    sim_reset();
+    sim_sd_card_attach(image, SIM_BENCH_SD_SECTORS);
+    if (udsp_card_sd_init(&sd, &dev) ||
+        udsp_card_recorder_start(&rec, &dev, SIM_BENCH_SD_FIRST, SIM_BENCH_SD_SECTORS - SIM_BENCH_SD_FIRST, ring,
+                                 sizeof(ring), SIM_BENCH_CHANNELS, SIM_BENCH_FS))
+    {
+        printf("  cannot start a recording on the SD card\n");
+        return 1;
+    }
+
+    for (unsigned k = 0; k < SIM_BENCH_SD_BLOCKS; k++)
+    {
+        sim_bench_block(block, k);
+        ok = udsp_card_recorder_push(&rec, block, SIM_BENCH_BLOCK_FRAMES) == 0;
+        ok &= udsp_card_recorder_service(&rec) >= 0;
+        if (!ok)
+        {
+            printf("  block %u not recorded\n", k);
+            return 1;
+        }
+    }
+
+    // A frame count whose byte count wraps to a single frame is dropped, not copied
+    head = rec.head;
+    ok = udsp_card_recorder_push(&rec, block, UINT32_MAX / (SIM_BENCH_CHANNELS * sizeof(int32_t)) + 2) != 0;
+    ok &= rec.head == head && rec.dropped != 0;
+    rec.dropped = 0;
+
+    ok &= udsp_card_recorder_stop(&rec) == 0 && rec.dropped == 0 && sd.errors == 0;
+    ok &= sd.block_addressing && sim_sd_card_stats.crc_errors == 0 && sim_sd_card_stats.illegal == 0;
+    ok &= !memcmp(header, "RIFF", 4) && !memcmp(header + 8, "WAVE", 4) &&
+          sim_bench_get32(header + UDSP_CARD_RECORDER_SECTOR - 4) == data_bytes;
+    for (unsigned k = 0; k < SIM_BENCH_SD_BLOCKS; k++)
+    {
+        sim_bench_block(block, k);
+        ok &= !memcmp(header + UDSP_CARD_RECORDER_SECTOR + k * sizeof(block), block, sizeof(block));
+    }
+
+    printf("%-16s %10s\n", "sd card", ok ? "ok" : "FAIL");
+    printf("%-16s %10u\n", "sd blocks", sim_sd_card_stats.blocks);
+
+    return !ok;
+}
+
+/**
+ * @brief Read the image back and compare it against the accepted blocks.
+ * @return Number of errors.
+ **/
+static unsigned sim_bench_verify(FILE *f, unsigned accepted)
+{
+    uint8_t header[UDSP_CARD_RECORDER_SECTOR];
+    int32_t expect[SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS];
+    int32_t got[SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS];
+    uint32_t data_bytes = accepted * sizeof(got);
+    unsigned errors = 0;
+
+    rewind(f);
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "RIFF", 4) ||
+        memcmp(header + 8, "WAVE", 4) || sim_bench_get32(header + 4) != UDSP_CARD_RECORDER_SECTOR - 8 + data_bytes ||
+        memcmp(header + UDSP_CARD_RECORDER_SECTOR - 8, "data", 4) ||
+        sim_bench_get32(header + UDSP_CARD_RECORDER_SECTOR - 4) != data_bytes)
+    {
+        printf("  header mismatch\n");
+        return 1;
+    }
+
+    for (unsigned k = 0; k < SIM_BENCH_BLOCKS; k++)
+    {
+        if (!sim_bench_accepted[k])
+        {
+            continue;
+        }
+        sim_bench_block(expect, k);
+        if (fread(got, 1, sizeof(got), f) != sizeof(got) || memcmp(got, expect, sizeof(got)))
+        {
+            errors++;
+        }
+    }
+    if (errors)
+    {
+        printf("  %u blocks differ\n", errors);
+    }
+
+    return errors;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned ring_kbytes = argc > 1 ? atoi(argv[1]) : 1024;
+    const char *path = argc > 2 ? argv[2] : SIM_BENCH_DIR "/recorder_sim.wav";
+    int32_t block[SIM_BENCH_BLOCK_FRAMES * SIM_BENCH_CHANNELS];
+    udsp_card_recorder_t rec;
+    udsp_card_blockdev_t dev;
+    sim_blockdev_t sd;
+    uint8_t *ring = malloc(ring_kbytes * 1024);
+    unsigned accepted = 0;
+    int failed = 0;
+
+    sim_reset();
+    if (!ring || sim_blockdev_open(&sd, &dev, path) ||
+        udsp_card_recorder_start(&rec, &dev, 0, SIM_BENCH_REGION, ring, ring_kbytes * 1024, SIM_BENCH_CHANNELS,
+                                 SIM_BENCH_FS))
+    {
+        printf("cannot start a recording with a %u KB ring to %s\n", ring_kbytes, path);
+        return 1;
+    }
+
+    for (unsigned k = 0; k < SIM_BENCH_BLOCKS; k++)
+    {
+        uint64_t due = (uint64_t)k * SIM_BENCH_BLOCK_FRAMES * XS1_TIMER_HZ / SIM_BENCH_FS;
+
+        // Writer thread until the next block is due
+        while (sim_time() < due)
+        {
+            int ret = udsp_card_recorder_service(&rec);
+
+            failed |= ret < 0;
+            if (ret <= 0)
+            {
+                sim_advance(due - sim_time());
+            }
+        }
+
+        sim_bench_block(block, k);
+        sim_bench_accepted[k] = udsp_card_recorder_push(&rec, block, SIM_BENCH_BLOCK_FRAMES) == 0;
+        accepted += sim_bench_accepted[k];
+    }
+    failed |= udsp_card_recorder_stop(&rec) != 0;
+
+    printf("%-16s %10u\n", "ring [KB]", ring_kbytes);
+    printf("%-16s %10u\n", "frames", SIM_BENCH_BLOCKS * SIM_BENCH_BLOCK_FRAMES);
+    printf("%-16s %10u\n", "dropped", rec.dropped);
+    printf("%-16s %10u\n", "batches", rec.batches);
+    printf("%-16s %10u\n", "ring peak [KB]", rec.ring_peak / 1024);
+    printf("%-16s %10.1f\n", "write max [ms]", (double)rec.write_max / XS1_TIMER_KHZ);
+    printf("%-16s %10u\n", "errors", rec.errors);
+    printf("%-16s %10.1f\n", "time [s]", (double)sim_time() / XS1_TIMER_HZ);
+
+    failed |= rec.dropped != 0;
+    failed |= sim_bench_verify(sd.file, accepted) != 0;
+    failed |= sim_bench_rf64() != 0;
+    failed |= sim_bench_sd() != 0;
+    sim_blockdev_close(&sd);
+    free(ring);
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file sim.h
+ * @brief Host simulation of the uDSP-Card platform: virtual reference time, ports,
+ * I2C bus and application PLL, wired to the ES9033 register model and the SD card model.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see es9033_model.h
+ *
+ * The stand-in headers in sim/include replace lib_xcore, lib_xcore_math, lib_io_i2c, lib_sw_pll,
+ * xscope and lib_logging so that the library sources build unchanged on the host.
+ * Time only advances through delays and modelled bus transfers, which makes every
+ * run deterministic.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <xcore/port.h>
+
+/** @defgroup Sim_Config Simulation Configuration
+ *  @{
+ */
+#define SIM_APP_PLL_LOCK_US 50 // Application PLL relock time after sw_pll_fixed_clock()
+#define SIM_XSCOPE_BUFFER 4096 // Bytes of xscope probe data captured
+/** @} */
+
+typedef struct
+{
+    unsigned transactions; // Transactions on the bus, one per start condition
+    unsigned bytes;        // Bytes on the bus, including the device address
+    unsigned nacks;        // Transactions NACKed by the device
+    uint64_t bus_ticks;    // Modelled bus time in reference timer ticks
+} sim_i2c_stats_t;
+
+extern sim_i2c_stats_t sim_i2c_stats;
+
+/**
+ * @brief Reset time, ports, bus statistics, captured xscope data, the DAC model and the SD card model.
+ */
+void sim_reset(void);
+
+/**
+ * @brief Simulated time since sim_reset() in reference timer ticks.
+ */
+uint64_t sim_time(void);
+
+/**
+ * @brief Advance the simulated time.
+ * @param ticks Reference timer ticks to advance.
+ */
+void sim_advance(uint64_t ticks);
+
+/**
+ * @brief Drive the value seen by port_in()/port_peek() on an input port.
+ */
+void sim_port_drive(port_t p, uint32_t value);
+
+/**
+ * @brief Clock an input port as a buffered port. From now on a word completes every
+ * 1 / word_hz seconds. port_in() waits for the next word, and if the caller is more
+ * than one word late it gets the last completed word, the ones before it are lost.
+ * port_get_trigger_time() returns the port counter at the end of the word read.
+ * @param p Port, the data of every word is the value set with sim_port_drive().
+ * @param word_hz Words per second.
+ * @param clocks Port clocks per word.
+ */
+void sim_port_stream(port_t p, unsigned word_hz, unsigned clocks);
+
+/**
+ * @brief Hold up the next port_in() on a port, as if its thread had not been scheduled.
+ * @param ticks Reference timer ticks the read starts late.
+ */
+void sim_port_stall(port_t p, uint64_t ticks);
+
+/**
+ * @brief Last value written to an output port with port_out().
+ */
+uint32_t sim_port_value(port_t p);
+
+/**
+ * @brief Make the application PLL fail, so that sw_pll_fixed_clock() leaves the MCLK
+ * at the DAC stopped until the fault is cleared and the clock is set again.
+ */
+void sim_pll_fault(int fault);
+
+/**
+ * @brief xscope probe data captured since sim_reset().
+ * @param len Receives the number of bytes captured.
+ */
+const uint8_t *sim_xscope_data(size_t *len);
@@ -0,0 +1,67 @@
+/**
+ * @file sim_blockdev.c
+ * @brief File backed stand-in for the SD card block device with modelled write latency.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#include <string.h>
+
+#include <xs1.h>
+
+#include "sim.h"
+#include "sim_blockdev.h"
+
+static int sim_blockdev_write(void *ctx, uint32_t sector, const void *buf, uint32_t count)
+{
+    sim_blockdev_t *sd = ctx;
+    size_t bytes = (size_t)count * UDSP_CARD_RECORDER_SECTOR;
+    uint64_t us = SIM_SD_COMMAND_US + bytes / SIM_SD_BYTES_PER_US;
+
+    if (fseeko(sd->file, (off_t)sector * UDSP_CARD_RECORDER_SECTOR, SEEK_SET) ||
+        fwrite(buf, 1, bytes, sd->file) != bytes)
+    {
+        return -1;
+    }
+
+    if (++sd->writes % SIM_SD_STALL_EVERY == 0)
+    {
+        us += SIM_SD_STALL_US;
+    }
+    sd->sectors += count;
+    sim_advance(us * XS1_TIMER_MHZ);
+
+    return 0;
+}
+
+static int sim_blockdev_sync(void *ctx)
+{
+    sim_blockdev_t *sd = ctx;
+
+    return fflush(sd->file) ? -1 : 0;
+}
+
+int sim_blockdev_open(sim_blockdev_t *sd, udsp_card_blockdev_t *dev, const char *path)
+{
+    memset(sd, 0, sizeof(*sd));
+    sd->file = fopen(path, "w+b");
+    if (!sd->file)
+    {
+        return -1;
+    }
+
+    dev->write = sim_blockdev_write;
+    dev->sync = sim_blockdev_sync;
+    dev->ctx = sd;
+
+    return 0;
+}
+
+void sim_blockdev_close(sim_blockdev_t *sd)
+{
+    if (sd->file)
+    {
+        fclose(sd->file);
+        sd->file = NULL;
+    }
+}
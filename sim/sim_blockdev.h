@@ -0,0 +1,49 @@
+/**
+ * @file sim_blockdev.h
+ * @brief File backed stand-in for the SD card block device with modelled write latency.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see udsp_card_recorder.h
+ *
+ * Every write advances the simulated time by a command overhead plus the transfer
+ * time, and every SIM_SD_STALL_EVERY-th write additionally stalls like a card
+ * erasing or remapping internally.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "udsp_card_recorder.h"
+
+/** @defgroup Sim_SD_Config SD Card Model Configuration
+ *  @{
+ */
+#define SIM_SD_COMMAND_US 250   // Overhead per multi-block write
+#define SIM_SD_BYTES_PER_US 12  // Sustained write rate, 12MB/s
+#define SIM_SD_STALL_EVERY 64   // Writes between internal stalls
+#define SIM_SD_STALL_US 250000  // Length of a stall
+/** @} */
+
+typedef struct
+{
+    FILE *file;
+    unsigned writes;   // Write commands
+    uint64_t sectors;  // Sectors written
+} sim_blockdev_t;
+
+/**
+ * @brief Open a file as a block device and fill in the backend.
+ *
+ * @param sd Pointer to the device state.
+ * @param dev Backend to fill in.
+ * @param path Image file, created or truncated.
+ * @return 0 on success, -1 if the file cannot be opened.
+ */
+int sim_blockdev_open(sim_blockdev_t *sd, udsp_card_blockdev_t *dev, const char *path);
+
+/**
+ * @brief Close the image file.
+ */
+void sim_blockdev_close(sim_blockdev_t *sd);
@@ -0,0 +1,564 @@
+/**
+ * @file sim_platform.c
+ * @brief Host implementation of the platform stand-ins used by the library sources.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see sim.h
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xs1.h>
+#include <xcore/hwtimer.h>
+#include <xcore/parallel.h>
+#include <xcore/port.h>
+#include <xcore/swmem_fill.h>
+#include <xmath/xmath.h>
+#include <xscope.h>
+
+#include "i2c.h"
+#include "sw_pll.h"
+#include "udsp_card_board.h"
+
+#include "es9033_model.h"
+#include "sim.h"
+#include "sim_sd_card.h"
+
+#define SIM_PORTS 16
+#define SIM_JOBS_MAX 8
+
+typedef struct
+{
+    port_t id;
+    uint32_t out;
+    uint32_t in;
+    unsigned word_hz; // Words per second of a port set up with sim_port_stream(), 0 otherwise
+    unsigned clocks;  // Port clocks per word
+    uint64_t start;   // Time the first word started
+    uint64_t next;    // Index of the next word read
+    uint64_t stall;   // Ticks the next read starts late
+    uint16_t stamp;   // Port counter at the end of the last word read
+} sim_port_t;
+
+typedef struct
+{
+    sim_job_t job;
+    uint64_t ticks; // Clock of the job
+    int done;
+    pthread_t thread;
+} sim_job_state_t;
+
+sim_i2c_stats_t sim_i2c_stats;
+
+static uint64_t sim_ticks;
+static __thread uint64_t *sim_clock = &sim_ticks; // Clock of the calling thread, its own inside a job
+static __thread sim_job_state_t *sim_job_self;
+static pthread_mutex_t sim_job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_job_cond = PTHREAD_COND_INITIALIZER;
+static sim_job_state_t sim_jobs[SIM_JOBS_MAX];
+static unsigned sim_job_count;
+static sim_job_state_t *sim_job_running;
+static sim_port_t sim_ports[SIM_PORTS];
+static unsigned sim_port_count;
+static uint8_t sim_xscope[SIM_XSCOPE_BUFFER];
+static size_t sim_xscope_len;
+static int sim_pll_faulted;
+
+void sim_reset(void)
+{
+    sim_ticks = 0;
+    sim_port_count = 0;
+    sim_xscope_len = 0;
+    sim_pll_faulted = 0;
+    memset(&sim_i2c_stats, 0, sizeof(sim_i2c_stats));
+    es9033_model_reset();
+    sim_sd_card_reset();
+}
+
+/**
+ * @brief The unfinished job with the earliest clock, the first one on a tie.
+ **/
+static sim_job_state_t *sim_job_next(void)
+{
+    sim_job_state_t *next = NULL;
+
+    for (unsigned i = 0; i < sim_job_count; i++)
+    {
+        if (!sim_jobs[i].done && (!next || sim_jobs[i].ticks < next->ticks))
+        {
+            next = &sim_jobs[i];
+        }
+    }
+
+    return next;
+}
+
+/**
+ * @brief Hand over to the job with the earliest clock and wait until it is this job's turn again.
+ **/
+static void sim_job_yield(void)
+{
+    sim_job_running = sim_job_next();
+    pthread_cond_broadcast(&sim_job_cond);
+    while (sim_job_running != sim_job_self)
+    {
+        pthread_cond_wait(&sim_job_cond, &sim_job_lock);
+    }
+}
+
+static void *sim_job_thread(void *arg)
+{
+    sim_job_state_t *state = arg;
+
+    pthread_mutex_lock(&sim_job_lock);
+    sim_job_self = state;
+    sim_clock = &state->ticks;
+    while (sim_job_running != state)
+    {
+        pthread_cond_wait(&sim_job_cond, &sim_job_lock);
+    }
+
+    state->job.fn(state->job.arg);
+
+    state->done = 1;
+    sim_job_running = sim_job_next();
+    pthread_cond_broadcast(&sim_job_cond);
+    pthread_mutex_unlock(&sim_job_lock);
+
+    return NULL;
+}
+
+uint64_t sim_time(void)
+{
+    return *sim_clock;
+}
+
+void sim_advance(uint64_t ticks)
+{
+    *sim_clock += ticks;
+
+    if (sim_job_self)
+    {
+        sim_job_yield();
+    }
+}
+
+static sim_port_t *sim_port(port_t p)
+{
+    for (unsigned i = 0; i < sim_port_count; i++)
+    {
+        if (sim_ports[i].id == p)
+        {
+            return &sim_ports[i];
+        }
+    }
+    if (sim_port_count == SIM_PORTS)
+    {
+        return NULL;
+    }
+    sim_ports[sim_port_count] = (sim_port_t){.id = p};
+    return &sim_ports[sim_port_count++];
+}
+
+void sim_port_drive(port_t p, uint32_t value)
+{
+    sim_port_t *port = sim_port(p);
+
+    if (port)
+    {
+        port->in = value;
+    }
+}
+
+void sim_port_stream(port_t p, unsigned word_hz, unsigned clocks)
+{
+    sim_port_t *port = sim_port(p);
+
+    if (port)
+    {
+        port->word_hz = word_hz;
+        port->clocks = clocks;
+        port->start = sim_time();
+        port->next = 0;
+        port->stall = 0;
+    }
+}
+
+void sim_port_stall(port_t p, uint64_t ticks)
+{
+    sim_port_t *port = sim_port(p);
+
+    if (port)
+    {
+        port->stall += ticks;
+    }
+}
+
+/**
+ * @brief Read the next word of a buffered port, waiting for it or skipping the lost ones.
+ **/
+static uint32_t sim_port_stream_in(sim_port_t *port)
+{
+    uint64_t done;
+
+    if (port->stall)
+    {
+        uint64_t stall = port->stall;
+
+        port->stall = 0;
+        sim_advance(stall);
+    }
+
+    // The port holds one completed word, any earlier one is overwritten
+    done = (sim_time() - port->start) * port->word_hz / XS1_TIMER_HZ;
+    if (done > port->next + 1)
+    {
+        port->next = done - 1;
+    }
+    else if (done < port->next + 1)
+    {
+        sim_advance(port->start + ((port->next + 1) * XS1_TIMER_HZ + port->word_hz - 1) / port->word_hz - sim_time());
+    }
+
+    port->stamp = (uint16_t)((port->next + 1) * port->clocks);
+    port->next++;
+
+    return port->in;
+}
+
+uint32_t sim_port_value(port_t p)
+{
+    sim_port_t *port = sim_port(p);
+
+    return port ? port->out : 0;
+}
+
+const uint8_t *sim_xscope_data(size_t *len)
+{
+    *len = sim_xscope_len;
+    return sim_xscope;
+}
+
+/* lib_xcore */
+
+uint32_t get_reference_time(void)
+{
+    return (uint32_t)sim_time();
+}
+
+void delay_ticks(unsigned ticks)
+{
+    sim_advance(ticks);
+}
+
+void delay_microseconds(unsigned delay)
+{
+    sim_advance((uint64_t)delay * XS1_TIMER_MHZ);
+}
+
+void delay_milliseconds(unsigned delay)
+{
+    sim_advance((uint64_t)delay * XS1_TIMER_KHZ);
+}
+
+void sim_par_jobs(const sim_job_t *jobs, unsigned num)
+{
+    uint64_t end = sim_ticks;
+
+    if (sim_job_self || num > SIM_JOBS_MAX)
+    {
+        fprintf(stderr, "sim: PAR_JOBS nested or with more than %d jobs\n", SIM_JOBS_MAX);
+        abort();
+    }
+
+    pthread_mutex_lock(&sim_job_lock);
+    sim_job_count = num;
+    for (unsigned i = 0; i < num; i++)
+    {
+        sim_jobs[i] = (sim_job_state_t){.job = jobs[i], .ticks = sim_ticks};
+    }
+    sim_job_running = sim_job_next();
+    for (unsigned i = 0; i < num; i++)
+    {
+        if (pthread_create(&sim_jobs[i].thread, NULL, sim_job_thread, &sim_jobs[i]))
+        {
+            fprintf(stderr, "sim: cannot start a job thread\n");
+            abort();
+        }
+    }
+    pthread_mutex_unlock(&sim_job_lock);
+
+    for (unsigned i = 0; i < num; i++)
+    {
+        pthread_join(sim_jobs[i].thread, NULL);
+        end = sim_jobs[i].ticks > end ? sim_jobs[i].ticks : end;
+    }
+
+    sim_job_count = 0;
+    sim_ticks = end;
+}
+
+void port_enable(port_t p)
+{
+    sim_port(p);
+}
+
+void port_disable(port_t p)
+{
+}
+
+void port_out(port_t p, uint32_t data)
+{
+    sim_port_t *port = sim_port(p);
+
+    if (port)
+    {
+        port->out = data;
+    }
+    if (p == UDSP_CARD_PORT_GPIO_OUT)
+    {
+        es9033_model_power(data & UDSP_CARD_GPIO_OUT_DAC_EN);
+    }
+    if (p == UDSP_CARD_PORT_SD_CLK || p == UDSP_CARD_PORT_SD_CMD || p == UDSP_CARD_PORT_SD_SIO)
+    {
+        sim_sd_card_out(p, data);
+    }
+}
+
+uint32_t port_in(port_t p)
+{
+    sim_port_t *port = sim_port(p);
+
+    if (port && port->word_hz)
+    {
+        return sim_port_stream_in(port);
+    }
+    if (p == UDSP_CARD_PORT_SD_CMD || p == UDSP_CARD_PORT_SD_SIO)
+    {
+        return sim_sd_card_in(p);
+    }
+
+    return port ? port->in : 0;
+}
+
+uint32_t port_peek(port_t p)
+{
+    return port_in(p);
+}
+
+void port_start_buffered(port_t p, unsigned transfer_width)
+{
+    sim_port(p);
+}
+
+void port_set_clock(port_t p, xclock_t clk)
+{
+}
+
+void port_set_out_clock(port_t p)
+{
+}
+
+void port_clear_buffer(port_t p)
+{
+}
+
+uint16_t port_get_trigger_time(port_t p)
+{
+    sim_port_t *port = sim_port(p);
+
+    return port ? port->stamp : 0;
+}
+
+void clock_enable(xclock_t clk)
+{
+}
+
+void clock_disable(xclock_t clk)
+{
+}
+
+void clock_start(xclock_t clk)
+{
+}
+
+void clock_stop(xclock_t clk)
+{
+}
+
+void clock_set_source_port(xclock_t clk, unsigned p)
+{
+}
+
+void clock_set_divide(xclock_t clk, uint8_t divide)
+{
+}
+
+/* Software memory, the host has no window so no fill ever arrives */
+
+swmem_fill_t swmem_fill_get(void)
+{
+    return 0;
+}
+
+fill_slot_t swmem_fill_in_address(swmem_fill_t r)
+{
+    fprintf(stderr, "sim: no software memory window, open flash stores from RAM\n");
+    abort();
+}
+
+void swmem_fill_populate_from_buffer(swmem_fill_t r, fill_slot_t address, const swmem_fill_buffer_t buf)
+{
+}
+
+/* lib_xcore_math */
+
+void filter_fir_s32_init(filter_fir_s32_t *filter, int32_t *sample_buffer, const unsigned tap_count,
+                         const int32_t *coefficients, const right_shift_t shift)
+{
+    *filter = (filter_fir_s32_t){.num_taps = tap_count, .shift = shift, .coef = coefficients, .state = sample_buffer};
+    memset(sample_buffer, 0, tap_count * sizeof(sample_buffer[0]));
+}
+
+void filter_fir_s32_add_sample(filter_fir_s32_t *filter, const int32_t new_sample)
+{
+    filter->head = filter->head ? filter->head - 1 : filter->num_taps - 1;
+    filter->state[filter->head] = new_sample;
+}
+
+int32_t filter_fir_s32(filter_fir_s32_t *filter, const int32_t new_sample)
+{
+    int64_t acc = 0;
+
+    filter_fir_s32_add_sample(filter, new_sample);
+
+    // coef[0] applies to the newest sample
+    for (unsigned k = 0; k < filter->num_taps; k++)
+    {
+        int64_t x = filter->state[(filter->head + k) % filter->num_taps];
+
+        acc += (x * filter->coef[k] + (1 << 29)) >> 30;
+    }
+    acc >>= filter->shift;
+
+    return acc > INT32_MAX ? INT32_MAX : acc < -INT32_MAX ? -INT32_MAX : (int32_t)acc;
+}
+
+/* lib_sw_pll */
+
+void sim_pll_fault(int fault)
+{
+    sim_pll_faulted = fault;
+}
+
+void sw_pll_fixed_clock(const unsigned frequency)
+{
+    // The MCLK at the DAC restarts once the application PLL has relocked
+    es9033_model_mclk(sim_pll_faulted ? 0 : frequency, get_reference_time() + SIM_APP_PLL_LOCK_US * XS1_TIMER_MHZ);
+}
+
+/* xscope */
+
+void xscope_bytes(unsigned char id, unsigned int length, const unsigned char *data)
+{
+    size_t n = length < sizeof(sim_xscope) - sim_xscope_len ? length : sizeof(sim_xscope) - sim_xscope_len;
+
+    memcpy(&sim_xscope[sim_xscope_len], data, n);
+    sim_xscope_len += n;
+}
+
+/* lib_io_i2c */
+
+/**
+ * @brief Advance time by the duration of a number of bits at the bus speed.
+ **/
+static void sim_i2c_bits(i2c_master_t *ctx, unsigned bits)
+{
+    sim_i2c_stats.bus_ticks += (uint64_t)bits * XS1_TIMER_KHZ / ctx->kbits_per_second;
+    sim_advance((uint64_t)bits * XS1_TIMER_KHZ / ctx->kbits_per_second);
+}
+
+/**
+ * @brief Account a transaction: start or repeated start, n + 1 bytes of 9 bits and an optional stop.
+ **/
+static void sim_i2c_transaction(i2c_master_t *ctx, size_t n, int acked, int send_stop_bit)
+{
+    sim_i2c_stats.transactions++;
+    sim_i2c_stats.bytes += acked ? n + 1 : 1;
+    sim_i2c_stats.nacks += !acked;
+    sim_i2c_bits(ctx, 1 + 9 * (acked ? n + 1 : 1) + (send_stop_bit ? 1 : 0));
+    ctx->stopped = send_stop_bit;
+}
+
+void i2c_master_init(i2c_master_t *ctx,
+                     const port_t p_scl, const uint32_t scl_bit_position, const uint32_t scl_other_bits_mask,
+                     const port_t p_sda, const uint32_t sda_bit_position, const uint32_t sda_other_bits_mask,
+                     const unsigned kbits_per_second)
+{
+    ctx->kbits_per_second = kbits_per_second;
+    ctx->stopped = 1;
+}
+
+void i2c_master_shutdown(i2c_master_t *ctx)
+{
+}
+
+i2c_res_t i2c_master_write(i2c_master_t *ctx, uint8_t device_addr, uint8_t buf[], size_t n,
+                           size_t *num_bytes_sent, int send_stop_bit)
+{
+    size_t sent = es9033_model_write(device_addr, buf, n, get_reference_time());
+
+    // A NACKed address always ends with a stop condition
+    sim_i2c_transaction(ctx, sent, sent != 0, send_stop_bit || !sent);
+    if (num_bytes_sent)
+    {
+        *num_bytes_sent = sent;
+    }
+    return sent ? I2C_ACK : I2C_NACK;
+}
+
+i2c_res_t i2c_master_read(i2c_master_t *ctx, uint8_t device_addr, uint8_t buf[], size_t n, int send_stop_bit)
+{
+    int ret = es9033_model_read(device_addr, buf, n, get_reference_time());
+
+    sim_i2c_transaction(ctx, n, ret == 0, send_stop_bit || ret != 0);
+    return ret == 0 ? I2C_ACK : I2C_NACK;
+}
+
+void i2c_master_stop_bit_send(i2c_master_t *ctx)
+{
+    if (!ctx->stopped)
+    {
+        sim_i2c_bits(ctx, 1);
+        ctx->stopped = 1;
+    }
+}
+
+uint8_t read_reg(i2c_master_t *ctx, uint8_t device_addr, uint8_t reg, i2c_regop_res_t *result)
+{
+    uint8_t data = 0;
+    size_t sent;
+
+    if (i2c_master_write(ctx, device_addr, &reg, 1, &sent, 0) != I2C_ACK)
+    {
+        *result = I2C_REGOP_DEVICE_NACK;
+        return 0;
+    }
+    *result = i2c_master_read(ctx, device_addr, &data, 1, 1) == I2C_ACK ? I2C_REGOP_SUCCESS : I2C_REGOP_DEVICE_NACK;
+    return data;
+}
+
+i2c_regop_res_t write_reg(i2c_master_t *ctx, uint8_t device_addr, uint8_t reg, uint8_t data)
+{
+    uint8_t buf[2] = {reg, data};
+    size_t sent;
+
+    if (i2c_master_write(ctx, device_addr, buf, 2, &sent, 1) != I2C_ACK)
+    {
+        return I2C_REGOP_DEVICE_NACK;
+    }
+    return sent == 2 ? I2C_REGOP_SUCCESS : I2C_REGOP_INCOMPLETE;
+}
@@ -0,0 +1,365 @@
+/**
+ * @file sim_sd_card.c
+ * @brief Bit level model of an SDHC card in the 1-bit SD bus mode on the SD ports.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ */
+
+#include <string.h>
+
+#include "udsp_card_board.h"
+#include "udsp_card_recorder.h"
+
+#include "sim_sd_card.h"
+
+#define SIM_SD_CARD_QUEUE 256 // Bits queued on a line, the longest is an R2 response with its busy prefix
+#define SIM_SD_CARD_BLOCK_BITS (UDSP_CARD_RECORDER_SECTOR * 8 + 16 + 1) // Data, CRC16 and end bit
+#define SIM_SD_CARD_APP_CMD (1u << 5)
+#define SIM_SD_CARD_READY_FOR_DATA (1u << 8)
+#define SIM_SD_CARD_OCR_BUSY (1u << 31)
+#define SIM_SD_CARD_OCR_CCS (1u << 30)
+#define SIM_SD_CARD_OCR_VOLTAGE 0x00FF8000
+
+typedef enum
+{
+    SIM_SD_CARD_IDLE = 0,
+    SIM_SD_CARD_READY = 1,
+    SIM_SD_CARD_IDENT = 2,
+    SIM_SD_CARD_STBY = 3,
+    SIM_SD_CARD_TRAN = 4,
+    SIM_SD_CARD_RCV = 6,
+} sim_sd_card_state_t;
+
+typedef struct
+{
+    uint8_t bits[SIM_SD_CARD_QUEUE];
+    unsigned head;
+    unsigned len;
+} sim_sd_card_queue_t;
+
+sim_sd_card_stats_t sim_sd_card_stats;
+
+static struct
+{
+    uint8_t *image;
+    uint32_t sectors;
+    sim_sd_card_state_t state;
+    int app;                // Next command is an application command
+    int v2;                 // CMD8 was answered
+    int ccs;                // Block addressing
+    unsigned acmd41;        // ACMD41 calls since CMD0
+    uint32_t clk;           // Last host level on SD_CLK
+    int cmd_driven;         // Host drives CMD
+    uint32_t cmd_host;      // Host level on CMD
+    int dat_driven;         // Host drives SIO
+    uint32_t dat_host;      // Host level on SIO
+    uint32_t cmd_card;      // Card level on CMD
+    uint32_t dat_card;      // Card level on DAT0
+    uint64_t cmd_shift;     // Command bits received
+    unsigned cmd_bits;      // 0 while waiting for a start bit
+    uint32_t sector;        // Sector of the next block
+    unsigned block_bits;    // 0 while waiting for a start bit
+    uint8_t block[UDSP_CARD_RECORDER_SECTOR + 2];
+    sim_sd_card_queue_t cmd_out;
+    sim_sd_card_queue_t dat_out;
+} sim_sd_card;
+
+static uint8_t sim_sd_card_crc7(const uint8_t *buf, unsigned len)
+{
+    uint8_t crc = 0;
+
+    for (unsigned i = 0; i < len * 8; i++)
+    {
+        unsigned bit = (buf[i / 8] >> (7 - i % 8)) & 1;
+
+        crc = (crc << 1) ^ ((crc >> 6 ^ bit) & 1 ? 0x09 : 0);
+    }
+
+    return crc & 0x7F;
+}
+
+static uint16_t sim_sd_card_crc16(const uint8_t *buf, unsigned len)
+{
+    uint16_t crc = 0;
+
+    for (unsigned i = 0; i < len * 8; i++)
+    {
+        unsigned bit = (buf[i / 8] >> (7 - i % 8)) & 1;
+
+        crc = (crc << 1) ^ ((crc >> 15 ^ bit) & 1 ? 0x1021 : 0);
+    }
+
+    return crc;
+}
+
+static void sim_sd_card_push(sim_sd_card_queue_t *q, uint64_t value, unsigned bits)
+{
+    while (bits-- && q->len < SIM_SD_CARD_QUEUE)
+    {
+        q->bits[(q->head + q->len++) % SIM_SD_CARD_QUEUE] = (value >> bits) & 1;
+    }
+}
+
+static uint32_t sim_sd_card_pop(sim_sd_card_queue_t *q)
+{
+    uint32_t bit;
+
+    if (!q->len)
+    {
+        return 1;
+    }
+    bit = q->bits[q->head];
+    q->head = (q->head + 1) % SIM_SD_CARD_QUEUE;
+    q->len--;
+
+    return bit;
+}
+
+/**
+ * @brief Queue a 48 bit response after the two clocks of NCR.
+ **/
+static void sim_sd_card_respond(uint8_t index, uint32_t arg, int crc)
+{
+    uint8_t frame[5] = {index, arg >> 24, arg >> 16, arg >> 8, arg};
+    uint8_t end = crc ? sim_sd_card_crc7(frame, 5) << 1 | 1 : 0xFF;
+
+    sim_sd_card_push(&sim_sd_card.cmd_out, 0x3, 2);
+    for (unsigned i = 0; i < 5; i++)
+    {
+        sim_sd_card_push(&sim_sd_card.cmd_out, frame[i], 8);
+    }
+    sim_sd_card_push(&sim_sd_card.cmd_out, end, 8);
+}
+
+/**
+ * @brief Hold DAT0 low once the queued response has been sent.
+ **/
+static void sim_sd_card_busy(void)
+{
+    sim_sd_card_push(&sim_sd_card.dat_out, ~0ull, sim_sd_card.cmd_out.len);
+    sim_sd_card_push(&sim_sd_card.dat_out, 0, SIM_SD_CARD_BUSY_CLOCKS);
+}
+
+static uint32_t sim_sd_card_status(void)
+{
+    return sim_sd_card.state << 9 | SIM_SD_CARD_READY_FOR_DATA | (sim_sd_card.app ? SIM_SD_CARD_APP_CMD : 0);
+}
+
+static void sim_sd_card_command(uint64_t frame)
+{
+    uint8_t buf[5] = {frame >> 40, frame >> 32, frame >> 24, frame >> 16, frame >> 8};
+    unsigned index = buf[0] & 0x3F;
+    uint32_t arg = (uint32_t)(frame >> 8);
+    int app = sim_sd_card.app;
+    sim_sd_card_state_t state = sim_sd_card.state;
+
+    if ((buf[0] & 0xC0) != 0x40 || !(frame & 1) || sim_sd_card_crc7(buf, 5) != ((frame >> 1) & 0x7F))
+    {
+        sim_sd_card_stats.crc_errors++;
+        return;
+    }
+    sim_sd_card_stats.commands++;
+    sim_sd_card.app = 0;
+
+    if (index == 0)
+    {
+        sim_sd_card.state = SIM_SD_CARD_IDLE;
+        sim_sd_card.acmd41 = 0;
+        sim_sd_card.v2 = 0;
+        sim_sd_card.ccs = 0;
+    }
+    else if (index == 8 && state == SIM_SD_CARD_IDLE)
+    {
+        sim_sd_card.v2 = 1;
+        sim_sd_card_respond(8, arg & 0xFFF, 1);
+    }
+    else if (index == 55)
+    {
+        sim_sd_card.app = 1;
+        sim_sd_card_respond(55, sim_sd_card_status(), 1);
+    }
+    else if (app && index == 41 && state == SIM_SD_CARD_IDLE)
+    {
+        uint32_t ocr = SIM_SD_CARD_OCR_VOLTAGE;
+
+        // Powered up from the second call on
+        if (++sim_sd_card.acmd41 > 1)
+        {
+            sim_sd_card.ccs = sim_sd_card.v2 && (arg & SIM_SD_CARD_OCR_CCS);
+            ocr |= SIM_SD_CARD_OCR_BUSY | (sim_sd_card.ccs ? SIM_SD_CARD_OCR_CCS : 0);
+            sim_sd_card.state = SIM_SD_CARD_READY;
+        }
+        sim_sd_card_respond(0x3F, ocr, 0);
+    }
+    else if (index == 2 && state == SIM_SD_CARD_READY)
+    {
+        // CID contents are not modelled
+        sim_sd_card_push(&sim_sd_card.cmd_out, 0x3, 2);
+        sim_sd_card_push(&sim_sd_card.cmd_out, 0x3F, 8);
+        sim_sd_card_push(&sim_sd_card.cmd_out, 0, 64);
+        sim_sd_card_push(&sim_sd_card.cmd_out, 1, 64);
+        sim_sd_card.state = SIM_SD_CARD_IDENT;
+    }
+    else if (index == 3 && (state == SIM_SD_CARD_IDENT || state == SIM_SD_CARD_STBY))
+    {
+        sim_sd_card_respond(3, (uint32_t)SIM_SD_CARD_RCA << 16 | state << 9, 1);
+        sim_sd_card.state = SIM_SD_CARD_STBY;
+    }
+    else if (index == 7 && state == SIM_SD_CARD_STBY && arg >> 16 == SIM_SD_CARD_RCA)
+    {
+        sim_sd_card_respond(7, sim_sd_card_status(), 1);
+        sim_sd_card_busy();
+        sim_sd_card.state = SIM_SD_CARD_TRAN;
+    }
+    else if (index == 13 && state >= SIM_SD_CARD_STBY && arg >> 16 == SIM_SD_CARD_RCA)
+    {
+        sim_sd_card_respond(13, sim_sd_card_status(), 1);
+    }
+    else if (index == 16 && state == SIM_SD_CARD_TRAN && arg == UDSP_CARD_RECORDER_SECTOR)
+    {
+        sim_sd_card_respond(16, sim_sd_card_status(), 1);
+    }
+    else if (index == 25 && state == SIM_SD_CARD_TRAN)
+    {
+        sim_sd_card_respond(25, sim_sd_card_status(), 1);
+        sim_sd_card.sector = sim_sd_card.ccs ? arg : arg / UDSP_CARD_RECORDER_SECTOR;
+        sim_sd_card.block_bits = 0;
+        sim_sd_card.state = SIM_SD_CARD_RCV;
+    }
+    else if (index == 12 && state == SIM_SD_CARD_RCV)
+    {
+        sim_sd_card_respond(12, sim_sd_card_status(), 1);
+        sim_sd_card_busy();
+        sim_sd_card.state = SIM_SD_CARD_TRAN;
+    }
+    else
+    {
+        sim_sd_card_stats.illegal++;
+    }
+}
+
+/**
+ * @brief Store a received block and queue its CRC status token and busy.
+ **/
+static void sim_sd_card_block(void)
+{
+    uint16_t crc = sim_sd_card.block[UDSP_CARD_RECORDER_SECTOR] << 8 | sim_sd_card.block[UDSP_CARD_RECORDER_SECTOR + 1];
+    unsigned token = 0x2;
+
+    if (sim_sd_card_crc16(sim_sd_card.block, UDSP_CARD_RECORDER_SECTOR) != crc)
+    {
+        sim_sd_card_stats.crc_errors++;
+        token = 0x5;
+    }
+    else if (sim_sd_card.sector >= sim_sd_card.sectors)
+    {
+        sim_sd_card_stats.illegal++;
+        token = 0x6;
+    }
+    else
+    {
+        memcpy(&sim_sd_card.image[(size_t)sim_sd_card.sector++ * UDSP_CARD_RECORDER_SECTOR], sim_sd_card.block,
+               UDSP_CARD_RECORDER_SECTOR);
+        sim_sd_card_stats.blocks++;
+    }
+
+    // Two clocks of NCRC, start bit, status, end bit
+    sim_sd_card_push(&sim_sd_card.dat_out, 0x3 << 5 | token << 1 | 1, 7);
+    sim_sd_card_push(&sim_sd_card.dat_out, 0, SIM_SD_CARD_BUSY_CLOCKS);
+}
+
+static void sim_sd_card_rising(void)
+{
+    uint32_t dat0 = sim_sd_card.dat_host & 1;
+
+    if (sim_sd_card.cmd_driven && (sim_sd_card.cmd_bits || !(sim_sd_card.cmd_host & 1)))
+    {
+        sim_sd_card.cmd_shift = sim_sd_card.cmd_shift << 1 | (sim_sd_card.cmd_host & 1);
+        if (++sim_sd_card.cmd_bits == 48)
+        {
+            sim_sd_card.cmd_bits = 0;
+            sim_sd_card_command(sim_sd_card.cmd_shift & ((1ull << 48) - 1));
+        }
+    }
+
+    if (sim_sd_card.state != SIM_SD_CARD_RCV || !sim_sd_card.dat_driven)
+    {
+        return;
+    }
+    if (!sim_sd_card.block_bits)
+    {
+        if (!dat0)
+        {
+            memset(sim_sd_card.block, 0, sizeof(sim_sd_card.block));
+            sim_sd_card.block_bits = 1;
+        }
+        return;
+    }
+    if (sim_sd_card.block_bits <= (UDSP_CARD_RECORDER_SECTOR + 2) * 8)
+    {
+        unsigned i = sim_sd_card.block_bits - 1;
+
+        sim_sd_card.block[i / 8] |= dat0 << (7 - i % 8);
+    }
+    if (sim_sd_card.block_bits++ == SIM_SD_CARD_BLOCK_BITS)
+    {
+        sim_sd_card.block_bits = 0;
+        sim_sd_card_block();
+    }
+}
+
+void sim_sd_card_attach(uint8_t *image, uint32_t sectors)
+{
+    sim_sd_card_reset();
+    sim_sd_card.image = image;
+    sim_sd_card.sectors = sectors;
+}
+
+void sim_sd_card_reset(void)
+{
+    memset(&sim_sd_card, 0, sizeof(sim_sd_card));
+    memset(&sim_sd_card_stats, 0, sizeof(sim_sd_card_stats));
+    sim_sd_card.clk = 1;
+    sim_sd_card.cmd_card = 1;
+    sim_sd_card.dat_card = 1;
+}
+
+void sim_sd_card_out(port_t p, uint32_t value)
+{
+    if (p == UDSP_CARD_PORT_SD_CMD)
+    {
+        sim_sd_card.cmd_driven = 1;
+        sim_sd_card.cmd_host = value;
+    }
+    else if (p == UDSP_CARD_PORT_SD_SIO)
+    {
+        sim_sd_card.dat_driven = 1;
+        sim_sd_card.dat_host = value;
+    }
+    else if (p == UDSP_CARD_PORT_SD_CLK && sim_sd_card.image && (value & 1) != sim_sd_card.clk)
+    {
+        sim_sd_card.clk = value & 1;
+        if (sim_sd_card.clk)
+        {
+            sim_sd_card_rising();
+        }
+        else
+        {
+            sim_sd_card.cmd_card = sim_sd_card_pop(&sim_sd_card.cmd_out);
+            sim_sd_card.dat_card = sim_sd_card_pop(&sim_sd_card.dat_out);
+        }
+    }
+}
+
+uint32_t sim_sd_card_in(port_t p)
+{
+    if (p == UDSP_CARD_PORT_SD_CMD)
+    {
+        sim_sd_card.cmd_driven = 0;
+        return sim_sd_card.cmd_card;
+    }
+
+    // DAT1-3 are only pulled up
+    sim_sd_card.dat_driven = 0;
+    return 0xE | sim_sd_card.dat_card;
+}
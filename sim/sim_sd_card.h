@@ -0,0 +1,60 @@
+/**
+ * @file sim_sd_card.h
+ * @brief Bit level model of an SDHC card in the 1-bit SD bus mode on the SD ports.
+ * @author Christoph Kiener
+ * @copyright GPL-3.0
+ * @see udsp_card_sd.h
+ *
+ * The card samples CMD and DAT0 on the rising edge of UDSP_CARD_PORT_SD_CLK and
+ * changes its outputs on the falling edge. Commands and data blocks are checked
+ * against their CRCs, and commands the card would not accept in its current state
+ * get no response and are counted instead. Accepted blocks are stored in a RAM image.
+ * Only the commands of the identification and write sequence are modelled.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <xcore/port.h>
+
+/** @defgroup Sim_SD_Card_Config SD Card Bus Model Configuration
+ *  @{
+ */
+#define SIM_SD_CARD_RCA 0x1234   // Relative card address published by CMD3
+#define SIM_SD_CARD_BUSY_CLOCKS 16 // Clocks the card holds DAT0 low after a block or an R1b response
+/** @} */
+
+typedef struct
+{
+    unsigned commands;   // Commands with a valid CRC
+    unsigned crc_errors; // Commands and blocks with a bad CRC
+    unsigned blocks;     // Blocks stored
+    unsigned illegal;    // Commands not valid in the current state and blocks outside the image
+} sim_sd_card_stats_t;
+
+extern sim_sd_card_stats_t sim_sd_card_stats;
+
+/**
+ * @brief Insert a powered down card. Detached by sim_reset().
+ *
+ * @param image Card contents, sectors * 512 bytes.
+ * @param sectors Capacity in sectors.
+ */
+void sim_sd_card_attach(uint8_t *image, uint32_t sectors);
+
+/**
+ * @brief Remove the card and clear its statistics.
+ */
+void sim_sd_card_reset(void);
+
+/**
+ * @brief Host output on an SD port, called from port_out().
+ */
+void sim_sd_card_out(port_t p, uint32_t value);
+
+/**
+ * @brief Host input on an SD port, called from port_in(). Releases the line.
+ * @return The level of the line with the pull-ups of the card slot.
+ */
+uint32_t sim_sd_card_in(port_t p);
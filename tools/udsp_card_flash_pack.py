@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Pack coefficient tables, DAC init profiles and calibration data into a uDSP-Card flash store (see udsp_card_flash.h).
+
+Coefficient files hold whitespace separated integers (decimal or 0x hex), or raw
+little endian int32 data if the file name ends in .bin. DAC profile files hold
+the MCLK and sample rate on the first line, then one step per line:
+    <addr> <reg> <wait_mask> <delay_us> <value> [<value> ...]
+Calibration files are stored as they are. '#' starts a comment in text files.
+
+Program the result behind the boot image with:
+    xflash --boot-partition-size 0x100000 --data store.bin app.xe
+
+Usage: udsp_card_flash_pack.py -o store.bin [--revision N] [--coeffs ID FILE] [--dac-profile ID FILE] [--calibration ID FILE]
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = 0x46534455
+FORMAT = 2
+
+HEADER = struct.Struct("<IHHIII")
+ENTRY = struct.Struct("<HHIII")
+
+COEFFS = 1
+DAC_PROFILE = 2
+CALIBRATION = 3
+
+# es9033_profile_t with ES9033_PROFILE_STEPS steps of ES9033_STEP_MAX_LEN values. es9033_step_t is
+# padded to its uint16_t alignment, es9033_profile_t to its unsigned alignment.
+PROFILE_STEPS = 7
+STEP_MAX_LEN = 3
+STEP = struct.Struct(f"<BBBBH{STEP_MAX_LEN}s{(6 + STEP_MAX_LEN) % 2}x")
+PROFILE_BYTES = (8 + PROFILE_STEPS * STEP.size + 3) // 4 * 4
+
+
+def text_lines(path):
+    for line in open(path):
+        line = line.split("#", 1)[0].split()
+        if line:
+            yield [int(word, 0) for word in line]
+
+
+def pack_coeffs(path):
+    if path.endswith(".bin"):
+        data = open(path, "rb").read()
+        if len(data) % 4:
+            sys.exit(f"{path}: length is not a multiple of 4")
+        return data
+    values = [value for line in text_lines(path) for value in line]
+    return struct.pack(f"<{len(values)}i", *values)
+
+
+def pack_dac_profile(path):
+    lines = list(text_lines(path))
+    if not lines or len(lines[0]) != 2:
+        sys.exit(f"{path}: first line must be '<mclk> <fs>'")
+    steps = lines[1:]
+    if len(steps) > PROFILE_STEPS:
+        sys.exit(f"{path}: more than {PROFILE_STEPS} steps")
+
+    data = struct.pack("<II", *lines[0])
+    for step in steps + [[0, 0, 0, 0]] * (PROFILE_STEPS - len(steps)):
+        addr, reg, wait_mask, delay_us, *vals = step
+        if len(vals) > STEP_MAX_LEN:
+            sys.exit(f"{path}: step at reg 0x{reg:02x} has more than {STEP_MAX_LEN} values")
+        data += STEP.pack(addr, reg, len(vals), wait_mask, delay_us, bytes(vals))
+    return data + bytes(PROFILE_BYTES - len(data))
+
+
+def pad4(data):
+    return data + bytes(-len(data) % 4)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("-o", "--output", required=True, help="store image to write")
+    parser.add_argument("--revision", type=lambda s: int(s, 0), default=0, help="content revision")
+    parser.add_argument("--coeffs", nargs=2, action="append", default=[], metavar=("ID", "FILE"))
+    parser.add_argument("--dac-profile", nargs=2, action="append", default=[], metavar=("ID", "FILE"))
+    parser.add_argument("--calibration", nargs=2, action="append", default=[], metavar=("ID", "FILE"))
+    args = parser.parse_args()
+
+    records = {}
+    for kind, items, pack in ((COEFFS, args.coeffs, pack_coeffs),
+                              (DAC_PROFILE, args.dac_profile, pack_dac_profile),
+                              (CALIBRATION, args.calibration, lambda path: open(path, "rb").read())):
+        for record_id, path in items:
+            key = (kind, int(record_id, 0))
+            if key in records:
+                sys.exit(f"duplicate record type {kind} id {key[1]}")
+            records[key] = pack(path)
+
+    offset = HEADER.size + ENTRY.size * len(records)
+    directory = b""
+    payloads = b""
+    for (kind, record_id), data in sorted(records.items()):
+        directory += ENTRY.pack(kind, record_id, offset + len(payloads), len(data), zlib.crc32(pad4(data)))
+        payloads += pad4(data)
+
+    size = offset + len(payloads)
+    header = HEADER.pack(MAGIC, FORMAT, len(records), size, args.revision, zlib.crc32(directory))
+    with open(args.output, "wb") as f:
+        f.write(header + directory + payloads)
+
+    print(f"{len(records)} records, {size} bytes")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""
+Decode a uDSP-Card bring-up trace (see udsp_card_trace.h) and print a per-step timeline.
+
+The input is the raw byte stream of the xscope trace probe, i.e. the concatenated
+8-byte udsp_card_trace_entry_t records sent by udsp_card_trace_dump(), as written
+by an xscope endpoint record callback. Use '-' to read from stdin.
+
+Usage: udsp_card_trace.py <trace.bin> [--ref-mhz 100]
+"""
+
+import argparse
+import struct
+import sys
+
+ENTRY = struct.Struct("<IBBH")
+
+EVENTS = {
+    0: "START",
+    1: "PLL_CONFIG",
+    2: "I2C_INIT",
+    3: "GPIO_ENABLE",
+    4: "DAC_WRITE",
+    5: "DAC_WAIT",
+    6: "DELAY",
+    7: "DONE",
+}
+
+
+def delta(later, earlier):
+    """Signed difference of two timestamps, the reference timer is 32 bit and wraps after ~43s at 100MHz."""
+    d = (later - earlier) & 0xFFFFFFFF
+    return d - (1 << 32) if d & 0x80000000 else d
+
+
+def describe(event, arg0, arg1):
+    if event == 3:
+        return f"port=0x{arg0:x}"
+    if event == 4:
+        return f"reg=0x{arg0:02x} len={arg1}"
+    if event == 5:
+        return f"mask=0x{arg0:02x} {'timeout' if arg1 else 'ready'}"
+    if event == 6:
+        return f"{arg1}us"
+    if event == 7:
+        return "failed" if arg1 else "ok"
+    return ""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("trace", help="raw trace byte stream, '-' for stdin")
+    parser.add_argument("--ref-mhz", type=float, default=100.0, help="reference timer frequency in MHz")
+    args = parser.parse_args()
+
+    data = sys.stdin.buffer.read() if args.trace == "-" else open(args.trace, "rb").read()
+    if len(data) % ENTRY.size:
+        print(f"warning: ignoring {len(data) % ENTRY.size} trailing bytes", file=sys.stderr)
+
+    entries = [ENTRY.unpack_from(data, i) for i in range(0, len(data) - ENTRY.size + 1, ENTRY.size)]
+    if not entries:
+        print("no trace entries")
+        return
+
+    start = prev = entries[0][0]
+    print(f"{'#':>3}  {'t [us]':>10}  {'step [us]':>10}  {'event':<12} details")
+    for i, (timestamp, event, arg0, arg1) in enumerate(entries):
+        # An entry out of order shows as a negative step instead of a wrap of the timer
+        elapsed = delta(timestamp, start) / args.ref_mhz
+        step = delta(timestamp, prev) / args.ref_mhz
+        name = EVENTS.get(event, f"EVENT_{event}")
+        print(f"{i:>3}  {elapsed:>10.1f}  {step:>10.1f}  {name:<12} {describe(event, arg0, arg1)}")
+        prev = timestamp
+
+    print(f"total: {delta(prev, start) / args.ref_mhz:.1f}us")
+
+
+if __name__ == "__main__":
+    main()